@@ -3,7 +3,6 @@
 #include <vector>
 #include <queue>
 #include <ros/ros.h>
-#include "ros/callback_queue.h"
 #include "geometry_msgs/PoseStamped.h"
 #include "geometry_msgs/PointStamped.h"
 #include "geometry_msgs/TwistStamped.h"
@@ -17,7 +16,19 @@
 #include "std_msgs/Float64MultiArray.h"
 #include "../src/debug/logger/logger.h"
 #include "multi_drone_platform/api_update.h"
+#include "multi_drone_platform/state_event.h"
 #include "../src/icp_implementation/icp_object.h"
+#include "../src/drone_server/latency_histogram.h"
+#include "../src/drone_server/command_trace.h"
+#include "../src/drone_server/callback_executor.h"
+#include "../src/drone_server/triple_buffer.h"
+#include "../src/drone_server/mocap_window.h"
+#include "../src/drone_server/kalman_bank.h"
+#include "../src/collision_management/neighbour_grid.h"
+#include <array>
+#include <atomic>
+#include <limits>
+#include <mutex>
 
 #define DEFAULT_QUEUE 10
 #define TIMEOUT_HOVER 20
@@ -30,15 +41,48 @@
 // api structures
 
 /**
- * map representing all drone commands available
+ * map from the string name of each drone command to its api_update opcode. Commands are dispatched by opcode, this map
+ * is only used to translate string commands from legacy clients and data service requests.
  */
-static std::map<std::string, int> apiMap = {
-    {"VELOCITY", 0},    {"POSITION", 1},    {"TAKEOFF", 2},
-    {"LAND", 3},        {"HOVER", 4},       {"EMERGENCY", 5},
-    {"SET_HOME", 6},    {"GET_HOME", 7},    {"GOTO_HOME", 8},
-    {"ORIENTATION", 9}, {"TIME", 10},       {"DRONE_SERVER_FREQ", 11}
+static const std::map<std::string, uint8_t> apiMap = {
+    {"VELOCITY", multi_drone_platform::api_update::VELOCITY},
+    {"POSITION", multi_drone_platform::api_update::POSITION},
+    {"TAKEOFF", multi_drone_platform::api_update::TAKEOFF},
+    {"LAND", multi_drone_platform::api_update::LAND},
+    {"HOVER", multi_drone_platform::api_update::HOVER},
+    {"EMERGENCY", multi_drone_platform::api_update::EMERGENCY},
+    {"SET_HOME", multi_drone_platform::api_update::SET_HOME},
+    {"GET_HOME", multi_drone_platform::api_update::GET_HOME},
+    {"GOTO_HOME", multi_drone_platform::api_update::GOTO_HOME},
+    {"ORIENTATION", multi_drone_platform::api_update::ORIENTATION},
+    {"TIME", multi_drone_platform::api_update::TIME},
+    {"DRONE_SERVER_FREQ", multi_drone_platform::api_update::DRONE_SERVER_FREQ},
+    {"LATENCY", multi_drone_platform::api_update::LATENCY}
 };
 
+/**
+ * returns the opcode of a string command without modifying apiMap
+ * @param msgType the string name of the command ("POSITION")
+ * @return the opcode, or api_update::OPCODE_COUNT if the string is not a valid command
+ */
+inline uint8_t api_opcode_from_string(const std::string& msgType) {
+    auto it = apiMap.find(msgType);
+    return (it == apiMap.end()) ? (uint8_t)multi_drone_platform::api_update::OPCODE_COUNT : it->second;
+}
+
+/**
+ * returns the string name of an opcode intended for printing
+ * @param opcode the opcode
+ * @return the name of the command, "INVALID" if the opcode is not a valid command
+ */
+inline const char* api_opcode_to_string(uint8_t opcode) {
+    static const char* names[multi_drone_platform::api_update::OPCODE_COUNT] = {
+        "VELOCITY", "POSITION", "TAKEOFF", "LAND", "HOVER", "EMERGENCY",
+        "SET_HOME", "GET_HOME", "GOTO_HOME", "ORIENTATION", "TIME", "DRONE_SERVER_FREQ", "LATENCY"
+    };
+    return (opcode < multi_drone_platform::api_update::OPCODE_COUNT) ? names[opcode] : "INVALID";
+}
+
 /**
  * class used internally to handle timeout timers for each rigidbody
  */
@@ -98,12 +142,22 @@ class rigidbody {
         DELETED
     };
 
+    /**
+     * the collision avoidance applied by update(..) to drones carrying out commands
+     */
+    enum avoidance_engine {
+        NO_AVOIDANCE,
+        POTENTIAL_FIELDS,
+        ORCA
+    };
+
     /**
      * classes who are given direct access to the rigidbody class for a variety of reasons
      */
     friend class drone_server;
     friend class static_physical_management;
     friend class potential_fields;
+    friend class orca_avoidance;
     friend class icp_impl;
 
 /* DATA */
@@ -141,6 +195,13 @@ class rigidbody {
         ros::Publisher obstaclesPublisher;
         ros::Publisher closestObstaclePublisher;
 
+        /**
+         * latched publisher of the drone's flight state changes. It is advertised by the drone server on its own node
+         * handle so that the final DELETED event is still available after the rigidbody is deleted
+         */
+        ros::Publisher statePublisher;
+        uint32_t stateSequence = 0;
+
         /**
          * A time point representing the end of the last received command
          */
@@ -149,18 +210,42 @@ class rigidbody {
         /**
          * boolean which turns true on rigidbody shutdown. When this is set true, the drone will no longer perform commands
          */
-        bool shutdownHasBeenCalled = false;
+        std::atomic<bool> shutdownHasBeenCalled{false};
+
+        /**
+         * callback queue to facilitate asynchronous command execution, run as a strand of the drone server's shared
+         * callback executor so that the drone's callbacks keep their order without a thread per drone
+         */
+        strand_queue myQueue;
+
+        /**
+         * The current observed flight state of the drone, atomic as the emergency thread sets it while the loop reads it
+         */
+        std::atomic<flight_state> state{flight_state::UNKNOWN};
+
+        /**
+         * serialises set_state between the drone's strand and the emergency thread, so that DELETED is never overwritten
+         * and state events keep their sequence
+         */
+        std::mutex stateLock;
 
         /**
-         * ROS async spinner and callback queue to facilitate asynchronous command execution
+         * held around every call into the wrapper except on_emergency, which must never wait behind a slow wrapper call.
+         * Commands check for DELETED once they hold it, so none reach the wrapper after an emergency. Recursive as a
+         * lockstep vflie injects its motion capture from within on_update
          */
-        ros::AsyncSpinner mySpin;
-        ros::CallbackQueue myQueue;
+        std::recursive_mutex wrapperLock;
 
         /**
-         * The current observed flight state of the drone
+         * publishes the current flight state on the state publisher with the next sequence number
          */
-        flight_state state = flight_state::UNKNOWN;
+        void publish_state_event();
+
+        /**
+         * writes the drone's dimensions and collision distances under mdp/drone_<id> in a single parameter server
+         * call, called by the drone server once the drone wrapper has been initialised
+         */
+        void publish_physical_params();
 
         /**
          * The drone's timeout timer
@@ -182,12 +267,100 @@ class rigidbody {
          */
         bool isVflie = false;
 
+        /**
+         * time spent adjusting incoming commands to the static limits, recorded on the rigidbody's spinner and
+         * collected by the drone server every timing period
+         */
+        latency_histogram commandAdjustTime;
+
+        /**
+         * latency of each hop of traced commands over the session, indexed by command_trace::hop
+         */
+        std::array<latency_histogram, command_trace::HOP_COUNT> commandHops;
+
+        /**
+         * time from the drone server receiving an emergency to this drone's wrapper having handled it, over the session
+         */
+        latency_histogram emergencyLatency;
+
+        /**
+         * guards commandAdjustTime, commandHops and emergencyLatency, which are written on the rigidbody's callback queue
+         * (or the drone server's emergency thread) and read by the server
+         */
+        std::mutex timingLock;
+
+        /**
+         * the physical state of the drone as seen by the drone server's control loop
+         */
+        struct physical_snapshot {
+            geometry_msgs::Pose pose;
+            geometry_msgs::Twist velocity;
+            geometry_msgs::Vector3 homePosition;
+            flight_state state = flight_state::UNKNOWN;
+            ros::Time timeOfLastMotionCaptureUpdate;
+            /* the time the last motion capture frame was captured, as stamped by the motion capture system */
+            ros::Time motionCaptureStamp;
+            /* the last command handled and the time it ends, for collision avoidance */
+            multi_drone_platform::api_update command;
+            ros::Time commandEnd;
+        };
+
+        /**
+         * snapshots of the drone's physical state, published on the rigidbody's callback queue whenever its motion
+         * capture, flight state or command changes and latched by the drone server once at the start of every loop, so every
+         * stage of a loop sees the same state of every drone without locking
+         */
+        triple_buffer<physical_snapshot> snapshots;
+
+        /**
+         * the drone's state as estimated by the drone server's Kalman filters, set every loop before the update stage.
+         * loopEstimate is read during the loop, estimates hands the estimate to the rigidbody's callback queue
+         */
+        kalman_estimate loopEstimate;
+        triple_buffer<kalman_estimate> estimates;
+
+        /**
+         * the net repulsion of all other drones on this drone and the distance to the closest of them within range,
+         * computed for the whole swarm at once by the drone server every loop before the update stage
+         */
+        geometry_msgs::Vector3 loopRepulsion;
+        double loopClosest = std::numeric_limits<double>::max();
+
+        /**
+         * the closest any other drone has come to this drone while potential fields were applied, only touched by the
+         * update stage of the drone server's loop
+         */
+        double closestSeen = std::numeric_limits<double>::max();
+
+        /**
+         * the collision avoidance applied to the drone, set by the drone server when the drone is added
+         */
+        avoidance_engine avoidanceEngine = NO_AVOIDANCE;
+
+        /**
+         * time spent in collision avoidance by the last update(..), summed over all drones by the drone server as the
+         * cost of collision avoidance each loop
+         */
+        uint64_t loopAvoidanceNs = 0;
+
+        /**
+         * true while ORCA has replaced the drone's position command with an avoiding velocity, only touched by the update
+         * stage of the drone server's loop
+         */
+        bool orcaAvoiding = false;
+
     protected:
         /**
          * boolean representing if the drone is running low on battery charge
          */
         bool batteryDying = false; // @TODO: formalise wrapper drone use of this variable (and cflie)
 
+        /**
+         * set by the drone server when running a lock-step simulation. The rigidbody's callback queue is then drained by
+         * the drone server rather than its spinner, and virtual drones hand their pose straight to add_motion_capture
+         */
+        bool isLockstep = false;
+
         /**
          * A full copy of the last received API command, the time of this api update
          */
@@ -195,10 +368,12 @@ class rigidbody {
         ros::Time timeOfLastApiUpdate;
 
         /**
-         * The value and time of the last motion capture frame
+         * The last motion capture frame and the time it was received, and the window of recent frames the drone's
+         * velocity is estimated from
          */
-        std::queue<geometry_msgs::PoseStamped> motionCapture;
+        geometry_msgs::PoseStamped latestMotionCapture;
         ros::Time timeOfLastMotionCaptureUpdate;
+        mocap_window motionCapture;
 
         /**
          * how many of the last 4 frames were detected as moving. used in state system.
@@ -268,7 +443,7 @@ public:
     /* FUNCTIONS */
     private:
         /**
-         * calculates and updates the observed velocity of the drone using the last two motion capture frames
+         * calculates and updates the observed velocity of the drone from the recent motion capture frames
          */
         void calculate_velocity();
 
@@ -299,7 +474,7 @@ public:
         void declare_expected_state(flight_state inputState, double duration = 0.5);
 
         /**
-         * sets the flight state of the drone
+         * sets the flight state of the drone, once DELETED the state no longer changes
          * @param state the desired flight state
          */
         void set_state(const flight_state& state);
@@ -308,7 +483,7 @@ public:
          * returns the flight state of the drone
          * @return the flight state
          */
-        const flight_state& get_state() const;
+        flight_state get_state() const;
 
         /**
          * returns a string representation of the given flight state intended for printing
@@ -333,6 +508,27 @@ public:
          */
         void handle_command();
 
+        /**
+         * handlers for each api_update opcode, called through the commandHandlers jump table
+         * @param msg the command to handle
+         */
+        void handle_velocity_command(const multi_drone_platform::api_update& msg);
+        void handle_position_command(const multi_drone_platform::api_update& msg);
+        void handle_takeoff_command(const multi_drone_platform::api_update& msg);
+        void handle_land_command(const multi_drone_platform::api_update& msg);
+        void handle_hover_command(const multi_drone_platform::api_update& msg);
+        void handle_emergency_command(const multi_drone_platform::api_update& msg);
+        void handle_set_home_command(const multi_drone_platform::api_update& msg);
+        void handle_go_home_command(const multi_drone_platform::api_update& msg);
+        void handle_invalid_command(const multi_drone_platform::api_update& msg);
+
+        typedef void (rigidbody::*command_handler)(const multi_drone_platform::api_update&);
+
+        /**
+         * the command handler for each opcode, indexed by api_update::opcode
+         */
+        static const std::array<command_handler, multi_drone_platform::api_update::OPCODE_COUNT> commandHandlers;
+
         void enqueue_command(multi_drone_platform::api_update command);
         void dequeue_command();
 
@@ -378,10 +574,10 @@ public:
         geometry_msgs::PoseStamped get_motion_capture();
 
         /**
-         * main update function called on the rigidbody by the drone server with a list of all active rigidbodies on the platform
-         * @param rigidBodies a list of all declared rigidbodies on the platform
+         * main update function called on the rigidbody by the drone server with the state of every drone on the platform
+         * @param neighbours the state of all live drones on the platform, including drones of other drone server shards
          */
-        void update(std::vector<rigidbody*>& rigidBodies);
+        void update(const neighbour_grid& neighbours);
 
         /**
          * ROS callback to handle api commands
@@ -389,6 +585,102 @@ public:
          */
         void api_callback(const multi_drone_platform::api_update& msg);
 
+        /**
+         * records the hop latencies of a traced command, timingLock must be held
+         * @param msg the command as queued to the rigidbody
+         * @param dequeued the time the spinner started on the command
+         * @param adjusted the time the command finished being adjusted to the static limits
+         * @param handled the time the command finished being handled
+         */
+        void record_command_hops(const multi_drone_platform::api_update& msg, uint64_t dequeued, uint64_t adjusted, uint64_t handled);
+
+        /**
+         * publishes the current pose, velocity and flight state of the drone as its latest snapshot. Only to be called
+         * on the rigidbody's callback queue, the snapshot's single writer
+         */
+        void publish_snapshot();
+
+        /**
+         * makes the latest published snapshot current, called by the drone server at the start of every loop. The
+         * flight state is taken from state as it is, since it is also set off the callback queue (i.e. by emergencies)
+         */
+        void latch_snapshot();
+
+        /**
+         * hands the go home command of a shutdown to the command queue, run on the rigidbody's callback queue
+         * @param msg the go home command
+         */
+        void shutdown_callback(const multi_drone_platform::api_update& msg);
+
+        /**
+         * returns the snapshot latched at the start of the drone server's current loop, only valid on the drone server's
+         * loop (including the update stage) as it is replaced by the next latch
+         * @return the latched snapshot
+         */
+        const physical_snapshot& get_snapshot() const;
+
+        /**
+         * hands the drone its latest state estimate, called by the drone server every loop before the update stage
+         * @param estimate the estimate
+         */
+        void set_estimate(const kalman_estimate& estimate);
+
+        /**
+         * returns the estimate set in the drone server's current loop, only valid on the drone server's loop
+         * @return the estimate
+         */
+        const kalman_estimate& get_loop_estimate() const;
+
+        /**
+         * hands the drone its net repulsion, called by the drone server every loop before the update stage
+         * @param repulsion the repulsive velocity from all other drones
+         * @param closest the distance to the closest drone within range, the largest double when there is none
+         */
+        void set_repulsion(const geometry_msgs::Vector3& repulsion, double closest);
+
+        /**
+         * returns the repulsion set in the drone server's current loop, only valid on the drone server's loop
+         * @return the repulsive velocity
+         */
+        const geometry_msgs::Vector3& get_loop_repulsion() const;
+
+        /**
+         * returns the distance to the closest drone set in the drone server's current loop
+         * @return the distance, the largest double when no drone is within range
+         */
+        double get_loop_closest() const;
+
+        /**
+         * predicts the position of the drone at a time from its latest state estimate, falling back to its last motion
+         * capture position before it has an estimate. Only to be called on the rigidbody's callback queue
+         * @param time the time to predict the position at
+         * @return the predicted position
+         */
+        geometry_msgs::Vector3 predict_position(const ros::Time& time);
+
+        /**
+         * queues an api command directly onto this rigidbody's callback queue, as if received on its api topic
+         * @param msg the api command
+         * @return false if the rigidbody is no longer accepting api commands
+         */
+        bool enqueue_api_update(const multi_drone_platform::api_update& msg);
+
+        /**
+         * queues the result of collision avoidance onto this rigidbody's callback queue, so that the wrapper is only told
+         * to move by the drone's own callbacks rather than the drone server's loop or update workers
+         * @param msg a VELOCITY update with the avoiding velocity, or a POSITION update resuming the command
+         * @param pCommandEnd the end of the command the result was computed for, as read from the loop's snapshot
+         */
+        void enqueue_avoidance(const multi_drone_platform::api_update& msg, const ros::Time& pCommandEnd);
+
+        /**
+         * applies a result of collision avoidance queued by enqueue_avoidance, unless the command it was computed for
+         * has since been replaced. Only to be called on the rigidbody's callback queue
+         * @param msg the avoiding velocity or resumed position
+         * @param pCommandEnd the end of the command the result was computed for
+         */
+        void apply_avoidance(const multi_drone_platform::api_update& msg, const ros::Time& pCommandEnd);
+
         /**
          * calls emergency on this rigidbody
          */
@@ -460,6 +752,13 @@ public:
         template <class T>
         void log_coord(logger::log_type msgType, std::string dataLabel, T data);
 
+        /**
+         * hands a motion capture frame to the rigidbody directly rather than through the motion capture topic, used by
+         * virtual drones in a lock-step simulation
+         * @param msg the motion capture frame, in the motion capture system's coordinates
+         */
+        void inject_motion_capture(const geometry_msgs::PoseStamped& msg);
+
         /**
          * returns the end yaw when a yawrate of the given duration is conducted on the drone.
          * @param yawrate the input yaw rate to rotate the drone by in degrees
@@ -521,6 +820,9 @@ public:
         /**
          * on_emergency is called whenever an emergency call is sent to the drone. At this point the drone should stop
          * all operation in hopes of preventing damage. It is not expected that the drone continues flight after this call.
+         * Platform-wide emergencies call this on one of the drone server's emergency threads as soon as they are received.
+         * on_emergency is not serialised with the other wrapper functions and may run alongside any of them, so it must
+         * guard any state it shares with them. No on_set_*, on_takeoff or on_land is called once it has been called.
          */
         virtual void on_emergency() = 0;
 
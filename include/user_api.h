@@ -86,6 +86,19 @@ struct velocity_msg {
     double yawRate = 0.0;
 };
 
+/**
+ * a structure summarising the distribution of a duration measured by the drone server. All values are in seconds.
+ * @see timings
+ */
+struct timing_distribution {
+    float p50 = 0.0f;
+    float p99 = 0.0f;
+    float p999 = 0.0f;
+    float max = 0.0f;
+    float mean = 0.0f;
+    uint64_t sampleCount = 0;
+};
+
 /**
  * a structure containing timings information returned by a call to get_operating_frequencies()
  * @see get_operating_frequencies
@@ -98,6 +111,18 @@ struct timings {
     float timeToUpdateDrones = 0.0f;
     float waitTimePerFrame = 0.0f;
 
+    /**
+     * distributions over the drone server session of the loop period, the time taken to update all drones, the slack
+     * remaining before each loop deadline, the time taken to adjust each command to the static limits, and the time
+     * spent on collision avoidance each loop. overruns is the number of loop deadlines the drone server has missed.
+     */
+    timing_distribution loopPeriod;
+    timing_distribution droneUpdateTime;
+    timing_distribution slack;
+    timing_distribution commandAdjustTime;
+    timing_distribution avoidanceTime;
+    uint64_t overruns = 0;
+
     /**
      * checks whether the current structure data is valid.
      * @return boolean
@@ -105,6 +130,105 @@ struct timings {
     bool isValid() const;
 };
 
+/**
+ * a structure containing the latency of each stage a drone's commands pass through, from being sent by a user program to
+ * being handled by the drone's wrapper. Returned by get_command_latency(), distributions are over the drone server
+ * session. Stages spanning two hosts are only measured when the user program runs on the drone server's host.
+ * @see get_command_latency
+ */
+struct command_latency {
+    id respectiveID{};
+    float timeStampSec = 0.0f;
+    /* user program publish to drone server receive */
+    timing_distribution transport;
+    /* drone server receive to the drone's command queue */
+    timing_distribution server;
+    /* waiting in the drone's command queue */
+    timing_distribution queue;
+    /* static limit adjustment of the command */
+    timing_distribution adjust;
+    /* handling of the command, including the drone wrapper */
+    timing_distribution handle;
+    /* user program publish to the end of handling */
+    timing_distribution total;
+
+    /**
+     * checks whether the current structure data is valid. This will return false if the respective mdp::id does not
+     * exist on the drone-server.
+     * @return boolean
+     */
+    bool isValid() const;
+};
+
+/**
+ * a set of drone commands that are sent to the drone server together in a single message by a call to
+ * send_command_batch(). Each function mirrors the user api function of the same name, but only adds the command to the
+ * batch. Prefer this over individual calls when commanding many drones in the same frame.
+ * @see send_command_batch
+ */
+class command_batch {
+public:
+    void set_drone_velocity(const mdp::id& id, mdp::velocity_msg msg);
+    void set_drone_position(const mdp::id& id, mdp::position_msg msg);
+    void cmd_takeoff(const mdp::id& id, float height = 0.5f, float duration = 2.0f);
+    void cmd_land(const mdp::id& id, float duration = 2.0f);
+    void cmd_emergency(const mdp::id& id);
+    void cmd_hover(const mdp::id& id, float duration = 10.0f);
+    void go_to_home(const mdp::id& id, float duration = 4.0f, float height = -1.0f);
+
+    /**
+     * removes all commands from the batch
+     */
+    void clear();
+
+    /**
+     * returns the number of commands in the batch
+     */
+    size_t size() const;
+
+    /**
+     * a single command within the batch, used internally
+     */
+    struct command {
+        uint32_t droneID = 0;
+        uint8_t opcode = 0;
+        std::array<double, 3> posVel = {{0.0, 0.0, 0.0}};
+        double yaw = 0.0;
+        double duration = 0.0;
+        bool relativeXY = false;
+        bool relativeZ = false;
+    };
+
+    /**
+     * returns the commands in the batch, used internally
+     */
+    const std::vector<command>& get_commands() const;
+
+private:
+    command& add(const mdp::id& id, uint8_t opcode);
+
+    std::vector<command> commands;
+};
+
+/**
+ * a structure containing the drone server's response to a command batch, returned by get_command_batch_result()
+ * @see get_command_batch_result
+ */
+struct batch_result {
+    uint32_t batchID = 0;
+    uint32_t accepted = 0;
+    uint32_t rejected = 0;
+    /**
+     * the ids of the drones whose commands were rejected (the drone does not exist or is shutting down)
+     */
+    std::vector<uint32_t> rejectedIDs;
+    /**
+     * checks whether the drone server's response has been received
+     * @return boolean
+     */
+    bool isValid() const;
+};
+
 /**
  * A possible state the drone can be in. This enum is returned by mdp::get_state(...)
  * @see get_state
@@ -132,7 +256,8 @@ void initialise(double updateRate, std::string nodeName);
 void terminate(bool land_drones = true);
 
 /**
- * returns a list of all the rigidbodies currently active on the drone server.
+ * returns a list of all the rigidbodies currently active on the drone server. The list is cached and kept up to date by
+ * the drone server's membership events, so this is cheap to call repeatedly.
  * @return a list of all active rigidbodies as mdp::id structures
  */
 std::vector<mdp::id> get_all_rigidbodies();
@@ -223,6 +348,22 @@ position_data get_home(const mdp::id& id);
  */
 void go_to_home(const mdp::id& id, float duration = 4.0f, float height = -1.0f);
 
+/**
+ * sends every command in the given batch to the drone server in a single message
+ * @param batch the commands to send
+ * @return an id identifying this batch, used to retrieve the drone server's response
+ * @see get_command_batch_result
+ */
+uint32_t send_command_batch(const mdp::command_batch& batch);
+
+/**
+ * returns the number of commands the drone server accepted and rejected from a batch sent with send_command_batch().
+ * Results are received asynchronously, if the response has not yet been received the returned structure is not valid.
+ * @param batchID the id returned by send_command_batch()
+ * @return a batch_result structure for the batch
+ */
+batch_result get_command_batch_result(uint32_t batchID);
+
 /**
  * sets the update frequency for the drone server (default 100Hz)
  * @param updateFrequency the desired update frequency in Hertz
@@ -235,6 +376,13 @@ void set_drone_server_update_frequency(float updateFrequency);
  */
 timings get_operating_frequencies();
 
+/**
+ * returns the latency of each stage the drone's commands have passed through on their way to the drone
+ * @param id the drone
+ * @return a command_latency data structure
+ */
+command_latency get_command_latency(const mdp::id& id);
+
 /**
  * sleeps the program until the rate has passed as defined in mdp::initialise.
  * Calling this regularly results in code being run in quantised time.
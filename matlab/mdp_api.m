@@ -2,6 +2,10 @@
 classdef mdp_api
     %MDP_API Summary of this class goes here
     %   Detailed explanation goes here
+    %   Drones are listed by the list_drones service and their states read
+    %   from the drone server's state events, which are multi_drone_platform
+    %   messages. Generate them once with rosgenmsg on the folder holding
+    %   the multi_drone_platform package.
     
     properties (SetAccess = private)
         APINode
@@ -53,7 +57,7 @@ classdef mdp_api
 
             fprintf("Initialising Client API Connection\n");
             obj.pub = rospublisher('/mdp', 'geometry_msgs/TransformStamped');
-            obj.list_srv_cli = rossvcclient('/mdp_list_srv');
+            obj.list_srv_cli = rossvcclient('/mdp_list_srv', 'multi_drone_platform/list_drones');
             obj.data_srv_cli = rossvcclient('/mdp_data_srv');
 
             obj.loop_rate_value = UpdateRate;
@@ -75,12 +79,12 @@ classdef mdp_api
             if land_drones
                 Drones = getalldrones(obj);
                 for i = 1 : size(Drones)
-                    if getstate(Drones(i)) ~= mdp_flight_state.DELETED
+                    if getstate(obj, Drones(i)) ~= mdp_flight_state.DELETED
                         cmdland(obj, Drones(i), 4.0);
                     end
                 end
                 for i = 1 : size(Drones)
-                    if getstate(Drones(i)) ~= mdp_flight_state.DELETED
+                    if getstate(obj, Drones(i)) ~= mdp_flight_state.DELETED
                         sleepuntilidle(obj, Drones(i));
                     end
                 end
@@ -92,21 +96,17 @@ classdef mdp_api
         end
         
         function DroneList = getalldrones(obj)
-            req = rosmessage('tf2_msgs/FrameGraphRequest');
             DroneList = [];
             if rosparam('get','mdp/should_shut_down') == false
+                % a known version of 0 always returns the whole list
+                req = rosmessage(obj.list_srv_cli);
+                req.KnownVersion = 0;
                 res = call(obj.list_srv_cli, req);
-                drones_str = split(res.FrameYaml, ' ');
 
-                for i = 1 : size(drones_str)
-                    if (drones_str(i) == "")
-                        continue
-                    end
-                    id_arr = split(drones_str(i), ':');
+                for i = 1 : numel(res.DroneIDs)
                     id = mdp_id(0, '');
-                    id.NumericId = uint32(str2double(id_arr(1)));
-                    CellArr = id_arr(2);
-                    id.Name = CellArr{:};
+                    id.NumericId = uint32(res.DroneIDs(i));
+                    id.Name = res.Tags{i};
                     DroneList = [DroneList id];
 
                     % if drone does not exist in DroneDataMap, then add it
@@ -226,6 +226,12 @@ classdef mdp_api
             Timings.MoCapUpdateRate = res.Plan.Poses(1).Pose.Position.Z;
             Timings.TimeToUpdateDrones = res.Plan.Poses(1).Pose.Orientation.X;
             Timings.WaitTimePerFrame = res.Plan.Poses(1).Pose.Orientation.Y;
+            Timings.Overruns = res.Plan.Poses(1).Pose.Orientation.W;
+            if numel(res.Plan.Poses) >= 4
+                Timings.LoopPeriod = decodetimingdistribution(res.Plan.Poses(2).Pose);
+                Timings.DroneUpdateTime = decodetimingdistribution(res.Plan.Poses(3).Pose);
+                Timings.Slack = decodetimingdistribution(res.Plan.Poses(4).Pose);
+            end
         end
 
         function spinuntilrate(obj)
@@ -238,35 +244,30 @@ classdef mdp_api
             obj.loop_rate.reset();
             obj.loop_rate.waitfor();
 
-            StateParam = strcat("mdp/drone_", num2str(drone.NumericId), "/state");
-            DroneState = "";
-            Ptree = rosparam();
-            DroneState = Ptree.get(StateParam);
             while true
-                if (DroneState == "DELETED" || DroneState == "LANDED" || DroneState == "HOVERING" || DroneState == "" || DroneState == "UNKNOWN")
+                DroneState = getstate(obj, drone);
+                if (DroneState == mdp_flight_state.DELETED || DroneState == mdp_flight_state.LANDED || DroneState == mdp_flight_state.HOVERING || DroneState == mdp_flight_state.UNKNOWN)
                     break;
                 end
 
                 obj.spinuntilrate();
-                DroneState = Ptree.get(StateParam);
             end
         end
 
         function State = getstate(obj, drone)
-            StateParam = strcat("mdp/drone_", num2str(drone.NumericId), "/state");
-            Ptree = rosparam();
-            if has(Ptree,StateParam) 
-                StrState = get(Ptree,StateParam);
-                if StrState
-                    State = mdp_flight_state.convertstringtoflightstate(StrState);
-                else
-                    State = mdp_flight_state.convertstringtoflightstate('DELETED');
+            % drones unknown to the client, or whose state has not arrived yet, are reported as deleted
+            State = mdp_flight_state.DELETED;
+            if isKey(obj.DroneDataMap, drone.NumericId)
+                Event = obj.DroneDataMap(drone.NumericId).getlateststate();
+                if ~isempty(Event)
+                    State = mdp_flight_state.convertstateeventtoflightstate(Event.State);
                 end
-            else 
-                State = mdp_flight_state.convertstringtoflightstate('DELETED');
             end
-            
         end
     end
 end
 
+
+function Distribution = decodetimingdistribution(pose)
+    Distribution = [pose.Position.X, pose.Position.Y, pose.Position.Z, pose.Orientation.X, pose.Orientation.Y];
+end
@@ -3,6 +3,7 @@ classdef mdp_drone_data
     properties (GetAccess=private)
         PoseSubscriber
         TwistSubscriber
+        StateSubscriber
     end
 
     methods
@@ -10,6 +11,8 @@ classdef mdp_drone_data
             TopicHeader = strcat('/mdp/drone_', num2str(DroneID));
             obj.PoseSubscriber = robotics.ros.Subscriber(RosNode, strcat(TopicHeader, '/curr_pose'));
             obj.TwistSubscriber = robotics.ros.Subscriber(RosNode, strcat(TopicHeader, '/curr_twist'));
+            % state events are latched, so the drone's current state arrives as soon as the subscriber connects
+            obj.StateSubscriber = robotics.ros.Subscriber(RosNode, strcat(TopicHeader, '/state'), 'multi_drone_platform/state_event');
         end
 
         function Pose = getlatestpose(obj)
@@ -19,5 +22,9 @@ classdef mdp_drone_data
         function Twist = getlatesttwist(obj)
             Twist = obj.TwistSubscriber.LatestMessage;
         end
+
+        function Event = getlateststate(obj)
+            Event = obj.StateSubscriber.LatestMessage;
+        end
     end
 end
\ No newline at end of file
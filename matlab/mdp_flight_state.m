@@ -25,5 +25,21 @@ classdef mdp_flight_state
                     State = mdp_flight_state.UNKNOWN;
             end
         end
+
+        function State = convertstateeventtoflightstate(StateValue)
+            % the values of multi_drone_platform/state_event's state field
+            switch StateValue
+                case 1
+                    State = mdp_flight_state.LANDED;
+                case 2
+                    State = mdp_flight_state.HOVERING;
+                case 3
+                    State = mdp_flight_state.MOVING;
+                case 4
+                    State = mdp_flight_state.DELETED;
+                otherwise
+                    State = mdp_flight_state.UNKNOWN;
+            end
+        end
     end
 end
\ No newline at end of file
@@ -7,6 +7,11 @@ classdef mdp_timings
         ActualDroneServerUpdateRate = 0
         TimeToUpdateDrones = 0
         WaitTimePerFrame = 0
+        % [p50, p99, p99.9, max, mean] in seconds
+        LoopPeriod = zeros(1, 5)
+        DroneUpdateTime = zeros(1, 5)
+        Slack = zeros(1, 5)
+        Overruns = 0
     end
 
     methods
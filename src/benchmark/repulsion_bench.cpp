@@ -0,0 +1,157 @@
+#include "../collision_management/neighbour_grid.h"
+#include "../collision_management/repulsion_kernel.h"
+#include "../collision_management/utility_functions.cpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+/**
+ * repulsion_bench times the potential field repulsion of a whole swarm computed by the per-drone path (walking the
+ * neighbour grid around each drone and evaluating every obstacle with geometry_msgs vectors, as the update stage did)
+ * against the structure-of-arrays repulsion kernel evaluating each pair once, and checks that both give the same forces.
+ * Drones are scattered uniformly over a volume whose size grows with the swarm, keeping the density of a crowded flying
+ * space.
+ *
+ * usage: rosrun multi_drone_platform repulsion_bench [N ...]
+ */
+
+/* gains of potential_fields, repeated here so that the benchmark does not depend on the rigidbody */
+#define BENCH_K_P 6.0
+#define BENCH_K_D 0.8
+
+#define RESTRICTED_DISTANCE 0.3
+#define INFLUENCE_DISTANCE 0.6
+#define MAX_VEL 1.0
+#define MAX_SPEED 0.5
+
+/* volume per drone in cubic meters, and the number of times each path is run per swarm size */
+#define VOLUME_PER_DRONE 0.25
+#define REPETITIONS 50
+
+/**
+ * returns the repulsion on a drone from every other drone as the per-drone path computes it
+ */
+geometry_msgs::Vector3 reference_repulsion(const neighbour_state& self, const neighbour_grid& grid, double& closest) {
+    geometry_msgs::Vector3 repulsion;
+    geometry_msgs::Vector3 point;
+    point.x = self.position.x;
+    point.y = self.position.y;
+    point.z = self.position.z;
+    grid.for_each_near(point, [&](const neighbour_state& rb) {
+        if (rb.droneID == self.droneID) return;
+
+        geometry_msgs::Vector3 obPoint;
+        obPoint.x = rb.position.x;
+        obPoint.y = rb.position.y;
+        obPoint.z = rb.position.z;
+        auto diffVec = utility_functions::difference(point, obPoint);
+        double d0 = utility_functions::magnitude(diffVec);
+        if (d0 > rb.influenceDistance && d0 > rb.restrictedDistance) return;
+        auto unitDirection = utility_functions::multiply_by_constant(diffVec, 1 / d0);
+        closest = std::min(closest, d0);
+
+        double vr = self.maxVel;
+        if (d0 > rb.restrictedDistance) {
+            double velDiff = utility_functions::distance_between(self.velocity, rb.velocity);
+            vr = BENCH_K_P * (rb.influenceDistance - d0) + BENCH_K_D * velDiff;
+        }
+        repulsion = utility_functions::add_vec3_or_point(repulsion,
+                utility_functions::multiply_by_constant(unitDirection, vr));
+    });
+    return repulsion;
+}
+
+double seconds_since(const std::chrono::steady_clock::time_point& start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+void run_swarm(size_t droneCount, std::mt19937& random) {
+    double side = std::cbrt(VOLUME_PER_DRONE * (double)droneCount);
+    std::uniform_real_distribution<double> position(0.0, side);
+    std::uniform_real_distribution<double> speed(-MAX_SPEED, MAX_SPEED);
+
+    std::vector<neighbour_state> states(droneCount);
+    for (size_t i = 0; i < droneCount; i++) {
+        neighbour_state& state = states[i];
+        state.droneID = (uint32_t)i;
+        state.position.x = position(random);
+        state.position.y = position(random);
+        state.position.z = position(random);
+        state.velocity.x = speed(random);
+        state.velocity.y = speed(random);
+        state.velocity.z = speed(random);
+        state.restrictedDistance = RESTRICTED_DISTANCE;
+        state.influenceDistance = INFLUENCE_DISTANCE;
+        state.maxVel = MAX_VEL;
+    }
+
+    /* the per-drone path, rebuilding the grid every run as the drone server does every loop */
+    neighbour_grid grid;
+    std::vector<geometry_msgs::Vector3> reference(droneCount);
+    std::vector<double> referenceClosest(droneCount);
+    auto start = std::chrono::steady_clock::now();
+    for (size_t run = 0; run < REPETITIONS; run++) {
+        grid.clear();
+        for (const neighbour_state& state : states) grid.add(state);
+        grid.build();
+        for (size_t i = 0; i < droneCount; i++) {
+            referenceClosest[i] = std::numeric_limits<double>::max();
+            reference[i] = reference_repulsion(states[i], grid, referenceClosest[i]);
+        }
+    }
+    double referenceTime = seconds_since(start) / REPETITIONS;
+
+    /* the kernel, including building the grid and filling its arrays from the grid */
+    repulsion_swarm swarm;
+    start = std::chrono::steady_clock::now();
+    for (size_t run = 0; run < REPETITIONS; run++) {
+        grid.clear();
+        for (const neighbour_state& state : states) grid.add(state);
+        grid.build();
+        swarm.load(grid);
+        compute_repulsion(swarm, grid, BENCH_K_P, BENCH_K_D);
+    }
+    double kernelTime = seconds_since(start) / REPETITIONS;
+
+    double maxError = 0.0;
+    size_t closestMismatches = 0;
+    for (size_t i = 0; i < droneCount; i++) {
+        maxError = std::max(maxError, std::abs(reference[i].x - swarm.forceX[i]));
+        maxError = std::max(maxError, std::abs(reference[i].y - swarm.forceY[i]));
+        maxError = std::max(maxError, std::abs(reference[i].z - swarm.forceZ[i]));
+        if (std::abs(referenceClosest[i] - swarm.closest[i]) > 1e-9) closestMismatches++;
+    }
+
+    std::cout << std::setw(6) << droneCount
+              << std::fixed << std::setprecision(1)
+              << std::setw(14) << referenceTime * 1e6
+              << std::setw(14) << kernelTime * 1e6
+              << std::setprecision(2) << std::setw(10) << referenceTime / kernelTime
+              << std::scientific << std::setprecision(2) << std::setw(14) << maxError
+              << std::setw(10) << closestMismatches << std::endl;
+}
+
+int main(int argc, char** argv) {
+    std::vector<size_t> droneCounts;
+    for (int i = 1; i < argc; i++) {
+        droneCounts.push_back((size_t)std::strtoul(argv[i], nullptr, 10));
+    }
+    if (droneCounts.empty()) {
+        droneCounts = {10, 50, 100, 250, 500, 1000};
+    }
+
+    std::mt19937 random(42);
+    std::cout << std::setw(6) << "N" << std::setw(14) << "per drone us" << std::setw(14) << "kernel us"
+              << std::setw(10) << "speedup" << std::setw(14) << "max error" << std::setw(10) << "closest" << std::endl;
+    for (size_t droneCount : droneCounts) {
+        run_swarm(droneCount, random);
+    }
+    return 0;
+}
@@ -0,0 +1,348 @@
+#include "ros/ros.h"
+#include "ros/master.h"
+#include "ros/network.h"
+#include "xmlrpcpp/XmlRpc.h"
+#include "user_api.h"
+#include "multi_drone_platform/add_drone.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * swarm_bench spawns increasing numbers of vflies on a running drone server, drives each swarm size through the same
+ * scripted workload (takeoff, formation move, crossing paths, command latency probes) and writes a JSON report of how
+ * the drone server scaled. The drone server should be running in real time (not a lock-step simulation) on this host,
+ * without other drones.
+ *
+ * usage: rosrun multi_drone_platform swarm_bench [report.json] [N ...]
+ */
+
+#define NODE_NAME "swarm_bench"
+#define ADD_DRONE_TOPIC "mdp/add_drone_srv"
+#define DRONE_SERVER_NODE "/mdp_drone_server"
+#define UPDATE_RATE 100
+
+#define DEFAULT_REPORT "swarm_bench.json"
+
+/* spacing of the vflie home grid in meters, and the number of drones per grid row */
+#define HOME_SPACING 0.5
+#define HOME_ROW_LENGTH 20
+
+#define TAKEOFF_HEIGHT 1.0f
+#define TAKEOFF_TIME 2.0f
+#define FORMATION_TIME 3.0f
+#define CROSSING_TIME 4.0f
+#define LAND_TIME 2.0f
+
+/* time to hover after the workload so that the drone server folds at least one full timing period (see TIMING_UPDATE) */
+#define HOLD_TIME 6.0
+
+/* number of drones probed for command to motion latency, the displacement counted as motion, and the probe timeout */
+#define LATENCY_PROBES 10
+#define LATENCY_MOVE 0.3
+#define LATENCY_THRESHOLD 0.01
+#define LATENCY_TIMEOUT 2.0
+
+/**
+ * results of the workload at a single swarm size
+ */
+struct bench_result {
+    size_t droneCount = 0;
+    double loopRateHz = 0.0;
+    double updateTimeMean = 0.0;
+    double updateTimePerDrone = 0.0;
+    double commandAdjustTimeMean = 0.0;
+    double avoidanceTimeMean = 0.0;
+    mdp::timing_distribution loopPeriod;
+    mdp::timing_distribution commandAdjustTime;
+    mdp::timing_distribution avoidanceTime;
+    uint64_t overruns = 0;
+    std::vector<double> commandLatencies;
+    long memoryPerDroneKb = 0;
+    double workloadTime = 0.0;
+};
+
+/**
+ * returns the resident memory of a process on this host in kB, or -1 if it could not be read
+ */
+long get_rss_kb(int pid) {
+    std::ifstream status("/proc/" + std::to_string(pid) + "/status");
+    std::string line;
+    while (std::getline(status, line)) {
+        if (line.compare(0, 6, "VmRSS:") == 0) {
+            return std::atol(line.c_str() + 6);
+        }
+    }
+    return -1;
+}
+
+/**
+ * asks the drone server node for its process id through the ROS slave API
+ * @return the pid, or -1 if the drone server could not be contacted
+ */
+int get_drone_server_pid() {
+    XmlRpc::XmlRpcValue args, result, payload;
+    args[0] = ros::this_node::getName();
+    args[1] = DRONE_SERVER_NODE;
+    if (!ros::master::execute("lookupNode", args, result, payload, true)) return -1;
+
+    std::string host;
+    uint32_t port;
+    if (!ros::network::splitURI((std::string)payload, host, port)) return -1;
+
+    XmlRpc::XmlRpcClient client(host.c_str(), (int)port, "/");
+    XmlRpc::XmlRpcValue pidArgs, pidResult;
+    pidArgs[0] = ros::this_node::getName();
+    if (!client.execute("getPid", pidArgs, pidResult) || pidResult.getType() != XmlRpc::XmlRpcValue::TypeArray
+        || pidResult.size() < 3 || (int)pidResult[0] != 1) {
+        return -1;
+    }
+    return (int)pidResult[2];
+}
+
+/**
+ * adds vflies to the drone server until it holds pTargetCount drones
+ * @return the drones on the drone server, which may be fewer than pTargetCount if adding failed
+ */
+std::vector<mdp::id> spawn_vflies(ros::ServiceClient& addClient, size_t pTargetCount) {
+    std::vector<mdp::id> drones = mdp::get_all_rigidbodies();
+    for (size_t i = drones.size(); i < pTargetCount; i++) {
+        multi_drone_platform::add_drone msg;
+        msg.request.droneName = "vflie_b" + std::to_string(i);
+        msg.request.arguments = {
+            std::to_string((double)(i % HOME_ROW_LENGTH) * HOME_SPACING),
+            std::to_string((double)(i / HOME_ROW_LENGTH) * HOME_SPACING)
+        };
+        if (!addClient.call(msg) || !msg.response.success) {
+            ROS_ERROR("Failed to add '%s'", msg.request.droneName.c_str());
+            break;
+        }
+    }
+
+    /* wait for the membership events of the new drones */
+    ros::WallTime deadline = ros::WallTime::now() + ros::WallDuration(5.0);
+    while (drones.size() < pTargetCount && ros::WallTime::now() < deadline) {
+        ros::WallDuration(0.05).sleep();
+        drones = mdp::get_all_rigidbodies();
+    }
+    return drones;
+}
+
+void sleep_until_all_idle(const std::vector<mdp::id>& drones) {
+    for (const auto& drone : drones) {
+        mdp::sleep_until_idle(drone);
+    }
+}
+
+/**
+ * moves every drone to its point on a circle around the home grid, offset by pOffset points around the circle. An
+ * offset of half the drone count sends every drone across the circle, so all paths cross in the middle.
+ */
+void move_to_circle(const std::vector<mdp::id>& drones, size_t pOffset, float pDuration) {
+    double centreX = (double)(std::min(drones.size(), (size_t)HOME_ROW_LENGTH) - 1) * HOME_SPACING * 0.5;
+    double centreY = (double)((drones.size() - 1) / HOME_ROW_LENGTH) * HOME_SPACING * 0.5;
+    double radius = std::max(1.0, (double)drones.size() * HOME_SPACING / (2.0 * M_PI));
+
+    mdp::command_batch batch;
+    for (size_t i = 0; i < drones.size(); i++) {
+        double angle = 2.0 * M_PI * (double)((i + pOffset) % drones.size()) / (double)drones.size();
+        mdp::position_msg msg;
+        msg.position = {{centreX + radius * std::cos(angle), centreY + radius * std::sin(angle), 0.0}};
+        msg.keepHeight = true;
+        msg.duration = pDuration;
+        batch.set_drone_position(drones[i], msg);
+    }
+    mdp::send_command_batch(batch);
+}
+
+/**
+ * measures the time from sending a small relative move to a hovering drone until its position starts to change
+ * @return the latency in seconds, or a negative value if the drone did not move in time
+ */
+double probe_command_latency(const mdp::id& drone) {
+    mdp::position_data start = mdp::get_position(drone);
+
+    mdp::position_msg msg;
+    msg.position = {{LATENCY_MOVE, 0.0, 0.0}};
+    msg.relative = true;
+    msg.keepHeight = true;
+    msg.duration = 1.0;
+
+    ros::WallTime sent = ros::WallTime::now();
+    mdp::set_drone_position(drone, msg);
+
+    double latency = -1.0;
+    while ((ros::WallTime::now() - sent).toSec() < LATENCY_TIMEOUT) {
+        mdp::position_data current = mdp::get_position(drone);
+        double dx = current.x - start.x, dy = current.y - start.y, dz = current.z - start.z;
+        if (std::sqrt(dx * dx + dy * dy + dz * dz) > LATENCY_THRESHOLD) {
+            latency = (ros::WallTime::now() - sent).toSec();
+            break;
+        }
+        std::this_thread::sleep_for(std::chrono::microseconds(500));
+    }
+
+    mdp::sleep_until_idle(drone);
+    return latency;
+}
+
+/**
+ * returns the mean of the samples recorded between two session distributions
+ */
+double get_interval_mean(const mdp::timing_distribution& before, const mdp::timing_distribution& after) {
+    if (after.sampleCount <= before.sampleCount) return 0.0;
+    double sum = ((double)after.mean * after.sampleCount) - ((double)before.mean * before.sampleCount);
+    return sum / (double)(after.sampleCount - before.sampleCount);
+}
+
+double get_percentile(std::vector<double> values, double percentile) {
+    if (values.empty()) return 0.0;
+    std::sort(values.begin(), values.end());
+    size_t index = (size_t)std::ceil((percentile / 100.0) * (double)values.size());
+    return values[std::min(values.size() - 1, (index > 0) ? index - 1 : 0)];
+}
+
+bench_result run_workload(const std::vector<mdp::id>& drones, int serverPid, long baselineRssKb) {
+    bench_result result;
+    result.droneCount = drones.size();
+    mdp::timings before = mdp::get_operating_frequencies();
+    ros::WallTime workloadStart = ros::WallTime::now();
+
+    ROS_INFO("[%zu drones] takeoff", drones.size());
+    mdp::command_batch batch;
+    for (const auto& drone : drones) {
+        batch.cmd_takeoff(drone, TAKEOFF_HEIGHT, TAKEOFF_TIME);
+    }
+    mdp::send_command_batch(batch);
+    sleep_until_all_idle(drones);
+
+    ROS_INFO("[%zu drones] formation", drones.size());
+    move_to_circle(drones, 0, FORMATION_TIME);
+    sleep_until_all_idle(drones);
+
+    ROS_INFO("[%zu drones] crossing paths", drones.size());
+    move_to_circle(drones, drones.size() / 2, CROSSING_TIME);
+    sleep_until_all_idle(drones);
+
+    ROS_INFO("[%zu drones] command latency", drones.size());
+    for (size_t i = 0; i < drones.size() && i < LATENCY_PROBES; i++) {
+        double latency = probe_command_latency(drones[i]);
+        if (latency >= 0.0) {
+            result.commandLatencies.push_back(latency);
+        } else {
+            ROS_WARN("Drone '%s' did not move within %.1fs", drones[i].name.c_str(), LATENCY_TIMEOUT);
+        }
+    }
+
+    ros::WallDuration(HOLD_TIME).sleep();
+    result.workloadTime = (ros::WallTime::now() - workloadStart).toSec();
+
+    mdp::timings after = mdp::get_operating_frequencies();
+    result.loopRateHz = after.actualDroneServerUpdateRate;
+    result.updateTimeMean = get_interval_mean(before.droneUpdateTime, after.droneUpdateTime);
+    result.updateTimePerDrone = result.updateTimeMean / (double)std::max((size_t)1, drones.size());
+    result.commandAdjustTimeMean = get_interval_mean(before.commandAdjustTime, after.commandAdjustTime);
+    result.avoidanceTimeMean = get_interval_mean(before.avoidanceTime, after.avoidanceTime);
+    result.loopPeriod = after.loopPeriod;
+    result.commandAdjustTime = after.commandAdjustTime;
+    result.avoidanceTime = after.avoidanceTime;
+    result.overruns = after.overruns - before.overruns;
+
+    long rss = (serverPid > 0) ? get_rss_kb(serverPid) : -1;
+    if (rss >= 0 && baselineRssKb >= 0 && !drones.empty()) {
+        result.memoryPerDroneKb = (rss - baselineRssKb) / (long)drones.size();
+    }
+
+    ROS_INFO("[%zu drones] land", drones.size());
+    batch.clear();
+    for (const auto& drone : drones) {
+        batch.cmd_land(drone, LAND_TIME);
+    }
+    mdp::send_command_batch(batch);
+    sleep_until_all_idle(drones);
+    return result;
+}
+
+void write_distribution(std::ostream& out, const mdp::timing_distribution& distribution) {
+    out << "{\"p50\": " << distribution.p50 << ", \"p99\": " << distribution.p99 << ", \"p999\": " << distribution.p999
+        << ", \"max\": " << distribution.max << ", \"mean\": " << distribution.mean
+        << ", \"samples\": " << distribution.sampleCount << "}";
+}
+
+void write_report(const std::string& path, const std::vector<bench_result>& results) {
+    std::ofstream out(path);
+    out << "{\n  \"benchmark\": \"swarm_bench\",\n  \"version\": 2,\n  \"timestamp\": " << (uint64_t)ros::WallTime::now().toSec()
+        << ",\n  \"results\": [\n";
+    for (size_t i = 0; i < results.size(); i++) {
+        const bench_result& r = results[i];
+        out << "    {\n";
+        out << "      \"drones\": " << r.droneCount << ",\n";
+        out << "      \"workload_s\": " << r.workloadTime << ",\n";
+        out << "      \"loop_rate_hz\": " << r.loopRateHz << ",\n";
+        out << "      \"overruns\": " << r.overruns << ",\n";
+        out << "      \"update_time_mean_s\": " << r.updateTimeMean << ",\n";
+        out << "      \"update_time_per_drone_s\": " << r.updateTimePerDrone << ",\n";
+        out << "      \"command_adjust_time_mean_s\": " << r.commandAdjustTimeMean << ",\n";
+        out << "      \"avoidance_time_mean_s\": " << r.avoidanceTimeMean << ",\n";
+        out << "      \"command_latency_s\": {\"p50\": " << get_percentile(r.commandLatencies, 50.0)
+            << ", \"p99\": " << get_percentile(r.commandLatencies, 99.0)
+            << ", \"max\": " << get_percentile(r.commandLatencies, 100.0)
+            << ", \"samples\": " << r.commandLatencies.size() << "},\n";
+        out << "      \"memory_per_drone_kb\": " << r.memoryPerDroneKb << ",\n";
+        /* distributions are over the whole drone server session up to this point */
+        out << "      \"session_loop_period_s\": ";
+        write_distribution(out, r.loopPeriod);
+        out << ",\n      \"session_command_adjust_time_s\": ";
+        write_distribution(out, r.commandAdjustTime);
+        out << ",\n      \"session_avoidance_time_s\": ";
+        write_distribution(out, r.avoidanceTime);
+        out << "\n    }" << ((i + 1 < results.size()) ? "," : "") << "\n";
+    }
+    out << "  ]\n}\n";
+}
+
+int main(int argc, char **argv) {
+    std::string reportPath = DEFAULT_REPORT;
+    std::vector<size_t> sweep = {1, 10, 50, 200};
+    if (argc > 1) reportPath = argv[1];
+    if (argc > 2) {
+        sweep.clear();
+        for (int i = 2; i < argc; i++) sweep.push_back((size_t)std::atol(argv[i]));
+        std::sort(sweep.begin(), sweep.end());
+    }
+
+    mdp::initialise(UPDATE_RATE, NODE_NAME);
+    ros::NodeHandle node;
+    ros::ServiceClient addClient = node.serviceClient<multi_drone_platform::add_drone>(ADD_DRONE_TOPIC);
+
+    if (!mdp::get_all_rigidbodies().empty()) {
+        ROS_WARN("The drone server already has drones, they will be included in the benchmark");
+    }
+
+    int serverPid = get_drone_server_pid();
+    long baselineRssKb = (serverPid > 0) ? get_rss_kb(serverPid) : -1;
+    if (baselineRssKb < 0) {
+        ROS_WARN("Unable to read the drone server's memory use, is it running on this host?");
+    }
+
+    std::vector<bench_result> results;
+    for (size_t droneCount : sweep) {
+        std::vector<mdp::id> drones = spawn_vflies(addClient, droneCount);
+        if (drones.size() < droneCount) {
+            ROS_ERROR("Only %zu of %zu drones are on the drone server, stopping the sweep", drones.size(), droneCount);
+            break;
+        }
+        results.push_back(run_workload(drones, serverPid, baselineRssKb));
+        write_report(reportPath, results);
+    }
+
+    ROS_INFO("Wrote benchmark report to '%s'", reportPath.c_str());
+    mdp::terminate();
+    return 0;
+}
@@ -0,0 +1,122 @@
+#include "obstacle_store.h"
+#include "signed_distance_field.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+/**
+ * generate_sdf samples the signed distance to the static geometry of a flight arena, its walls and the obstacles of an
+ * obstacles file, on a regular grid and writes it as a signed distance field file for the drone server to map.
+ *
+ * usage: rosrun multi_drone_platform generate_sdf <obstacles.yaml> <output.sdf> <resolution> <min_x> <max_x> <min_y>
+ *                                                 <max_y> <min_z> <max_z>
+ *
+ * The walls are the faces of the box given by the min and max arguments (the drone server's static boundary), the
+ * field is positive inside the box and away from the obstacles.
+ */
+
+/* the grid extends this far (in meters) beyond the walls, so that drones that stray outside of the arena are pushed back */
+#define ARENA_MARGIN 0.25
+
+void print_help() {
+    std::cout << "Generates a signed distance field of the walls of an arena and the obstacles of an obstacles file" << std::endl;
+    std::cout << "\tgenerate_sdf <obstacles.yaml> <output.sdf> <resolution> <min_x> <max_x> <min_y> <max_y> <min_z> <max_z>" << std::endl;
+}
+
+/**
+ * returns the sample of the field at a point, the closer of the walls and the closest obstacle
+ */
+sdf_sample sample_arena(const obstacle_store& obstacles, const std::array<double, 3>& arenaMin,
+                        const std::array<double, 3>& arenaMax, const geometry_msgs::Vector3& point) {
+    const double position[3] = {point.x, point.y, point.z};
+    sdf_sample sample;
+    double distance = INFINITY;
+    for (int axis = 0; axis < 3; axis++) {
+        /* the walls of an axis face inwards, towards increasing distance */
+        for (int side = 0; side < 2; side++) {
+            double wall = side ? arenaMax[axis] - position[axis] : position[axis] - arenaMin[axis];
+            if (wall < distance) {
+                distance = wall;
+                sample.gradient[0] = sample.gradient[1] = sample.gradient[2] = 0.0f;
+                sample.gradient[axis] = side ? -1.0f : 1.0f;
+            }
+        }
+    }
+
+    obstacle_query obstacle;
+    if (obstacles.closest(point, distance, obstacle) && obstacle.distance < distance) {
+        distance = obstacle.distance;
+        sample.gradient[0] = (float)obstacle.normal.x;
+        sample.gradient[1] = (float)obstacle.normal.y;
+        sample.gradient[2] = (float)obstacle.normal.z;
+    }
+    sample.distance = (float)distance;
+    return sample;
+}
+
+int main(int argc, char** argv) {
+    if (argc != 10 || strcmp(argv[1], "--help") == 0) {
+        print_help();
+        return argc == 2 ? 0 : 1;
+    }
+
+    obstacle_store obstacles;
+    std::string error;
+    if (!obstacles.load(argv[1], error)) {
+        std::cerr << "Unable to load obstacles: " << error << std::endl;
+        return 1;
+    }
+
+    double resolution = std::atof(argv[3]);
+    std::array<double, 3> arenaMin, arenaMax, origin;
+    std::array<uint32_t, 3> size;
+    for (int axis = 0; axis < 3; axis++) {
+        arenaMin[axis] = std::atof(argv[4 + 2 * axis]);
+        arenaMax[axis] = std::atof(argv[5 + 2 * axis]);
+        if (!(resolution > 0.0) || !(arenaMax[axis] > arenaMin[axis])) {
+            std::cerr << "The resolution must be positive and each max above its min" << std::endl;
+            return 1;
+        }
+        origin[axis] = arenaMin[axis] - ARENA_MARGIN;
+        size[axis] = (uint32_t)std::ceil((arenaMax[axis] - arenaMin[axis] + 2.0 * ARENA_MARGIN) / resolution) + 1;
+    }
+
+    std::cout << "Sampling " << size[0] << " x " << size[1] << " x " << size[2] << " points over "
+              << obstacles.size() << " obstacles" << std::endl;
+    std::vector<sdf_sample> samples((size_t)size[0] * size[1] * size[2]);
+
+    /* z slices are handed out to a thread per core, the obstacle store can be queried concurrently */
+    std::atomic<uint32_t> nextSlice(0);
+    std::vector<std::thread> workers;
+    for (unsigned int worker = 0; worker < std::max(1u, std::thread::hardware_concurrency()); worker++) {
+        workers.emplace_back([&]() {
+            for (uint32_t k = nextSlice++; k < size[2]; k = nextSlice++) {
+                geometry_msgs::Vector3 point;
+                point.z = origin[2] + k * resolution;
+                for (uint32_t j = 0; j < size[1]; j++) {
+                    point.y = origin[1] + j * resolution;
+                    for (uint32_t i = 0; i < size[0]; i++) {
+                        point.x = origin[0] + i * resolution;
+                        samples[i + size[0] * (j + (size_t)size[1] * k)] = sample_arena(obstacles, arenaMin, arenaMax, point);
+                    }
+                }
+            }
+        });
+    }
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+
+    if (!signed_distance_field::save(argv[2], size, origin, resolution, samples, error)) {
+        std::cerr << "Unable to save the signed distance field: " << error << std::endl;
+        return 1;
+    }
+    std::cout << "Wrote " << samples.size() << " samples to '" << argv[2] << "'" << std::endl;
+    return 0;
+}
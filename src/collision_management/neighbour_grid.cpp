@@ -0,0 +1,68 @@
+#include "neighbour_grid.h"
+
+#include <algorithm>
+
+void neighbour_grid::clear() {
+    states.clear();
+}
+
+void neighbour_grid::add(const neighbour_state& state) {
+    states.push_back(state);
+}
+
+void neighbour_grid::build() {
+    cellSize = NEIGHBOUR_GRID_MIN_CELL;
+    for (const auto& state : states) {
+        cellSize = std::max(cellSize, std::max(state.influenceDistance, state.restrictedDistance));
+    }
+
+    uint32_t bucketCount = 16;
+    while (bucketCount < 2 * states.size()) {
+        bucketCount <<= 1;
+    }
+    bucketMask = bucketCount - 1;
+
+    /* counting sort of the drones by bucket */
+    buckets.resize(states.size());
+    bucketStarts.assign(bucketCount + 1, 0);
+    for (size_t i = 0; i < states.size(); i++) {
+        const geometry_msgs::Point& position = states[i].position;
+        std::array<int64_t, 3> cell = get_cell(position.x, position.y, position.z);
+        buckets[i] = get_bucket(cell[0], cell[1], cell[2]);
+        bucketStarts[buckets[i] + 1]++;
+    }
+    for (uint32_t bucket = 0; bucket < bucketCount; bucket++) {
+        bucketStarts[bucket + 1] += bucketStarts[bucket];
+    }
+
+    /* bucketStarts[b + 1] holds the end of bucket b, filling each bucket from its end leaves it holding its start */
+    order.resize(states.size());
+    for (size_t i = states.size(); i-- > 0;) {
+        order[--bucketStarts[buckets[i] + 1]] = (uint32_t)i;
+    }
+    for (uint32_t bucket = 0; bucket < bucketCount; bucket++) {
+        bucketStarts[bucket] = bucketStarts[bucket + 1];
+    }
+    bucketStarts[bucketCount] = (uint32_t)states.size();
+}
+
+const std::vector<neighbour_state>& neighbour_grid::get_states() const {
+    return states;
+}
+
+const std::vector<uint32_t>& neighbour_grid::get_order() const {
+    return order;
+}
+
+double neighbour_grid::get_cell_size() const {
+    return cellSize;
+}
+
+std::array<int64_t, 3> neighbour_grid::get_cell(double x, double y, double z) const {
+    return {{(int64_t)std::floor(x / cellSize), (int64_t)std::floor(y / cellSize), (int64_t)std::floor(z / cellSize)}};
+}
+
+uint32_t neighbour_grid::get_bucket(int64_t x, int64_t y, int64_t z) const {
+    uint64_t hash = ((uint64_t)x * 73856093u) ^ ((uint64_t)y * 19349663u) ^ ((uint64_t)z * 83492791u);
+    return (uint32_t)(hash ^ (hash >> 32)) & bucketMask;
+}
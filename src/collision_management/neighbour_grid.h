@@ -0,0 +1,181 @@
+#ifndef MULTI_DRONE_PLATFORM_NEIGHBOUR_GRID_H
+#define MULTI_DRONE_PLATFORM_NEIGHBOUR_GRID_H
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "geometry_msgs/Vector3.h"
+#include "neighbour_state.h"
+
+/**
+ * the smallest cell size of the grid in meters, so that drones without an influence distance do not make it degenerate
+ */
+#define NEIGHBOUR_GRID_MIN_CELL 0.1
+
+/**
+ * The states of all drones known to a drone server, indexed by a uniform spatial hash grid rebuilt every loop. The
+ * cell size is the largest influence (or restricted) distance of any drone, so every drone that can influence a point
+ * lies in the cell of that point or one of its 26 neighbouring cells, and collision avoidance only visits those cells
+ * rather than the entire swarm. Queries reaching further than the cell size walk every cell within their radius.
+ *
+ * Cells are hashed into a table of buckets twice the size of the swarm (cells sharing a bucket are visited together),
+ * and the drones of every bucket are kept contiguous, so building the grid is two passes over the drones and the
+ * grid's arrays are reused from loop to loop.
+ */
+class neighbour_grid {
+public:
+    /**
+     * removes every drone from the grid
+     */
+    void clear();
+
+    /**
+     * adds the state of a drone, taking effect from the next call to build()
+     * @param state the drone's state
+     */
+    void add(const neighbour_state& state);
+
+    /**
+     * indexes the added drones, to be called once all drones of a loop have been added
+     */
+    void build();
+
+    /**
+     * returns the state of every drone in the grid
+     */
+    const std::vector<neighbour_state>& get_states() const;
+
+    /**
+     * returns the cell size of the grid, the furthest any drone can be from a point and influence it
+     */
+    double get_cell_size() const;
+
+    /**
+     * returns the index into get_states() of every drone, ordered by bucket so that the drones of a bucket are contiguous
+     */
+    const std::vector<uint32_t>& get_order() const;
+
+    /**
+     * calls visit on every drone in the cell of a point and its neighbouring cells, which includes every drone within
+     * the cell size of the point. Drones further away may also be visited
+     * @param point the point
+     * @param visit the function to call with the state of each drone
+     */
+    template <typename F>
+    void for_each_near(const geometry_msgs::Vector3& point, F&& visit) const {
+        for_each_bucket_near(point.x, point.y, point.z, [&](uint32_t begin, uint32_t end) {
+            for (uint32_t i = begin; i < end; i++) {
+                visit(states[order[i]]);
+            }
+        });
+    }
+
+    /**
+     * calls visit on every drone within a radius of a point, which may reach beyond the neighbouring cells of the point
+     * for queries further than the cell size, e.g. ORCA's time horizon. The cells within the radius are walked when
+     * there are fewer of them than buckets, otherwise every drone is tested
+     * @param point the point
+     * @param radius the distance from the point within which drones are visited
+     * @param visit the function to call with the state of each drone
+     */
+    template <typename F>
+    void for_each_within(const geometry_msgs::Vector3& point, double radius, F&& visit) const {
+        if (states.empty()) return;
+        double radiusSq = radius * radius;
+        auto visitWithin = [&](const neighbour_state& state) {
+            double dx = state.position.x - point.x;
+            double dy = state.position.y - point.y;
+            double dz = state.position.z - point.z;
+            if (dx * dx + dy * dy + dz * dz <= radiusSq) visit(state);
+        };
+
+        int64_t reach = std::max((int64_t)1, (int64_t)std::ceil(radius / cellSize));
+        uint64_t side = 2 * (uint64_t)reach + 1;
+        if (side * side * side >= (uint64_t)bucketMask + 1) {
+            /* the walk would visit every bucket anyway */
+            for (const auto& state : states) {
+                visitWithin(state);
+            }
+            return;
+        }
+
+        /* cells of the walk can hash to the same bucket, each bucket is only visited once */
+        static thread_local std::vector<uint32_t> walkBuckets;
+        walkBuckets.clear();
+        std::array<int64_t, 3> cell = get_cell(point.x, point.y, point.z);
+        for (int64_t dx = -reach; dx <= reach; dx++) {
+            for (int64_t dy = -reach; dy <= reach; dy++) {
+                for (int64_t dz = -reach; dz <= reach; dz++) {
+                    walkBuckets.push_back(get_bucket(cell[0] + dx, cell[1] + dy, cell[2] + dz));
+                }
+            }
+        }
+        std::sort(walkBuckets.begin(), walkBuckets.end());
+        walkBuckets.erase(std::unique(walkBuckets.begin(), walkBuckets.end()), walkBuckets.end());
+        for (uint32_t bucket : walkBuckets) {
+            for (uint32_t i = bucketStarts[bucket]; i < bucketStarts[bucket + 1]; i++) {
+                visitWithin(states[order[i]]);
+            }
+        }
+    }
+
+    /**
+     * calls visit with the range of get_order() holding each bucket of the cell of a point and its neighbouring cells,
+     * each bucket being visited once
+     * @param x, y, z the point
+     * @param visit the function to call with the first and one past the last position in get_order() of each bucket
+     */
+    template <typename F>
+    void for_each_bucket_near(double x, double y, double z, F&& visit) const {
+        if (states.empty()) return;
+        std::array<int64_t, 3> cell = get_cell(x, y, z);
+
+        /* neighbouring cells can hash to the same bucket, each bucket is only visited once */
+        std::array<uint32_t, 27> visitedBuckets;
+        size_t visitedCount = 0;
+        for (int64_t dx = -1; dx <= 1; dx++) {
+            for (int64_t dy = -1; dy <= 1; dy++) {
+                for (int64_t dz = -1; dz <= 1; dz++) {
+                    uint32_t bucket = get_bucket(cell[0] + dx, cell[1] + dy, cell[2] + dz);
+                    bool visited = false;
+                    for (size_t i = 0; i < visitedCount; i++) {
+                        if (visitedBuckets[i] == bucket) {
+                            visited = true;
+                            break;
+                        }
+                    }
+                    if (visited) continue;
+                    visitedBuckets[visitedCount++] = bucket;
+
+                    if (bucketStarts[bucket] < bucketStarts[bucket + 1]) {
+                        visit(bucketStarts[bucket], bucketStarts[bucket + 1]);
+                    }
+                }
+            }
+        }
+    }
+
+    /**
+     * returns the cell of a point, the drones near points of the same cell are in the same buckets
+     * @param x, y, z the point
+     */
+    std::array<int64_t, 3> get_cell(double x, double y, double z) const;
+
+private:
+    uint32_t get_bucket(int64_t x, int64_t y, int64_t z) const;
+
+    std::vector<neighbour_state> states;
+
+    /* bucket of each drone, index of the first drone of each bucket in order (plus an end), and drones ordered by bucket */
+    std::vector<uint32_t> buckets;
+    std::vector<uint32_t> bucketStarts;
+    std::vector<uint32_t> order;
+
+    double cellSize = NEIGHBOUR_GRID_MIN_CELL;
+    uint32_t bucketMask = 0;
+};
+
+#endif //MULTI_DRONE_PLATFORM_NEIGHBOUR_GRID_H
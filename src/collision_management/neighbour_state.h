@@ -0,0 +1,22 @@
+#ifndef MULTI_DRONE_PLATFORM_NEIGHBOUR_STATE_H
+#define MULTI_DRONE_PLATFORM_NEIGHBOUR_STATE_H
+
+#include <cstdint>
+#include "geometry_msgs/Point.h"
+#include "geometry_msgs/Vector3.h"
+
+/**
+ * The state of a drone as seen by collision avoidance, gathered by the drone server every loop from its own rigidbodies
+ * and from the drones of other drone server shards
+ */
+struct neighbour_state {
+    uint32_t droneID = 0;
+    geometry_msgs::Point position;
+    geometry_msgs::Vector3 velocity;
+    double restrictedDistance = 0.0;
+    double influenceDistance = 0.0;
+    /* the drone's maximum speed, only known for the drone server's own drones */
+    double maxVel = 0.0;
+};
+
+#endif //MULTI_DRONE_PLATFORM_NEIGHBOUR_STATE_H
@@ -0,0 +1,452 @@
+#include "obstacle_store.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <map>
+#include <stdexcept>
+#include <utility>
+#include <yaml-cpp/yaml.h>
+
+/* deeper nodes are left as leaves, which keeps visit_nearest's traversal stack bounded */
+#define BVH_MAX_DEPTH 32
+
+/* distances below this are treated as a point lying on a surface, where the surface's own normal is used */
+#define SURFACE_EPSILON 1e-9
+
+void bounding_volume_hierarchy::build(const std::vector<Eigen::AlignedBox3d>& bounds) {
+    nodes.clear();
+    items.resize(bounds.size());
+    for (uint32_t i = 0; i < items.size(); i++) {
+        items[i] = i;
+    }
+    if (bounds.empty()) return;
+
+    nodes.reserve(2 * bounds.size() / BVH_LEAF_SIZE + 1);
+    nodes.emplace_back();
+    build_node(0, 0, (uint32_t)items.size(), bounds, 0);
+}
+
+void bounding_volume_hierarchy::build_node(uint32_t index, uint32_t begin, uint32_t end,
+                                           const std::vector<Eigen::AlignedBox3d>& bounds, uint32_t depth) {
+    Eigen::AlignedBox3d nodeBounds;
+    Eigen::AlignedBox3d centers;
+    for (uint32_t i = begin; i < end; i++) {
+        nodeBounds.extend(bounds[items[i]]);
+        centers.extend(bounds[items[i]].center());
+    }
+    nodes[index].bounds = nodeBounds;
+
+    if (end - begin <= BVH_LEAF_SIZE || depth >= BVH_MAX_DEPTH) {
+        nodes[index].first = begin;
+        nodes[index].count = end - begin;
+        return;
+    }
+
+    int axis = 0;
+    centers.sizes().maxCoeff(&axis);
+    uint32_t middle = begin + (end - begin) / 2;
+    std::nth_element(items.begin() + begin, items.begin() + middle, items.begin() + end,
+                     [&bounds, axis](uint32_t a, uint32_t b) {
+                         return bounds[a].center()[axis] < bounds[b].center()[axis];
+                     });
+
+    /* nodes may be reallocated by the children, so the node is only referred to by index */
+    uint32_t children = (uint32_t)nodes.size();
+    nodes.emplace_back();
+    nodes.emplace_back();
+    nodes[index].first = children;
+    nodes[index].count = 0;
+    build_node(children, begin, middle, bounds, depth + 1);
+    build_node(children + 1, middle, end, bounds, depth + 1);
+}
+
+Eigen::AlignedBox3d bounding_volume_hierarchy::get_bounds() const {
+    return nodes.empty() ? Eigen::AlignedBox3d() : nodes[0].bounds;
+}
+
+static Eigen::Vector3d read_vector(const YAML::Node& node, const char* key) {
+    const YAML::Node& value = node[key];
+    if (!value || !value.IsSequence() || value.size() != 3) {
+        throw std::runtime_error(std::string("'") + key + "' must be a list of 3 numbers");
+    }
+    return Eigen::Vector3d(value[0].as<double>(), value[1].as<double>(), value[2].as<double>());
+}
+
+static double read_number(const YAML::Node& node, const char* key) {
+    if (!node[key]) throw std::runtime_error(std::string("'") + key + "' is missing");
+    return node[key].as<double>();
+}
+
+static Eigen::Matrix3d read_rotation(const YAML::Node& node) {
+    if (!node["rpy"]) return Eigen::Matrix3d::Identity();
+    Eigen::Vector3d rpy = read_vector(node, "rpy") * M_PI / 180.0;
+    return (Eigen::AngleAxisd(rpy.z(), Eigen::Vector3d::UnitZ())
+            * Eigen::AngleAxisd(rpy.y(), Eigen::Vector3d::UnitY())
+            * Eigen::AngleAxisd(rpy.x(), Eigen::Vector3d::UnitX())).toRotationMatrix();
+}
+
+bool obstacle_store::load(const std::string& path, std::string& error) {
+    obstacles.clear();
+    meshes.clear();
+    size_t index = 0;
+    bool inList = false;
+    try {
+        YAML::Node file = YAML::LoadFile(path);
+        YAML::Node list = file["obstacles"];
+        if (!list || !list.IsSequence()) throw std::runtime_error("there is no 'obstacles' list");
+        inList = true;
+
+        for (const YAML::Node& node : list) {
+            obstacle ob;
+            std::string type = node["type"] ? node["type"].as<std::string>() : "";
+            if (type == "box") {
+                Eigen::Vector3d min = read_vector(node, "min"), max = read_vector(node, "max");
+                if ((max.array() < min.array()).any()) throw std::runtime_error("'max' is below 'min'");
+                ob.center = (min + max) / 2.0;
+                ob.halfExtents = (max - min) / 2.0;
+            } else if (type == "oriented_box") {
+                ob.center = read_vector(node, "center");
+                ob.halfExtents = read_vector(node, "half_extents");
+                ob.rotation = read_rotation(node);
+            } else if (type == "cylinder") {
+                ob.type = obstacle_type::CYLINDER;
+                ob.center = read_vector(node, "center");
+                double radius = read_number(node, "radius");
+                ob.halfExtents = Eigen::Vector3d(radius, radius, read_number(node, "height") / 2.0);
+                ob.rotation = read_rotation(node);
+            } else if (type == "mesh") {
+                ob.type = obstacle_type::MESH;
+                triangle_mesh mesh;
+                for (const YAML::Node& vertex : node["vertices"]) {
+                    mesh.vertices.emplace_back(vertex[0].as<double>(), vertex[1].as<double>(), vertex[2].as<double>());
+                }
+                for (const YAML::Node& triangle : node["triangles"]) {
+                    mesh.triangles.push_back({{triangle[0].as<uint32_t>(), triangle[1].as<uint32_t>(),
+                                               triangle[2].as<uint32_t>()}});
+                }
+                std::string meshError;
+                if (!build_mesh(mesh, meshError)) throw std::runtime_error(meshError);
+                ob.mesh = (uint32_t)meshes.size();
+                meshes.push_back(std::move(mesh));
+            } else {
+                throw std::runtime_error("unknown type '" + type + "', expected box, oriented_box, cylinder or mesh");
+            }
+            if ((ob.halfExtents.array() < 0.0).any()) throw std::runtime_error("negative dimensions");
+            obstacles.push_back(ob);
+            index++;
+        }
+    } catch (const std::exception& e) {
+        error = "'" + path + "'" + (inList ? " obstacle " + std::to_string(index) : std::string()) + ": " + e.what();
+        obstacles.clear();
+        meshes.clear();
+        hierarchy.build({});
+        return false;
+    }
+
+    std::vector<Eigen::AlignedBox3d> bounds;
+    bounds.reserve(obstacles.size());
+    for (const obstacle& ob : obstacles) {
+        bounds.push_back(get_bounds(ob, meshes));
+    }
+    hierarchy.build(bounds);
+    return true;
+}
+
+bool obstacle_store::build_mesh(triangle_mesh& mesh, std::string& error) {
+    if (mesh.triangles.empty()) {
+        error = "a mesh needs 'vertices' and 'triangles'";
+        return false;
+    }
+
+    mesh.faceNormals.resize(mesh.triangles.size());
+    mesh.edgeNormals.resize(mesh.triangles.size());
+    mesh.vertexNormals.assign(mesh.vertices.size(), Eigen::Vector3d::Zero());
+    std::map<std::pair<uint32_t, uint32_t>, std::pair<Eigen::Vector3d, uint32_t>> edges;
+    std::vector<Eigen::AlignedBox3d> bounds(mesh.triangles.size());
+
+    for (size_t t = 0; t < mesh.triangles.size(); t++) {
+        const std::array<uint32_t, 3>& triangle = mesh.triangles[t];
+        for (uint32_t vertex : triangle) {
+            if (vertex >= mesh.vertices.size()) {
+                error = "triangle " + std::to_string(t) + " refers to vertex " + std::to_string(vertex)
+                        + " of " + std::to_string(mesh.vertices.size());
+                return false;
+            }
+        }
+        Eigen::Vector3d normal = (mesh.vertices[triangle[1]] - mesh.vertices[triangle[0]])
+                .cross(mesh.vertices[triangle[2]] - mesh.vertices[triangle[0]]);
+        if (normal.norm() < SURFACE_EPSILON) {
+            error = "triangle " + std::to_string(t) + " has no area";
+            return false;
+        }
+        normal.normalize();
+        mesh.faceNormals[t] = normal;
+
+        for (int corner = 0; corner < 3; corner++) {
+            uint32_t vertex = triangle[corner];
+            uint32_t next = triangle[(corner + 1) % 3];
+            uint32_t previous = triangle[(corner + 2) % 3];
+            Eigen::Vector3d toNext = (mesh.vertices[next] - mesh.vertices[vertex]).normalized();
+            Eigen::Vector3d toPrevious = (mesh.vertices[previous] - mesh.vertices[vertex]).normalized();
+            double angle = std::acos(std::max(-1.0, std::min(1.0, toNext.dot(toPrevious))));
+            mesh.vertexNormals[vertex] += angle * normal;
+
+            std::pair<Eigen::Vector3d, uint32_t>& edge = edges[std::make_pair(std::min(vertex, next), std::max(vertex, next))];
+            if (edge.second == 0) edge.first = Eigen::Vector3d::Zero();
+            edge.first += normal;
+            edge.second++;
+            bounds[t].extend(mesh.vertices[vertex]);
+        }
+    }
+
+    for (const auto& edge : edges) {
+        if (edge.second.second != 2) {
+            error = "the mesh is not closed, the edge between vertices " + std::to_string(edge.first.first) + " and "
+                    + std::to_string(edge.first.second) + " has " + std::to_string(edge.second.second) + " triangles";
+            return false;
+        }
+    }
+    for (size_t t = 0; t < mesh.triangles.size(); t++) {
+        const std::array<uint32_t, 3>& triangle = mesh.triangles[t];
+        for (int corner = 0; corner < 3; corner++) {
+            uint32_t vertex = triangle[corner], next = triangle[(corner + 1) % 3];
+            mesh.edgeNormals[t][corner] = edges[std::make_pair(std::min(vertex, next), std::max(vertex, next))].first;
+        }
+    }
+    mesh.hierarchy.build(bounds);
+    return true;
+}
+
+Eigen::AlignedBox3d obstacle_store::get_bounds(const obstacle& ob, const std::vector<triangle_mesh>& meshes) {
+    Eigen::Vector3d extent;
+    switch (ob.type) {
+        case obstacle_type::BOX:
+            extent = ob.rotation.cwiseAbs() * ob.halfExtents;
+            break;
+        case obstacle_type::CYLINDER: {
+            /* the caps are discs around the axis, extending radius * sin(angle between axis and world axis) */
+            Eigen::Vector3d axis = ob.rotation.col(2);
+            for (int i = 0; i < 3; i++) {
+                extent[i] = ob.halfExtents.z() * std::abs(axis[i])
+                            + ob.halfExtents.x() * std::sqrt(std::max(0.0, 1.0 - axis[i] * axis[i]));
+            }
+            break;
+        }
+        case obstacle_type::MESH:
+            return meshes[ob.mesh].hierarchy.get_bounds();
+    }
+    return Eigen::AlignedBox3d(ob.center - extent, ob.center + extent);
+}
+
+obstacle_store::local_query obstacle_store::box_distance(const obstacle& ob, const Eigen::Vector3d& point) {
+    Eigen::Vector3d local = ob.rotation.transpose() * (point - ob.center);
+    Eigen::Vector3d excess = local.cwiseAbs() - ob.halfExtents;
+
+    local_query result;
+    Eigen::Vector3d closest, normal;
+    if ((excess.array() > 0.0).any()) {
+        closest = local.cwiseMax(-ob.halfExtents).cwiseMin(ob.halfExtents);
+        result.distance = (local - closest).norm();
+        normal = (local - closest) / result.distance;
+    } else {
+        /* inside, the nearest face is the one the point is least deep behind */
+        int axis = 0;
+        result.distance = excess.maxCoeff(&axis);
+        double side = (local[axis] >= 0.0) ? 1.0 : -1.0;
+        closest = local;
+        closest[axis] = side * ob.halfExtents[axis];
+        normal = Eigen::Vector3d::Zero();
+        normal[axis] = side;
+    }
+    result.closestPoint = ob.rotation * closest + ob.center;
+    result.normal = ob.rotation * normal;
+    return result;
+}
+
+obstacle_store::local_query obstacle_store::cylinder_distance(const obstacle& ob, const Eigen::Vector3d& point) {
+    Eigen::Vector3d local = ob.rotation.transpose() * (point - ob.center);
+    const double radius = ob.halfExtents.x(), halfHeight = ob.halfExtents.z();
+    double radial = std::hypot(local.x(), local.y());
+    Eigen::Vector3d outward = (radial > SURFACE_EPSILON) ? Eigen::Vector3d(local.x() / radial, local.y() / radial, 0.0)
+                                                         : Eigen::Vector3d::UnitX();
+    double side = (local.z() >= 0.0) ? 1.0 : -1.0;
+    double radialExcess = radial - radius, axialExcess = std::abs(local.z()) - halfHeight;
+
+    local_query result;
+    Eigen::Vector3d closest, normal;
+    if (radialExcess > 0.0 || axialExcess > 0.0) {
+        closest = outward * std::min(radial, radius);
+        closest.z() = std::max(-halfHeight, std::min(halfHeight, local.z()));
+        result.distance = (local - closest).norm();
+        normal = (local - closest) / result.distance;
+    } else if (radialExcess > axialExcess) {
+        result.distance = radialExcess;
+        closest = outward * radius;
+        closest.z() = local.z();
+        normal = outward;
+    } else {
+        result.distance = axialExcess;
+        closest = local;
+        closest.z() = side * halfHeight;
+        normal = Eigen::Vector3d(0.0, 0.0, side);
+    }
+    result.closestPoint = ob.rotation * closest + ob.center;
+    result.normal = ob.rotation * normal;
+    return result;
+}
+
+/**
+ * features of a triangle the closest point to a point can lie on
+ */
+enum class triangle_feature {FACE, VERTEX_A, VERTEX_B, VERTEX_C, EDGE_AB, EDGE_BC, EDGE_CA};
+
+/**
+ * returns the closest point on a triangle to a point, by the regions of the triangle's Voronoi diagram
+ */
+static Eigen::Vector3d closest_on_triangle(const Eigen::Vector3d& p, const Eigen::Vector3d& a,
+                                           const Eigen::Vector3d& b, const Eigen::Vector3d& c,
+                                           triangle_feature& feature) {
+    Eigen::Vector3d ab = b - a, ac = c - a, ap = p - a;
+    double d1 = ab.dot(ap), d2 = ac.dot(ap);
+    if (d1 <= 0.0 && d2 <= 0.0) {
+        feature = triangle_feature::VERTEX_A;
+        return a;
+    }
+
+    Eigen::Vector3d bp = p - b;
+    double d3 = ab.dot(bp), d4 = ac.dot(bp);
+    if (d3 >= 0.0 && d4 <= d3) {
+        feature = triangle_feature::VERTEX_B;
+        return b;
+    }
+
+    double vc = d1 * d4 - d3 * d2;
+    if (vc <= 0.0 && d1 >= 0.0 && d3 <= 0.0) {
+        feature = triangle_feature::EDGE_AB;
+        return a + ab * (d1 / (d1 - d3));
+    }
+
+    Eigen::Vector3d cp = p - c;
+    double d5 = ab.dot(cp), d6 = ac.dot(cp);
+    if (d6 >= 0.0 && d5 <= d6) {
+        feature = triangle_feature::VERTEX_C;
+        return c;
+    }
+
+    double vb = d5 * d2 - d1 * d6;
+    if (vb <= 0.0 && d2 >= 0.0 && d6 <= 0.0) {
+        feature = triangle_feature::EDGE_CA;
+        return a + ac * (d2 / (d2 - d6));
+    }
+
+    double va = d3 * d6 - d5 * d4;
+    if (va <= 0.0 && (d4 - d3) >= 0.0 && (d5 - d6) >= 0.0) {
+        feature = triangle_feature::EDGE_BC;
+        return b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+    }
+
+    feature = triangle_feature::FACE;
+    double denominator = 1.0 / (va + vb + vc);
+    return a + ab * (vb * denominator) + ac * (vc * denominator);
+}
+
+obstacle_store::local_query obstacle_store::mesh_distance(const triangle_mesh& mesh, const Eigen::Vector3d& point,
+                                                          double maxDistance) {
+    double closest = maxDistance;
+    uint32_t closestTriangle = 0;
+    triangle_feature closestFeature = triangle_feature::FACE;
+    Eigen::Vector3d closestPoint;
+    bool found = false;
+    mesh.hierarchy.visit_nearest(point, closest, [&](uint32_t t) {
+        const std::array<uint32_t, 3>& triangle = mesh.triangles[t];
+        triangle_feature feature;
+        Eigen::Vector3d onTriangle = closest_on_triangle(point, mesh.vertices[triangle[0]], mesh.vertices[triangle[1]],
+                                                         mesh.vertices[triangle[2]], feature);
+        double distance = (point - onTriangle).norm();
+        if (distance < closest) {
+            closest = distance;
+            closestTriangle = t;
+            closestFeature = feature;
+            closestPoint = onTriangle;
+            found = true;
+        }
+    });
+
+    local_query result;
+    result.distance = std::numeric_limits<double>::infinity();
+    if (!found) return result;
+
+    const std::array<uint32_t, 3>& triangle = mesh.triangles[closestTriangle];
+    Eigen::Vector3d pseudoNormal;
+    switch (closestFeature) {
+        case triangle_feature::FACE: pseudoNormal = mesh.faceNormals[closestTriangle]; break;
+        case triangle_feature::VERTEX_A: pseudoNormal = mesh.vertexNormals[triangle[0]]; break;
+        case triangle_feature::VERTEX_B: pseudoNormal = mesh.vertexNormals[triangle[1]]; break;
+        case triangle_feature::VERTEX_C: pseudoNormal = mesh.vertexNormals[triangle[2]]; break;
+        case triangle_feature::EDGE_AB: pseudoNormal = mesh.edgeNormals[closestTriangle][0]; break;
+        case triangle_feature::EDGE_BC: pseudoNormal = mesh.edgeNormals[closestTriangle][1]; break;
+        case triangle_feature::EDGE_CA: pseudoNormal = mesh.edgeNormals[closestTriangle][2]; break;
+    }
+
+    /* the point is outside if it lies in front of the closest feature's pseudo normal */
+    Eigen::Vector3d offset = point - closestPoint;
+    bool outside = offset.dot(pseudoNormal) >= 0.0;
+    result.distance = outside ? closest : -closest;
+    result.closestPoint = closestPoint;
+    if (closest > SURFACE_EPSILON) {
+        result.normal = outside ? Eigen::Vector3d(offset / closest) : Eigen::Vector3d(-offset / closest);
+    } else {
+        result.normal = pseudoNormal.normalized();
+    }
+    return result;
+}
+
+bool obstacle_store::closest(const geometry_msgs::Vector3& point, double maxDistance, obstacle_query& result) const {
+    const Eigen::Vector3d p(point.x, point.y, point.z);
+    double closest = maxDistance;
+    bool found = false;
+    local_query best;
+    uint32_t bestObstacle = 0;
+    hierarchy.visit_nearest(p, closest, [&](uint32_t index) {
+        const obstacle& ob = obstacles[index];
+        local_query candidate;
+        switch (ob.type) {
+            case obstacle_type::BOX:
+                candidate = box_distance(ob, p);
+                break;
+            case obstacle_type::CYLINDER:
+                candidate = cylinder_distance(ob, p);
+                break;
+            case obstacle_type::MESH: {
+                /* a point inside the mesh can be further from its surface than any obstacle found so far */
+                const triangle_mesh& mesh = meshes[ob.mesh];
+                bool withinBounds = mesh.hierarchy.get_bounds().contains(p);
+                candidate = mesh_distance(mesh, p, withinBounds ? std::numeric_limits<double>::infinity()
+                                                                : std::max(closest, 0.0));
+                break;
+            }
+        }
+        if (candidate.distance <= closest) {
+            closest = candidate.distance;
+            best = candidate;
+            bestObstacle = index;
+            found = true;
+        }
+    });
+    if (!found) return false;
+
+    result.distance = best.distance;
+    result.closestPoint.x = best.closestPoint.x();
+    result.closestPoint.y = best.closestPoint.y();
+    result.closestPoint.z = best.closestPoint.z();
+    result.normal.x = best.normal.x();
+    result.normal.y = best.normal.y();
+    result.normal.z = best.normal.z();
+    result.obstacle = bestObstacle;
+    return true;
+}
+
+size_t obstacle_store::size() const {
+    return obstacles.size();
+}
@@ -0,0 +1,193 @@
+#ifndef MULTI_DRONE_PLATFORM_OBSTACLE_STORE_H
+#define MULTI_DRONE_PLATFORM_OBSTACLE_STORE_H
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <Eigen/Geometry>
+#include "geometry_msgs/Vector3.h"
+
+/**
+ * the most items held by a leaf of a bounding volume hierarchy
+ */
+#define BVH_LEAF_SIZE 4
+
+/**
+ * A bounding volume hierarchy of axis aligned boxes, each bounding an item. Nodes are kept in a flat array with the two
+ * children of a node next to each other, and the items of every node are a contiguous range of get_items().
+ */
+class bounding_volume_hierarchy {
+public:
+    /**
+     * builds the hierarchy, splitting every node at the median of its items along its longest axis
+     * @param bounds the bounds of each item
+     */
+    void build(const std::vector<Eigen::AlignedBox3d>& bounds);
+
+    /**
+     * visits the items in order of increasing distance of their node from a point, skipping every node further from
+     * the point than the closest distance found so far. Distances may be signed, negative inside an item, so nodes
+     * containing the point are visited until an item is found outside of which the point lies
+     * @param point the point
+     * @param closest the closest distance found so far, lowered by visit
+     * @param visit called with the index of each visited item, lowering closest if the item is closer
+     */
+    template <typename F>
+    void visit_nearest(const Eigen::Vector3d& point, double& closest, F&& visit) const {
+        if (nodes.empty()) return;
+        std::array<uint32_t, 64> stack;
+        size_t stackSize = 0;
+        stack[stackSize++] = 0;
+        while (stackSize > 0) {
+            const node& current = nodes[stack[--stackSize]];
+            if (current.bounds.exteriorDistance(point) > std::max(closest, 0.0)) continue;
+            if (current.count > 0) {
+                for (uint32_t i = current.first; i < current.first + current.count; i++) {
+                    visit(items[i]);
+                }
+                continue;
+            }
+
+            /* the nearer child is pushed last so that it is visited first, lowering closest for the further one */
+            uint32_t left = current.first, right = current.first + 1;
+            if (nodes[left].bounds.exteriorDistance(point) < nodes[right].bounds.exteriorDistance(point)) {
+                std::swap(left, right);
+            }
+            stack[stackSize++] = left;
+            stack[stackSize++] = right;
+        }
+    }
+
+    /**
+     * returns the bounds of the whole hierarchy, empty when it holds no items
+     */
+    Eigen::AlignedBox3d get_bounds() const;
+
+private:
+    struct node {
+        Eigen::AlignedBox3d bounds;
+        /* a leaf holds count items from first in items, an inner node has no items and its children at first */
+        uint32_t first = 0;
+        uint32_t count = 0;
+    };
+
+    void build_node(uint32_t index, uint32_t begin, uint32_t end, const std::vector<Eigen::AlignedBox3d>& bounds,
+                    uint32_t depth);
+
+    std::vector<node> nodes;
+    std::vector<uint32_t> items;
+};
+
+/**
+ * The result of a distance query against the static obstacles
+ */
+struct obstacle_query {
+    /* signed distance from the point to the obstacle's surface, negative when the point is inside it */
+    double distance = 0.0;
+    /* the closest point on the obstacle's surface */
+    geometry_msgs::Vector3 closestPoint;
+    /* unit direction in which the distance increases, pointing out of the obstacle */
+    geometry_msgs::Vector3 normal;
+    /* index of the obstacle in the obstacles file */
+    uint32_t obstacle = 0;
+};
+
+/**
+ * The static obstacles of the flying space, loaded from a YAML file listing axis aligned boxes, oriented boxes,
+ * cylinders and closed triangle meshes:
+ *
+ * obstacles:
+ *   - type: box
+ *     min: [-0.5, -0.5, 0.0]
+ *     max: [0.5, 0.5, 1.0]
+ *   - type: oriented_box
+ *     center: [1.0, 0.0, 0.5]
+ *     half_extents: [0.3, 0.05, 0.5]
+ *     rpy: [0.0, 0.0, 45.0]
+ *   - type: cylinder
+ *     center: [-1.0, 0.0, 1.0]
+ *     radius: 0.1
+ *     height: 2.0
+ *   - type: mesh
+ *     vertices: [[0, 0, 0], [1, 0, 0], [0, 1, 0], [0, 0, 1]]
+ *     triangles: [[0, 2, 1], [0, 1, 3], [0, 3, 2], [1, 2, 3]]
+ *
+ * Rotations (rpy) are roll, pitch and yaw in degrees, a cylinder's axis is its local z axis. Mesh triangles list their
+ * vertices counter-clockwise seen from outside the mesh.
+ *
+ * The obstacles are indexed by a bounding volume hierarchy, and the triangles of every mesh by a hierarchy of their
+ * own, so distance queries visit a logarithmic number of obstacles and triangles. The store is not modified after it
+ * is loaded, so it can be queried from any thread.
+ */
+class obstacle_store {
+public:
+    /**
+     * replaces the obstacles with those of an obstacles file
+     * @param path the path to the file
+     * @param error set to the reason when the file could not be loaded
+     * @return false if the file could not be loaded, leaving the store empty
+     */
+    bool load(const std::string& path, std::string& error);
+
+    /**
+     * finds the obstacle closest to a point, by signed distance so that the obstacle the point is deepest inside wins
+     * @param point the point
+     * @param maxDistance obstacles further than this from the point are ignored
+     * @param result the closest obstacle, set only when there is one within maxDistance
+     * @return true if an obstacle is within maxDistance of the point
+     */
+    bool closest(const geometry_msgs::Vector3& point, double maxDistance, obstacle_query& result) const;
+
+    /**
+     * returns the number of obstacles
+     */
+    size_t size() const;
+
+private:
+    enum class obstacle_type {BOX, CYLINDER, MESH};
+
+    /**
+     * an obstacle, boxes and cylinders are described in a local frame centered on the obstacle. For a cylinder
+     * halfExtents holds its radius twice followed by half its height
+     */
+    struct obstacle {
+        obstacle_type type = obstacle_type::BOX;
+        Eigen::Vector3d center = Eigen::Vector3d::Zero();
+        Eigen::Matrix3d rotation = Eigen::Matrix3d::Identity();
+        Eigen::Vector3d halfExtents = Eigen::Vector3d::Zero();
+        uint32_t mesh = 0;
+    };
+
+    /**
+     * a closed triangle mesh with the angle weighted pseudo normals of its faces, edges and vertices, which give the
+     * side of the mesh a point is on from its closest feature
+     */
+    struct triangle_mesh {
+        std::vector<Eigen::Vector3d> vertices;
+        std::vector<std::array<uint32_t, 3>> triangles;
+        std::vector<Eigen::Vector3d> faceNormals;
+        /* per triangle, the pseudo normals of its edges ab, bc and ca */
+        std::vector<std::array<Eigen::Vector3d, 3>> edgeNormals;
+        std::vector<Eigen::Vector3d> vertexNormals;
+        bounding_volume_hierarchy hierarchy;
+    };
+
+    struct local_query {
+        double distance;
+        Eigen::Vector3d closestPoint;
+        Eigen::Vector3d normal;
+    };
+
+    static bool build_mesh(triangle_mesh& mesh, std::string& error);
+    static Eigen::AlignedBox3d get_bounds(const obstacle& ob, const std::vector<triangle_mesh>& meshes);
+    static local_query box_distance(const obstacle& ob, const Eigen::Vector3d& point);
+    static local_query cylinder_distance(const obstacle& ob, const Eigen::Vector3d& point);
+    static local_query mesh_distance(const triangle_mesh& mesh, const Eigen::Vector3d& point, double maxDistance);
+
+    std::vector<obstacle> obstacles;
+    std::vector<triangle_mesh> meshes;
+    bounding_volume_hierarchy hierarchy;
+};
+
+#endif //MULTI_DRONE_PLATFORM_OBSTACLE_STORE_H
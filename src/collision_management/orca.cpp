@@ -0,0 +1,230 @@
+#include "orca.h"
+
+#include <algorithm>
+#include <cmath>
+
+/* squared lengths below this are treated as zero, the planes of nearly parallel constraints as parallel */
+#define ORCA_EPSILON 1e-9
+
+void orca_solver::clear() {
+    planes.clear();
+}
+
+void orca_solver::add_neighbour(const Eigen::Vector3d& relativePosition, const Eigen::Vector3d& velocity,
+                                const Eigen::Vector3d& neighbourVelocity, double combinedRadius, double timeHorizon,
+                                double timeStep) {
+    const Eigen::Vector3d relativeVelocity = velocity - neighbourVelocity;
+    const double distSq = relativePosition.squaredNorm();
+    const double combinedRadiusSq = combinedRadius * combinedRadius;
+
+    /* u is the smallest change of the relative velocity that leaves the velocity obstacle, the normal its direction */
+    Eigen::Vector3d u, normal;
+    if (distSq > combinedRadiusSq) {
+        /* the velocity obstacle is a cone truncated by a sphere, w is measured from the sphere's centre */
+        const double invTimeHorizon = 1.0 / timeHorizon;
+        const Eigen::Vector3d w = relativeVelocity - invTimeHorizon * relativePosition;
+        const double wLengthSq = w.squaredNorm();
+        const double dotProduct = w.dot(relativePosition);
+
+        if (dotProduct < 0.0 && dotProduct * dotProduct > combinedRadiusSq * wLengthSq) {
+            /* closest to the sphere cap */
+            const double wLength = std::sqrt(wLengthSq);
+            if (wLength <= ORCA_EPSILON) return;
+            normal = w / wLength;
+            u = (combinedRadius * invTimeHorizon - wLength) * normal;
+        } else {
+            /* closest to the side of the cone */
+            const double a = distSq;
+            const double b = relativePosition.dot(relativeVelocity);
+            const double c = relativeVelocity.squaredNorm()
+                    - relativePosition.cross(relativeVelocity).squaredNorm() / (distSq - combinedRadiusSq);
+            const double t = (b + std::sqrt(std::max(b * b - a * c, 0.0))) / a;
+            const Eigen::Vector3d ww = relativeVelocity - t * relativePosition;
+            const double wwLength = ww.norm();
+            if (wwLength <= ORCA_EPSILON) return;
+            normal = ww / wwLength;
+            u = (combinedRadius * t - wwLength) * normal;
+        }
+    } else {
+        /* already too close, move apart within one time step */
+        const double invTimeStep = 1.0 / timeStep;
+        const Eigen::Vector3d w = relativeVelocity - invTimeStep * relativePosition;
+        const double wLength = w.norm();
+        if (wLength <= ORCA_EPSILON) return;
+        normal = w / wLength;
+        u = (combinedRadius * invTimeStep - wLength) * normal;
+    }
+
+    orca_plane plane;
+    plane.point = velocity + 0.5 * u;
+    plane.normal = normal;
+    planes.push_back(plane);
+}
+
+void orca_solver::add_plane(const orca_plane& plane) {
+    planes.push_back(plane);
+}
+
+size_t orca_solver::size() const {
+    return planes.size();
+}
+
+Eigen::Vector3d orca_solver::solve(const Eigen::Vector3d& preferredVelocity, double maxSpeed) {
+    Eigen::Vector3d result;
+    size_t planeFail = linear_program_3(planes, maxSpeed, preferredVelocity, false, result);
+    if (planeFail < planes.size()) {
+        linear_program_4(planeFail, maxSpeed, result);
+    }
+    return result;
+}
+
+bool orca_solver::linear_program_1(const std::vector<orca_plane>& planes, size_t planeNo, const line& constraint,
+                                   double radius, const Eigen::Vector3d& optVelocity, bool directionOpt,
+                                   Eigen::Vector3d& result) {
+    /* the part of the line inside the speed sphere */
+    const double dotProduct = constraint.point.dot(constraint.direction);
+    const double discriminant = dotProduct * dotProduct + radius * radius - constraint.point.squaredNorm();
+    if (discriminant < 0.0) return false;
+
+    const double sqrtDiscriminant = std::sqrt(discriminant);
+    double tLeft = -dotProduct - sqrtDiscriminant;
+    double tRight = -dotProduct + sqrtDiscriminant;
+
+    /* clipped by the earlier planes */
+    for (size_t i = 0; i < planeNo; i++) {
+        const double numerator = (planes[i].point - constraint.point).dot(planes[i].normal);
+        const double denominator = constraint.direction.dot(planes[i].normal);
+        if (denominator * denominator <= ORCA_EPSILON) {
+            /* the line is parallel to the plane, and either wholly inside or wholly outside it */
+            if (numerator > 0.0) return false;
+            continue;
+        }
+
+        const double t = numerator / denominator;
+        if (denominator >= 0.0) {
+            tLeft = std::max(tLeft, t);
+        } else {
+            tRight = std::min(tRight, t);
+        }
+        if (tLeft > tRight) return false;
+    }
+
+    if (directionOpt) {
+        /* the furthest point along the optimisation direction */
+        result = constraint.point + ((optVelocity.dot(constraint.direction) > 0.0) ? tRight : tLeft) * constraint.direction;
+    } else {
+        /* the closest point to the optimisation velocity */
+        const double t = constraint.direction.dot(optVelocity - constraint.point);
+        result = constraint.point + std::min(std::max(t, tLeft), tRight) * constraint.direction;
+    }
+    return true;
+}
+
+bool orca_solver::linear_program_2(const std::vector<orca_plane>& planes, size_t planeNo, double radius,
+                                   const Eigen::Vector3d& optVelocity, bool directionOpt, Eigen::Vector3d& result) {
+    /* the circle where the plane cuts the speed sphere */
+    const orca_plane& plane = planes[planeNo];
+    const double planeDist = plane.point.dot(plane.normal);
+    const double planeDistSq = planeDist * planeDist;
+    const double radiusSq = radius * radius;
+    if (planeDistSq > radiusSq) return false;
+
+    const double planeRadiusSq = radiusSq - planeDistSq;
+    const Eigen::Vector3d planeCenter = planeDist * plane.normal;
+
+    if (directionOpt) {
+        const Eigen::Vector3d planeOptVelocity = optVelocity - optVelocity.dot(plane.normal) * plane.normal;
+        const double planeOptVelocityLengthSq = planeOptVelocity.squaredNorm();
+        if (planeOptVelocityLengthSq <= ORCA_EPSILON) {
+            result = planeCenter;
+        } else {
+            result = planeCenter + std::sqrt(planeRadiusSq / planeOptVelocityLengthSq) * planeOptVelocity;
+        }
+    } else {
+        /* the projection of the optimisation velocity onto the plane, pulled back inside the circle */
+        result = optVelocity + (plane.point - optVelocity).dot(plane.normal) * plane.normal;
+        if (result.squaredNorm() > radiusSq) {
+            const Eigen::Vector3d planeResult = result - planeCenter;
+            result = planeCenter + std::sqrt(planeRadiusSq / planeResult.squaredNorm()) * planeResult;
+        }
+    }
+
+    /* earlier planes the result violates restrict it to their line of intersection with this plane */
+    for (size_t i = 0; i < planeNo; i++) {
+        if (planes[i].normal.dot(planes[i].point - result) <= 0.0) continue;
+
+        const Eigen::Vector3d crossProduct = planes[i].normal.cross(plane.normal);
+        if (crossProduct.squaredNorm() <= ORCA_EPSILON) {
+            /* the planes are parallel and this one is on the wrong side */
+            return false;
+        }
+
+        line constraint;
+        constraint.direction = crossProduct.normalized();
+        const Eigen::Vector3d lineNormal = constraint.direction.cross(plane.normal);
+        constraint.point = plane.point + ((planes[i].point - plane.point).dot(planes[i].normal)
+                / lineNormal.dot(planes[i].normal)) * lineNormal;
+        if (!linear_program_1(planes, i, constraint, radius, optVelocity, directionOpt, result)) return false;
+    }
+    return true;
+}
+
+size_t orca_solver::linear_program_3(const std::vector<orca_plane>& planes, double radius,
+                                     const Eigen::Vector3d& optVelocity, bool directionOpt, Eigen::Vector3d& result) {
+    if (directionOpt) {
+        /* the optimisation velocity is a unit direction, the result starts as far along it as possible */
+        result = optVelocity * radius;
+    } else if (optVelocity.squaredNorm() > radius * radius) {
+        result = optVelocity.normalized() * radius;
+    } else {
+        result = optVelocity;
+    }
+
+    for (size_t i = 0; i < planes.size(); i++) {
+        if (planes[i].normal.dot(planes[i].point - result) <= 0.0) continue;
+
+        /* the result violates this plane, move it onto the plane */
+        const Eigen::Vector3d previous = result;
+        if (!linear_program_2(planes, i, radius, optVelocity, directionOpt, result)) {
+            result = previous;
+            return i;
+        }
+    }
+    return planes.size();
+}
+
+void orca_solver::linear_program_4(size_t beginPlane, double radius, Eigen::Vector3d& result) {
+    /* no velocity satisfies every plane from beginPlane on, minimise the largest distance to the violated planes */
+    double distance = 0.0;
+    for (size_t i = beginPlane; i < planes.size(); i++) {
+        if (planes[i].normal.dot(planes[i].point - result) <= distance) continue;
+
+        /* the velocities equally far outside of plane i and each earlier plane */
+        projectedPlanes.clear();
+        for (size_t j = 0; j < i; j++) {
+            orca_plane plane;
+            const Eigen::Vector3d crossProduct = planes[j].normal.cross(planes[i].normal);
+            if (crossProduct.squaredNorm() <= ORCA_EPSILON) {
+                if (planes[i].normal.dot(planes[j].normal) > 0.0) {
+                    /* same direction, plane j does not constrain plane i's violation further */
+                    continue;
+                }
+                /* opposite directions */
+                plane.point = 0.5 * (planes[i].point + planes[j].point);
+            } else {
+                const Eigen::Vector3d lineNormal = crossProduct.cross(planes[i].normal);
+                plane.point = planes[i].point + ((planes[j].point - planes[i].point).dot(planes[j].normal)
+                        / lineNormal.dot(planes[j].normal)) * lineNormal;
+            }
+            plane.normal = (planes[j].normal - planes[i].normal).normalized();
+            projectedPlanes.push_back(plane);
+        }
+
+        const Eigen::Vector3d previous = result;
+        if (linear_program_3(projectedPlanes, radius, planes[i].normal, true, result) < projectedPlanes.size()) {
+            /* in theory impossible, failing can only be due to rounding, so keep the previous result */
+            result = previous;
+        }
+        distance = planes[i].normal.dot(planes[i].point - result);
+    }
+}
@@ -0,0 +1,85 @@
+#ifndef MULTI_DRONE_PLATFORM_ORCA_H
+#define MULTI_DRONE_PLATFORM_ORCA_H
+
+#include <cstddef>
+#include <vector>
+#include <Eigen/Geometry>
+
+/**
+ * A half-space of permitted velocities, every velocity v with (v - point) . normal >= 0
+ */
+struct orca_plane {
+    Eigen::Vector3d point;
+    Eigen::Vector3d normal;
+};
+
+/**
+ * Optimal reciprocal collision avoidance in 3D (van den Berg et al.). Each neighbour of a drone forbids the velocities
+ * that would bring the two within their combined radius inside the time horizon, and the drone takes half of the
+ * responsibility of avoiding it, which leaves it a half-space of permitted velocities. The new velocity is the one
+ * closest to the drone's preferred velocity inside every half-space and its maximum speed, found by an incremental
+ * 3D linear program. When the half-spaces leave no velocity, the one least violating them is taken instead.
+ *
+ * The half-spaces are kept between drones so their storage is only reallocated when a drone has more neighbours than
+ * any before it. A solver is not thread safe, each thread solving drones needs its own.
+ */
+class orca_solver {
+public:
+    /**
+     * removes the half-spaces of the previous drone
+     */
+    void clear();
+
+    /**
+     * adds the half-space avoiding a neighbour
+     * @param relativePosition the neighbour's position relative to the drone
+     * @param velocity the drone's velocity
+     * @param neighbourVelocity the neighbour's velocity
+     * @param combinedRadius the distance the two must keep between them
+     * @param timeHorizon how far ahead (in seconds) collisions are avoided
+     * @param timeStep the time (in seconds) in which drones already closer than combinedRadius move apart
+     */
+    void add_neighbour(const Eigen::Vector3d& relativePosition, const Eigen::Vector3d& velocity,
+                       const Eigen::Vector3d& neighbourVelocity, double combinedRadius, double timeHorizon,
+                       double timeStep);
+
+    /**
+     * adds a half-space of permitted velocities, which the drone is wholly responsible for
+     * @param plane the half-space
+     */
+    void add_plane(const orca_plane& plane);
+
+    /**
+     * returns the number of half-spaces added since the last clear
+     */
+    size_t size() const;
+
+    /**
+     * finds the velocity closest to the preferred velocity permitted by every half-space
+     * @param preferredVelocity the velocity the drone would take without neighbours
+     * @param maxSpeed the largest speed the result may have
+     * @return the new velocity
+     */
+    Eigen::Vector3d solve(const Eigen::Vector3d& preferredVelocity, double maxSpeed);
+
+private:
+    struct line {
+        Eigen::Vector3d point;
+        Eigen::Vector3d direction;
+    };
+
+    static bool linear_program_1(const std::vector<orca_plane>& planes, size_t planeNo, const line& constraint,
+                                 double radius, const Eigen::Vector3d& optVelocity, bool directionOpt,
+                                 Eigen::Vector3d& result);
+    static bool linear_program_2(const std::vector<orca_plane>& planes, size_t planeNo, double radius,
+                                 const Eigen::Vector3d& optVelocity, bool directionOpt, Eigen::Vector3d& result);
+    static size_t linear_program_3(const std::vector<orca_plane>& planes, double radius,
+                                   const Eigen::Vector3d& optVelocity, bool directionOpt, Eigen::Vector3d& result);
+    void linear_program_4(size_t beginPlane, double radius, Eigen::Vector3d& result);
+
+    std::vector<orca_plane> planes;
+    /* the half-spaces projected onto a violated plane while minimising the largest violation */
+    std::vector<orca_plane> projectedPlanes;
+};
+
+#endif //MULTI_DRONE_PLATFORM_ORCA_H
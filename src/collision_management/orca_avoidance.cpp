@@ -0,0 +1,112 @@
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#include "orca_avoidance.h"
+#include "orca.h"
+#include "potential_fields.h"
+#include "static_physical_management.h"
+
+namespace {
+    Eigen::Vector3d to_eigen(const geometry_msgs::Vector3& v) {
+        return Eigen::Vector3d(v.x, v.y, v.z);
+    }
+
+    Eigen::Vector3d to_eigen(const geometry_msgs::Point& p) {
+        return Eigen::Vector3d(p.x, p.y, p.z);
+    }
+
+    geometry_msgs::Vector3 to_vec3(const Eigen::Vector3d& v) {
+        geometry_msgs::Vector3 ret;
+        ret.x = v.x();
+        ret.y = v.y();
+        ret.z = v.z();
+        return ret;
+    }
+}
+
+bool orca_avoidance::check(rigidbody* d, const neighbour_grid& neighbours) {
+    /* the drone's own state and command as the drone server collected them for the loop, as the drone's callbacks may
+     * be replacing them concurrently */
+    const rigidbody::physical_snapshot& self = d->get_snapshot();
+    ros::Time now = ros::Time::now();
+    auto remainingDuration = self.commandEnd.toSec() - now.toSec();
+    if (remainingDuration <= 0.0 || self.command.opcode != multi_drone_platform::api_update::POSITION) {
+        d->orcaAvoiding = false;
+        return false;
+    }
+
+    const kalman_estimate& estimate = d->get_loop_estimate();
+    Eigen::Vector3d position, velocity;
+    if (estimate.valid) {
+        position = to_eigen(estimate.predict(now));
+        velocity = to_eigen(estimate.velocity);
+    } else {
+        position = to_eigen(self.pose.position);
+        velocity = to_eigen(self.velocity.linear);
+    }
+
+    /* the solver and neighbour list are reused from drone to drone by each thread updating drones */
+    static thread_local orca_solver solver;
+    static thread_local std::vector<std::pair<double, const neighbour_state*>> nearest;
+    solver.clear();
+    nearest.clear();
+    geometry_msgs::Vector3 point = to_vec3(position);
+    /* a neighbour can only close the gap at twice the drone's top speed, the cell size bounds its restricted distance */
+    double range = 2.0 * d->maxVel * ORCA_TIME_HORIZON + std::max(d->restrictedDistance, neighbours.get_cell_size());
+    neighbours.for_each_within(point, range, [&](const neighbour_state& rb) {
+        if (rb.droneID == d->get_id()) return;
+        nearest.emplace_back((to_eigen(rb.position) - position).squaredNorm(), &rb);
+    });
+    if (nearest.size() > ORCA_MAX_NEIGHBOURS) {
+        std::nth_element(nearest.begin(), nearest.begin() + ORCA_MAX_NEIGHBOURS, nearest.end());
+        nearest.resize(ORCA_MAX_NEIGHBOURS);
+    }
+    for (const auto& neighbour : nearest) {
+        const neighbour_state& rb = *neighbour.second;
+        solver.add_neighbour(to_eigen(rb.position) - position, velocity, to_eigen(rb.velocity),
+                std::max(d->restrictedDistance, rb.restrictedDistance), ORCA_TIME_HORIZON, ORCA_TIME_STEP);
+    }
+
+    /* static geometry does not move, so the drone alone keeps its restricted distance from the closest of it */
+    double staticDistance;
+    geometry_msgs::Vector3 staticNormal;
+    bool inRange;
+    if (static_physical_management::arenaField.sample(point, staticDistance, staticNormal)) {
+        inRange = staticDistance <= d->influenceDistance;
+    } else {
+        obstacle_query wall;
+        inRange = static_physical_management::staticObstacles.closest(point, d->influenceDistance, wall);
+        staticDistance = wall.distance;
+        staticNormal = wall.normal;
+    }
+    if (inRange) {
+        orca_plane plane;
+        plane.normal = to_eigen(staticNormal);
+        plane.point = plane.normal * (d->restrictedDistance - staticDistance) / ORCA_TIME_HORIZON;
+        solver.add_plane(plane);
+    }
+
+    Eigen::Vector3d preferred = to_eigen(potential_fields::attractive_forces(d, remainingDuration));
+    Eigen::Vector3d avoiding = solver.solve(preferred, d->maxVel);
+    bool constrained = (avoiding - preferred).norm() > ORCA_ADJUST_THRESHOLD;
+    d->log(logger::DEBUG, "ORCA neighbours: " + std::to_string(nearest.size()) + (inRange ? " and static geometry" : ""));
+
+    /* the wrapper is told on the drone's own callback queue */
+    multi_drone_platform::api_update result;
+    result.yawVal = 0.0;
+    result.duration = remainingDuration;
+    if (constrained) {
+        result.opcode = multi_drone_platform::api_update::VELOCITY;
+        result.posVel = to_vec3(avoiding);
+        d->enqueue_avoidance(result, self.commandEnd);
+        d->orcaAvoiding = true;
+    } else if (d->orcaAvoiding) {
+        /* clear of every neighbour again, carry on with the position command */
+        result.opcode = multi_drone_platform::api_update::POSITION;
+        result.posVel = self.command.posVel;
+        d->enqueue_avoidance(result, self.commandEnd);
+        d->orcaAvoiding = false;
+    }
+    return constrained;
+}
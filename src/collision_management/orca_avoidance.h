@@ -0,0 +1,47 @@
+#ifndef MULTI_DRONE_PLATFORM_ORCA_AVOIDANCE_H
+#define MULTI_DRONE_PLATFORM_ORCA_AVOIDANCE_H
+
+#include "rigidbody.h"
+#include "neighbour_grid.h"
+
+/**
+ * How far ahead (in seconds) collisions with other drones and static geometry are avoided
+ */
+#define ORCA_TIME_HORIZON 1.0
+
+/**
+ * The time (in seconds) in which drones already within their restricted distance of each other move apart
+ */
+#define ORCA_TIME_STEP 0.1
+
+/**
+ * The most neighbours, closest first, that constrain a drone's velocity. Neighbours are looked for as far as two drones
+ * at the drone's top speed could close within ORCA_TIME_HORIZON, plus their combined radius, which reaches beyond the
+ * cells of the neighbour grid that potential fields look in
+ */
+#define ORCA_MAX_NEIGHBOURS 16
+
+/**
+ * Avoiding velocities closer than this (in meters per second) to the preferred velocity leave the position command as is
+ */
+#define ORCA_ADJUST_THRESHOLD 0.05
+
+/**
+ * Collision avoidance by optimal reciprocal collision avoidance (ORCA), an alternative to potential_fields that neither
+ * oscillates nor gets stuck in local minima. Every loop each drone moving to a position takes the velocity closest to the
+ * one that would bring it to its goal in time, among those that keep it clear of its nearest neighbours and of the static
+ * geometry for ORCA_TIME_HORIZON, assuming its neighbours do the same.
+ */
+class orca_avoidance {
+public:
+    /**
+     * Applies ORCA to a drone if it is carrying out a position command, replacing the command with the avoiding velocity
+     * while the drone has to deviate from it and restoring it once the drone no longer has to.
+     * @param d The subject drone.
+     * @param neighbours The states of all drones known by the drone server, including those of other shards.
+     * @return true if the drone's velocity was constrained by a neighbour or static geometry.
+     */
+    static bool check(rigidbody* d, const neighbour_grid& neighbours);
+};
+
+#endif //MULTI_DRONE_PLATFORM_ORCA_AVOIDANCE_H
@@ -1,62 +1,47 @@
 //
 // Created by jacob on 18/5/20.
 //
-#include <limits>
+#include <algorithm>
 
 #include "potential_fields.h"
+#include "static_physical_management.h"
 #include "utility_functions.cpp"
 
-double potential_fields::closest = std::numeric_limits<double>::max();
-double potential_fields::lastClosestRound = std::numeric_limits<double>::max();
-double potential_fields::closestThisRound = std::numeric_limits<double>::max();
 
-
-bool potential_fields::check(rigidbody* d, std::vector<rigidbody*>& rigidbodies) {
-    auto remainingDuration = d->commandEnd.toSec() - ros::Time().now().toSec();
-    closestThisRound = std::numeric_limits<double>::max();
+bool potential_fields::check(rigidbody* d, const neighbour_grid& neighbours) {
+    /* the command is read from the loop's snapshot, as the drone's callbacks may be replacing it concurrently */
+    const rigidbody::physical_snapshot& self = d->get_snapshot();
+    auto remainingDuration = self.commandEnd.toSec() - ros::Time().now().toSec();
     geometry_msgs::Vector3 velocity;
     geometry_msgs::Point posLimited;
     if (remainingDuration > 0.00) {
 //    @TODO: This is currently not configured for yaw
-        switch(apiMap[d->lastRecievedApiUpdate.msgType]) {
-            /* VELOCITY */
-            case 0:
+        switch(self.command.opcode) {
+            case multi_drone_platform::api_update::VELOCITY:
 //                velLimited = vel_static_limits(d, d->desiredVelocity.linear);
 //                if (!coord_equality(velLimited, d->desiredVelocity.linear)) {
 //                    d->set_desired_velocity(velLimited, 0.0, remainingDuration, true, true);
 //                }
             break;
-            /* POSITION */
-            case 1:
-                position_based_pf(d, rigidbodies);
-                break;
+            case multi_drone_platform::api_update::POSITION:
+                position_based_pf(d, neighbours);
+                return true;
         }
     }
+    return false;
 }
 
-geometry_msgs::Vector3 predict_position(ros::Time lastUpdate, geometry_msgs::Twist currVel, geometry_msgs::Pose currPos, int timeSteps) {
-    double timeSinceMoCapUpdate = ros::Time::now().toSec() - lastUpdate.toSec();
-    if (timeSinceMoCapUpdate < 0.0) {
-        ROS_WARN("time since update returning less than 0");
-        timeSinceMoCapUpdate = 0.0;
-    }
-
-    geometry_msgs::Vector3 pos = utility_functions::point_to_vec3(currPos.position);
-    pos.x += (currVel.linear.x * timeSinceMoCapUpdate * (double)timeSteps);
-    pos.y += (currVel.linear.y * timeSinceMoCapUpdate * (double)timeSteps);
-    pos.z += (currVel.linear.z * timeSinceMoCapUpdate * (double)timeSteps);
-
-    return pos;
-}
-
-void potential_fields::position_based_pf(rigidbody *d, std::vector<rigidbody *> &rigidbodies) {
+void potential_fields::position_based_pf(rigidbody *d, const neighbour_grid& neighbours) {
     geometry_msgs::Vector3 netPotentialVelocity;
 
-    auto remainingDuration = d->commandEnd.toSec() - ros::Time().now().toSec();
-    auto repulsiveForces = replusive_forces(d, rigidbodies);
+    const rigidbody::physical_snapshot& self = d->get_snapshot();
+    auto remainingDuration = self.commandEnd.toSec() - ros::Time().now().toSec();
+    auto repulsiveForces = replusive_forces(d, neighbours);
     auto attractiveForces = attractive_forces(d, remainingDuration);
     netPotentialVelocity = utility_functions::add_vec3_or_point(repulsiveForces, attractiveForces);
-    closest = std::min(closest, closestThisRound);
+    /* the statistics are kept per drone, as drones are updated in parallel */
+    double closestThisRound = d->get_loop_closest();
+    d->closestSeen = std::min(d->closestSeen, closestThisRound);
 
     d->log(logger::DEBUG, "Distance to closest " + std::to_string(closestThisRound));
     d->log_coord(logger::DEBUG, "Repulsive Force", repulsiveForces);
@@ -65,74 +50,95 @@ void potential_fields::position_based_pf(rigidbody *d, std::vector<rigidbody *>
         d->log(logger::DEBUG, "Local Minima");
     }
 
+    /* the wrapper is told on the drone's own callback queue */
+    multi_drone_platform::api_update result;
+    result.yawVal = 0.0;
+    result.duration = remainingDuration;
     if (utility_functions::magnitude(repulsiveForces) <= 0.2) {
-        d->set_desired_position(d->lastRecievedApiUpdate.posVel, 0.0, remainingDuration);
+        result.opcode = multi_drone_platform::api_update::POSITION;
+        result.posVel = self.command.posVel;
     }
     else {
-        d->set_desired_velocity(netPotentialVelocity, 0.0, remainingDuration);
+        result.opcode = multi_drone_platform::api_update::VELOCITY;
+        result.posVel = netPotentialVelocity;
     }
-    d->log(logger::INFO, "Closest dist: " + std::to_string(closest));
-    lastClosestRound = closestThisRound;
+    d->enqueue_avoidance(result, self.commandEnd);
+    d->log(logger::INFO, "Closest dist: " + std::to_string(d->closestSeen));
 }
 
-geometry_msgs::Vector3 potential_fields::replusive_forces(rigidbody *d, std::vector<rigidbody *> &rigidbodies) {
-    geometry_msgs::Vector3 replusiveForce;
-    std::multimap<double, geometry_msgs::Pose> sortedObstacles;
-    for (auto rb : rigidbodies) {
-        if (rb->get_id() != d->get_id()) {
-            auto obPoint = utility_functions::point_to_vec3(rb->currentPose.position);
-            auto dPoint = utility_functions::point_to_vec3(d->currentPose.position);
-            auto dFuturePoint = predict_position(d->timeOfLastMotionCaptureUpdate, d->currentVelocity, d->currentPose, 10);
-            auto diffVec = utility_functions::difference(dFuturePoint, obPoint);
-            double d0 = utility_functions::magnitude(diffVec);
-            auto unitDirection = utility_functions::multiply_by_constant(diffVec, 1 / d0);
-
-            double velDiff = utility_functions::distance_between(d->currentVelocity.linear, rb->currentVelocity.linear);
-
-            geometry_msgs::Pose obstacle;
-            obstacle.orientation.w = rb->get_id();
-            obstacle.orientation.x = d0;
-            obstacle.position = utility_functions::vec3_to_point(utility_functions::difference(obPoint, dPoint));
-            sortedObstacles.insert(std::pair<double, geometry_msgs::Pose>(d0, obstacle));
-
-            closestThisRound = std::min(closestThisRound, d0);
-
-            d->log(logger::DEBUG, "Dist: " + std::to_string(d0));
-
-            if (d0 <= rb->restrictedDistance) {
-                replusiveForce.x += d->maxVel * unitDirection.x;
-                replusiveForce.y += d->maxVel * unitDirection.y;
-                replusiveForce.z += d->maxVel * unitDirection.z;
-            }else if (d0 <= rb->influenceDistance) {
-                double vr = K_P * (rb->influenceDistance - d0) + K_D * (velDiff);
-                replusiveForce.x += vr * unitDirection.x;
-                replusiveForce.y += vr * unitDirection.y;
-                replusiveForce.z += vr * unitDirection.z;
-            }
-        }
+geometry_msgs::Vector3 potential_fields::replusive_forces(rigidbody *d, const neighbour_grid& neighbours) {
+    geometry_msgs::PoseArray msg;
+    /* read the drone's own state from the loop's snapshot and estimate, as its callbacks may be updating it concurrently */
+    const rigidbody::physical_snapshot& self = d->get_snapshot();
+    const kalman_estimate& estimate = d->get_loop_estimate();
+    const geometry_msgs::Vector3 dPoint = utility_functions::point_to_vec3(self.pose.position);
+    const geometry_msgs::Vector3& dVelocity = estimate.valid ? estimate.velocity : self.velocity.linear;
+    const geometry_msgs::Vector3 dFuturePoint = utility_functions::add_vec3_or_point(dPoint,
+            utility_functions::multiply_by_constant(dVelocity, PREDICTION_HORIZON));
+
+    /* the repulsion itself was computed for the whole swarm by the drone server, only the obstacles in range of the
+     * drone are gathered here, from the cells around its predicted position */
+    neighbours.for_each_near(dFuturePoint, [&](const neighbour_state& rb) {
+        if (rb.droneID == d->get_id()) return;
+
+        auto obPoint = utility_functions::point_to_vec3(rb.position);
+        auto obFuturePoint = utility_functions::add_vec3_or_point(obPoint,
+                utility_functions::multiply_by_constant(rb.velocity, PREDICTION_HORIZON));
+        double d0 = utility_functions::distance_between(dFuturePoint, obFuturePoint);
+        if (d0 > rb.influenceDistance && d0 > rb.restrictedDistance) return;
+
+        geometry_msgs::Pose obstacle;
+        obstacle.orientation.w = rb.droneID;
+        obstacle.orientation.x = d0;
+        obstacle.position = utility_functions::vec3_to_point(utility_functions::difference(obPoint, dPoint));
+        msg.poses.push_back(obstacle);
+
+        d->log(logger::DEBUG, "Dist: " + std::to_string(d0));
+    });
+
+    /* static geometry repels the drone like a drone standing still, from its closest point. The arena's field gives the
+     * distance to the walls and obstacles in constant time, the obstacle store is only queried where there is no field */
+    geometry_msgs::Vector3 staticForce;
+    double staticRange = std::max(d->influenceDistance, d->restrictedDistance);
+    double staticDistance;
+    geometry_msgs::Vector3 staticNormal;
+    bool inRange;
+    if (static_physical_management::arenaField.sample(dFuturePoint, staticDistance, staticNormal)) {
+        inRange = staticDistance <= staticRange;
+    } else {
+        obstacle_query wall;
+        inRange = static_physical_management::staticObstacles.closest(dFuturePoint, staticRange, wall);
+        staticDistance = wall.distance;
+        staticNormal = wall.normal;
+    }
+    if (inRange) {
+        double vr = K_P * (d->influenceDistance - staticDistance) + K_D * utility_functions::magnitude(dVelocity);
+        if (staticDistance <= d->restrictedDistance) vr = d->maxVel;
+        staticForce = utility_functions::multiply_by_constant(staticNormal, vr);
+        d->log(logger::DEBUG, "Static geometry dist: " + std::to_string(staticDistance));
     }
-    // iterate walls
 
-    geometry_msgs::PoseArray msg;
+    /* obstacles are published closest first, the distance of each is held in its orientation.x */
+    std::sort(msg.poses.begin(), msg.poses.end(), [](const geometry_msgs::Pose& a, const geometry_msgs::Pose& b) {
+        return a.orientation.x < b.orientation.x;
+    });
     std_msgs::Float64 closestMsg;
-    closestMsg.data = (float)closestThisRound;
+    closestMsg.data = (float)d->get_loop_closest();
     msg.header.stamp = ros::Time::now();
-    for (auto ob : sortedObstacles) {
-        msg.poses.push_back(ob.second);
-    }
     d->obstaclesPublisher.publish(msg);
     d->closestObstaclePublisher.publish(closestMsg);
-    return replusiveForce;
+    return utility_functions::add_vec3_or_point(d->get_loop_repulsion(), staticForce);
 }
 
 geometry_msgs::Vector3 potential_fields::attractive_forces(rigidbody *d, double remainingDuration) {
     geometry_msgs::Vector3 attractiveForce;
-    auto distToTarget = utility_functions::distance_between(utility_functions::point_to_vec3(d->currentPose.position), d->lastRecievedApiUpdate.posVel);
+    const rigidbody::physical_snapshot& self = d->get_snapshot();
+    auto distToTarget = utility_functions::distance_between(utility_functions::point_to_vec3(self.pose.position), self.command.posVel);
     auto reqVelocity = calculate_req_velocity(d, remainingDuration);
 
     if (distToTarget <= ATTRACTIVE_DIST) {
         double multiple = utility_functions::magnitude(reqVelocity)/ATTRACTIVE_DIST;
-        auto posDiff = utility_functions::difference(d->lastRecievedApiUpdate.posVel,utility_functions::point_to_vec3(d->currentPose.position));
+        auto posDiff = utility_functions::difference(self.command.posVel,utility_functions::point_to_vec3(self.pose.position));
         attractiveForce = utility_functions::multiply_by_constant(posDiff, multiple);
     }
     else {
@@ -144,9 +150,10 @@ geometry_msgs::Vector3 potential_fields::attractive_forces(rigidbody *d, double
 
 geometry_msgs::Vector3 potential_fields::calculate_req_velocity(rigidbody *d, double remainingDuration) {
     geometry_msgs::Vector3 reqVel;
-    reqVel.x = (d->lastRecievedApiUpdate.posVel.x - d->currentPose.position.x) / remainingDuration;
-    reqVel.y = (d->lastRecievedApiUpdate.posVel.y - d->currentPose.position.y) / remainingDuration;
-    reqVel.z = (d->lastRecievedApiUpdate.posVel.z - d->currentPose.position.z) / remainingDuration;
+    const rigidbody::physical_snapshot& self = d->get_snapshot();
+    reqVel.x = (self.command.posVel.x - self.pose.position.x) / remainingDuration;
+    reqVel.y = (self.command.posVel.y - self.pose.position.y) / remainingDuration;
+    reqVel.z = (self.command.posVel.z - self.pose.position.z) / remainingDuration;
     return reqVel;
 }
 
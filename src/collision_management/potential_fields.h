@@ -6,6 +6,7 @@
 #define MULTI_DRONE_PLATFORM_POTENTIAL_FIELDS_H
 
 #include "rigidbody.h"
+#include "neighbour_grid.h"
 
 /**
  * Indicates when the attractive velocity should reduce to ensure the goalpoint is not overshot
@@ -22,24 +23,22 @@
  */
 #define K_D 0.8f
 
+/**
+ * How far ahead (in seconds) the position of the drone is predicted from its state estimate when computing repulsion
+ */
+#define PREDICTION_HORIZON 0.1
+
 class potential_fields {
 private:
     /**
-     * Used to generate the velocity related to repulsive forces for a given drone obstacle.
+     * Used to get the velocity related to repulsive forces for a given drone, from the other drones as computed for the
+     * whole swarm by the drone server this loop and from the closest static obstacle, and to publish the drone
+     * obstacles within range of the drone.
      * @param d The given drone for which the obstacle positions are relative to.
-     * @param rigidbodies The list of all rigidbodies (treated as obstacles).
+     * @param neighbours The states of all drones (treated as obstacles).
      * @return The repulsive velocity vector.
      */
-    static geometry_msgs::Vector3 replusive_forces(rigidbody* d, std::vector<rigidbody*>& rigidbodies);
-
-    /**
-     * Used to generate the velocity related to attractive forces for a given drone obstacle.
-     * @param d The given drone for which the goal point is relative to.
-     * @param remainingDuration This is used as a factor in the calculation as determines how quickly the given drone
-     * should attempt to reach its destination.
-     * @return The attractive velocity vector.
-     */
-    static geometry_msgs::Vector3 attractive_forces(rigidbody* d, double remainingDuration);
+    static geometry_msgs::Vector3 replusive_forces(rigidbody* d, const neighbour_grid& neighbours);
 
     /**
      * Used to calculate the velocity required to reach the specified destination in time.
@@ -53,27 +52,28 @@ private:
      * The main function which adds the repulsive and attractive velocity vectors to determine the next state for the
      * given drone.
      * @param d The subject drone.
-     * @param rigidbodies All rigidbody objects tracked by the drone server.
+     * @param neighbours The states of all drones known to the drone server.
      */
-    static void position_based_pf(rigidbody* d, std::vector<rigidbody *> &rigidbodies);
+    static void position_based_pf(rigidbody* d, const neighbour_grid& neighbours);
 public:
+    /**
+     * Used to generate the velocity related to attractive forces for a given drone obstacle, also the preferred
+     * velocity of orca_avoidance.
+     * @param d The given drone for which the goal point is relative to.
+     * @param remainingDuration This is used as a factor in the calculation as determines how quickly the given drone
+     * should attempt to reach its destination.
+     * @return The attractive velocity vector.
+     */
+    static geometry_msgs::Vector3 attractive_forces(rigidbody* d, double remainingDuration);
+
     /**
      * Determines whether to apply potential fields based on the command type, currently only applies to position-based
      * commands.
      * @param d The subject drone.
-     * @param rigidbodies All rigidbody objects tracked and known by the drone server.
+     * @param neighbours The states of all drones known by the drone server, including those of other shards.
      * @return
      */
-    static bool check(rigidbody* d, std::vector<rigidbody*>& rigidbodies);
-
-    /**
-    * Variables used to track relative distance related statistics
-    */
-    static double closest;
-    static double closestThisRound;
-    static double lastClosestRound;
-
-
+    static bool check(rigidbody* d, const neighbour_grid& neighbours);
 };
 
 #endif //MULTI_DRONE_PLATFORM_POTENTIAL_FIELDS_H
@@ -0,0 +1,187 @@
+#include "repulsion_kernel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+void repulsion_swarm::load(const neighbour_grid& grid) {
+    const std::vector<neighbour_state>& states = grid.get_states();
+    const std::vector<uint32_t>& order = grid.get_order();
+    for (std::vector<double>* array : {&x, &y, &z, &vx, &vy, &vz, &restrictedDistance, &influenceDistance, &maxVel,
+                                       &sortedForceX, &sortedForceY, &sortedForceZ, &sortedClosest,
+                                       &forceX, &forceY, &forceZ, &closest}) {
+        array->resize(states.size());
+    }
+
+    for (size_t i = 0; i < order.size(); i++) {
+        const neighbour_state& state = states[order[i]];
+        x[i] = state.position.x;
+        y[i] = state.position.y;
+        z[i] = state.position.z;
+        vx[i] = state.velocity.x;
+        vy[i] = state.velocity.y;
+        vz[i] = state.velocity.z;
+        restrictedDistance[i] = state.restrictedDistance;
+        influenceDistance[i] = state.influenceDistance;
+        maxVel[i] = state.maxVel;
+    }
+}
+
+size_t repulsion_swarm::size() const {
+    return x.size();
+}
+
+/**
+ * returns the speed at which a drone is pushed away from an obstacle
+ * @param distance the distance between the drone and the obstacle
+ * @param speedDiff the magnitude of their velocity difference
+ * @param restricted the obstacle's restricted distance
+ * @param influence the obstacle's influence distance
+ * @param maxVel the drone's maximum speed
+ */
+static inline double repulsion_speed(double distance, double speedDiff, double restricted, double influence,
+                                     double maxVel, double kp, double kd) {
+    /* computed unconditionally and selected, so that the kernel's loop has no branches */
+    double field = kp * (influence - distance) + kd * speedDiff;
+    field = (distance <= influence) ? field : 0.0;
+    return (distance <= restricted) ? maxVel : field;
+}
+
+/**
+ * evaluates the pairs of drone i with each gathered drone, returning the repulsion on drone i through fi and closestI
+ * and leaving the repulsion on each gathered drone (as a speed along the direction from drone i) in nearForce and its
+ * distance to drone i, when within drone i's range, in nearDistance
+ */
+static void repel_near(repulsion_swarm& swarm, size_t i, size_t count, double kp, double kd,
+                       double& fxi, double& fyi, double& fzi, double& closestI) {
+    const double* __restrict__ x = swarm.nearX.data();
+    const double* __restrict__ y = swarm.nearY.data();
+    const double* __restrict__ z = swarm.nearZ.data();
+    const double* __restrict__ vx = swarm.nearVx.data();
+    const double* __restrict__ vy = swarm.nearVy.data();
+    const double* __restrict__ vz = swarm.nearVz.data();
+    const double* __restrict__ restricted = swarm.nearRestricted.data();
+    const double* __restrict__ influence = swarm.nearInfluence.data();
+    const double* __restrict__ maxVel = swarm.nearMaxVel.data();
+    double* __restrict__ force = swarm.nearForce.data();
+    double* __restrict__ nearDistance = swarm.nearDistance.data();
+
+    const double none = std::numeric_limits<double>::max();
+    const double xi = swarm.x[i], yi = swarm.y[i], zi = swarm.z[i];
+    const double vxi = swarm.vx[i], vyi = swarm.vy[i], vzi = swarm.vz[i];
+    const double restrictedI = swarm.restrictedDistance[i], influenceI = swarm.influenceDistance[i];
+    const double maxVelI = swarm.maxVel[i];
+    const double rangeI = std::max(influenceI, restrictedI);
+    double fx = 0.0, fy = 0.0, fz = 0.0, closestRange = none;
+
+    /* the gathered arrays never overlap */
+#pragma GCC ivdep
+    for (size_t k = 0; k < count; k++) {
+        const double dx = xi - x[k];
+        const double dy = yi - y[k];
+        const double dz = zi - z[k];
+        const double distance = std::sqrt(dx * dx + dy * dy + dz * dz);
+        /* coincident drones have no direction to be pushed in, as dx, dy and dz are then 0 */
+        const double inverse = 1.0 / (distance + std::numeric_limits<double>::min());
+
+        const double dvx = vxi - vx[k];
+        const double dvy = vyi - vy[k];
+        const double dvz = vzi - vz[k];
+        const double speedDiff = std::sqrt(dvx * dvx + dvy * dvy + dvz * dvz);
+
+        /* i is repelled by k's distances at i's speed limit, and the other way around, in opposite directions */
+        const double onI = repulsion_speed(distance, speedDiff, restricted[k], influence[k], maxVelI, kp, kd) * inverse;
+        force[k] = repulsion_speed(distance, speedDiff, restrictedI, influenceI, maxVel[k], kp, kd) * inverse;
+        fx += onI * dx;
+        fy += onI * dy;
+        fz += onI * dz;
+
+        /* the closest distance only counts drones within their influence or restricted distance */
+        const double rangeOfK = std::max(influence[k], restricted[k]);
+        closestRange = std::min(closestRange, (distance <= rangeOfK) ? distance : none);
+        nearDistance[k] = (distance <= rangeI) ? distance : none;
+    }
+
+    fxi = fx;
+    fyi = fy;
+    fzi = fz;
+    closestI = std::min(closestI, closestRange);
+}
+
+void compute_repulsion(repulsion_swarm& swarm, const neighbour_grid& grid, double kp, double kd) {
+    const size_t count = swarm.size();
+    std::fill(swarm.sortedForceX.begin(), swarm.sortedForceX.end(), 0.0);
+    std::fill(swarm.sortedForceY.begin(), swarm.sortedForceY.end(), 0.0);
+    std::fill(swarm.sortedForceZ.begin(), swarm.sortedForceZ.end(), 0.0);
+    std::fill(swarm.sortedClosest.begin(), swarm.sortedClosest.end(), std::numeric_limits<double>::max());
+
+    std::array<int64_t, 3> lastCell = {{0, 0, 0}};
+    for (size_t i = 0; i < count; i++) {
+        /* every pair within range lies in neighbouring cells, and is evaluated from its drone earlier in bucket order */
+        /* pairs out of range of both drones repel neither, they are dropped by their squared distance when gathering */
+        const double xi = swarm.x[i], yi = swarm.y[i], zi = swarm.z[i];
+        const double rangeI = std::max(swarm.influenceDistance[i], swarm.restrictedDistance[i]);
+        std::array<int64_t, 3> cell = grid.get_cell(xi, yi, zi);
+        if (i == 0 || cell != lastCell) {
+            /* drones of a bucket are contiguous and mostly share a cell, so the buckets around it are looked up once */
+            lastCell = cell;
+            swarm.nearBuckets.clear();
+            grid.for_each_bucket_near(xi, yi, zi, [&](uint32_t begin, uint32_t end) {
+                swarm.nearBuckets.emplace_back(begin, end);
+            });
+        }
+
+        swarm.nearIndex.clear();
+        for (const std::pair<uint32_t, uint32_t>& bucket : swarm.nearBuckets) {
+            for (uint32_t j = std::max(bucket.first, (uint32_t)i + 1); j < bucket.second; j++) {
+                const double dx = xi - swarm.x[j], dy = yi - swarm.y[j], dz = zi - swarm.z[j];
+                const double range = std::max(rangeI,
+                                              std::max(swarm.influenceDistance[j], swarm.restrictedDistance[j]));
+                if (dx * dx + dy * dy + dz * dz <= range * range) swarm.nearIndex.push_back(j);
+            }
+        }
+        const size_t nearCount = swarm.nearIndex.size();
+        if (nearCount == 0) continue;
+
+        for (std::vector<double>* array : {&swarm.nearX, &swarm.nearY, &swarm.nearZ, &swarm.nearVx, &swarm.nearVy,
+                                           &swarm.nearVz, &swarm.nearRestricted, &swarm.nearInfluence,
+                                           &swarm.nearMaxVel, &swarm.nearForce, &swarm.nearDistance}) {
+            if (array->size() < nearCount) array->resize(nearCount);
+        }
+        for (size_t k = 0; k < nearCount; k++) {
+            uint32_t j = swarm.nearIndex[k];
+            swarm.nearX[k] = swarm.x[j];
+            swarm.nearY[k] = swarm.y[j];
+            swarm.nearZ[k] = swarm.z[j];
+            swarm.nearVx[k] = swarm.vx[j];
+            swarm.nearVy[k] = swarm.vy[j];
+            swarm.nearVz[k] = swarm.vz[j];
+            swarm.nearRestricted[k] = swarm.restrictedDistance[j];
+            swarm.nearInfluence[k] = swarm.influenceDistance[j];
+            swarm.nearMaxVel[k] = swarm.maxVel[j];
+        }
+
+        double fxi, fyi, fzi, closestI = swarm.sortedClosest[i];
+        repel_near(swarm, i, nearCount, kp, kd, fxi, fyi, fzi, closestI);
+        swarm.sortedForceX[i] += fxi;
+        swarm.sortedForceY[i] += fyi;
+        swarm.sortedForceZ[i] += fzi;
+        swarm.sortedClosest[i] = closestI;
+
+        for (size_t k = 0; k < nearCount; k++) {
+            uint32_t j = swarm.nearIndex[k];
+            swarm.sortedForceX[j] -= swarm.nearForce[k] * (xi - swarm.x[j]);
+            swarm.sortedForceY[j] -= swarm.nearForce[k] * (yi - swarm.y[j]);
+            swarm.sortedForceZ[j] -= swarm.nearForce[k] * (zi - swarm.z[j]);
+            swarm.sortedClosest[j] = std::min(swarm.sortedClosest[j], swarm.nearDistance[k]);
+        }
+    }
+
+    const std::vector<uint32_t>& order = grid.get_order();
+    for (size_t i = 0; i < count; i++) {
+        swarm.forceX[order[i]] = swarm.sortedForceX[i];
+        swarm.forceY[order[i]] = swarm.sortedForceY[i];
+        swarm.forceZ[order[i]] = swarm.sortedForceZ[i];
+        swarm.closest[order[i]] = swarm.sortedClosest[i];
+    }
+}
@@ -0,0 +1,68 @@
+#ifndef MULTI_DRONE_PLATFORM_REPULSION_KERNEL_H
+#define MULTI_DRONE_PLATFORM_REPULSION_KERNEL_H
+
+#include <cstddef>
+#include <utility>
+#include <vector>
+#include "neighbour_grid.h"
+
+/**
+ * The state of a swarm as structure-of-arrays (one array per quantity) for the repulsion kernel, together with the
+ * kernel's output. The input arrays hold the drones in the bucket order of a neighbour grid, so the drones of a bucket
+ * are contiguous, while the output arrays are indexed like the grid's states. The arrays are reused from loop to loop.
+ */
+struct repulsion_swarm {
+    /* inputs in bucket order, the position and velocity of each drone, its avoidance distances and its maximum speed */
+    std::vector<double> x, y, z;
+    std::vector<double> vx, vy, vz;
+    std::vector<double> restrictedDistance;
+    std::vector<double> influenceDistance;
+    std::vector<double> maxVel;
+
+    /* the net repulsive velocity on each drone and the distance to its closest drone within range, in bucket order */
+    std::vector<double> sortedForceX, sortedForceY, sortedForceZ;
+    std::vector<double> sortedClosest;
+
+    /* the ranges of the bucket order holding the buckets around the cell of the drone being evaluated */
+    std::vector<std::pair<uint32_t, uint32_t>> nearBuckets;
+
+    /* the drones near the drone being evaluated, gathered into a contiguous block with their repulsion on it */
+    std::vector<uint32_t> nearIndex;
+    std::vector<double> nearX, nearY, nearZ;
+    std::vector<double> nearVx, nearVy, nearVz;
+    std::vector<double> nearRestricted, nearInfluence, nearMaxVel;
+    std::vector<double> nearForce, nearDistance;
+
+    /* outputs indexed like the grid's states, the largest double for closest when no drone is within range */
+    std::vector<double> forceX, forceY, forceZ;
+    std::vector<double> closest;
+
+    /**
+     * fills the inputs from the states of a built neighbour grid
+     * @param grid the grid
+     */
+    void load(const neighbour_grid& grid);
+
+    /**
+     * returns the number of drones
+     */
+    size_t size() const;
+};
+
+/**
+ * computes the potential field repulsion between every pair of nearby drones of a swarm. Each pair is evaluated once,
+ * with the distance, direction and velocity difference shared by the repulsion of both drones. A drone within the
+ * restricted distance of another is pushed away at its maximum speed, within the influence distance it is pushed away
+ * at kp * (influenceDistance - distance) + kd * |velocity difference|.
+ *
+ * Only the drones in the grid buckets around each drone are evaluated. They are gathered into a contiguous block, the
+ * pairs of the block are evaluated by a branchless loop so that it is vectorised, and the repulsion on the gathered
+ * drones is scattered back.
+ * @param swarm the swarm, loaded from grid, whose outputs are overwritten
+ * @param grid the grid the swarm was loaded from
+ * @param kp the gain of the distance term
+ * @param kd the gain of the velocity difference term
+ */
+void compute_repulsion(repulsion_swarm& swarm, const neighbour_grid& grid, double kp, double kd);
+
+#endif //MULTI_DRONE_PLATFORM_REPULSION_KERNEL_H
@@ -0,0 +1,157 @@
+#include "signed_distance_field.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static_assert(sizeof(sdf_file_header) == 64, "the signed distance field header must keep its file layout");
+static_assert(sizeof(sdf_sample) == 16, "signed distance field samples must keep their file layout");
+
+signed_distance_field::~signed_distance_field() {
+    this->unmap();
+}
+
+void signed_distance_field::unmap() {
+    if (mapping) munmap(mapping, mappingSize);
+    mapping = nullptr;
+    mappingSize = 0;
+    header = nullptr;
+    samples = nullptr;
+}
+
+bool signed_distance_field::load(const std::string& path, std::string& error) {
+    this->unmap();
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        error = "unable to open '" + path + "': " + std::strerror(errno);
+        return false;
+    }
+    struct stat status;
+    if (fstat(fd, &status) != 0 || (size_t)status.st_size < sizeof(sdf_file_header)) {
+        error = "'" + path + "' is too small to be a signed distance field";
+        close(fd);
+        return false;
+    }
+    void* mapped = mmap(nullptr, (size_t)status.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    /* the mapping stays valid after the descriptor is closed */
+    close(fd);
+    if (mapped == MAP_FAILED) {
+        error = "unable to map '" + path + "': " + std::strerror(errno);
+        return false;
+    }
+
+    const sdf_file_header* mappedHeader = (const sdf_file_header*)mapped;
+    size_t count = (size_t)mappedHeader->size[0] * mappedHeader->size[1] * mappedHeader->size[2];
+    if (std::strncmp(mappedHeader->magic, SDF_FILE_MAGIC, sizeof(mappedHeader->magic)) != 0
+        || mappedHeader->version != SDF_FILE_VERSION) {
+        error = "'" + path + "' is not a version " + std::to_string(SDF_FILE_VERSION) + " signed distance field";
+    } else if (mappedHeader->size[0] < 2 || mappedHeader->size[1] < 2 || mappedHeader->size[2] < 2
+               || !(mappedHeader->resolution > 0.0)) {
+        error = "'" + path + "' has an empty grid";
+    } else if ((size_t)status.st_size != sizeof(sdf_file_header) + count * sizeof(sdf_sample)) {
+        error = "'" + path + "' is truncated, expected " + std::to_string(count) + " samples";
+    } else {
+        mapping = mapped;
+        mappingSize = (size_t)status.st_size;
+        header = mappedHeader;
+        samples = (const sdf_sample*)((const char*)mapped + sizeof(sdf_file_header));
+        /* lookups land anywhere in the field, fault it in now rather than during the control loop */
+        madvise(mapping, mappingSize, MADV_WILLNEED);
+        return true;
+    }
+    munmap(mapped, (size_t)status.st_size);
+    return false;
+}
+
+bool signed_distance_field::save(const std::string& path, const std::array<uint32_t, 3>& size,
+                                 const std::array<double, 3>& origin, double resolution,
+                                 const std::vector<sdf_sample>& samples, std::string& error) {
+    sdf_file_header fileHeader;
+    std::memset(&fileHeader, 0, sizeof(fileHeader));
+    std::strncpy(fileHeader.magic, SDF_FILE_MAGIC, sizeof(fileHeader.magic));
+    fileHeader.version = SDF_FILE_VERSION;
+    for (int axis = 0; axis < 3; axis++) {
+        fileHeader.size[axis] = size[axis];
+        fileHeader.origin[axis] = origin[axis];
+    }
+    fileHeader.resolution = resolution;
+    if (samples.size() != (size_t)size[0] * size[1] * size[2]) {
+        error = "expected " + std::to_string((size_t)size[0] * size[1] * size[2]) + " samples but was given "
+                + std::to_string(samples.size());
+        return false;
+    }
+
+    /* written beside the target and renamed over it, a drone server mapping the old file keeps its pages intact */
+    std::string tempPath = path + ".tmp." + std::to_string(getpid());
+    FILE* file = std::fopen(tempPath.c_str(), "wb");
+    if (!file) {
+        error = "unable to create '" + tempPath + "': " + std::strerror(errno);
+        return false;
+    }
+    bool written = std::fwrite(&fileHeader, sizeof(fileHeader), 1, file) == 1
+                   && std::fwrite(samples.data(), sizeof(sdf_sample), samples.size(), file) == samples.size();
+    written = (std::fclose(file) == 0) && written;
+    if (!written) {
+        error = "unable to write '" + tempPath + "'";
+    } else if (std::rename(tempPath.c_str(), path.c_str()) != 0) {
+        error = "unable to replace '" + path + "': " + std::strerror(errno);
+        written = false;
+    }
+    if (!written) std::remove(tempPath.c_str());
+    return written;
+}
+
+bool signed_distance_field::is_loaded() const {
+    return header != nullptr;
+}
+
+bool signed_distance_field::sample(const geometry_msgs::Vector3& point, double& distance,
+                                   geometry_msgs::Vector3& gradient) const {
+    if (!header) return false;
+
+    /* the cell holding the point, and the point's position within it */
+    const double position[3] = {point.x, point.y, point.z};
+    size_t cell[3];
+    double t[3];
+    for (int axis = 0; axis < 3; axis++) {
+        double scaled = (position[axis] - header->origin[axis]) / header->resolution;
+        double last = (double)(header->size[axis] - 1);
+        if (!(scaled >= 0.0 && scaled <= last)) return false;
+        double index = std::min(std::floor(scaled), last - 1.0);
+        cell[axis] = (size_t)index;
+        t[axis] = scaled - index;
+    }
+
+    const size_t strideY = header->size[0];
+    const size_t strideZ = strideY * header->size[1];
+    const sdf_sample* corner = samples + cell[0] + cell[1] * strideY + cell[2] * strideZ;
+    double interpolated[4] = {0.0, 0.0, 0.0, 0.0};
+    for (int k = 0; k < 2; k++) {
+        for (int j = 0; j < 2; j++) {
+            for (int i = 0; i < 2; i++) {
+                const sdf_sample& s = corner[i + j * strideY + k * strideZ];
+                double weight = (i ? t[0] : 1.0 - t[0]) * (j ? t[1] : 1.0 - t[1]) * (k ? t[2] : 1.0 - t[2]);
+                interpolated[0] += weight * s.distance;
+                interpolated[1] += weight * s.gradient[0];
+                interpolated[2] += weight * s.gradient[1];
+                interpolated[3] += weight * s.gradient[2];
+            }
+        }
+    }
+
+    distance = interpolated[0];
+    double norm = std::sqrt(interpolated[1] * interpolated[1] + interpolated[2] * interpolated[2]
+                            + interpolated[3] * interpolated[3]);
+    /* opposing gradients (on a ridge of the field) can cancel out, leaving no direction */
+    double scale = (norm > 0.0) ? 1.0 / norm : 0.0;
+    gradient.x = interpolated[1] * scale;
+    gradient.y = interpolated[2] * scale;
+    gradient.z = interpolated[3] * scale;
+    return true;
+}
@@ -0,0 +1,98 @@
+#ifndef MULTI_DRONE_PLATFORM_SIGNED_DISTANCE_FIELD_H
+#define MULTI_DRONE_PLATFORM_SIGNED_DISTANCE_FIELD_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "geometry_msgs/Vector3.h"
+
+/**
+ * identifies a signed distance field file, and the version of its layout
+ */
+#define SDF_FILE_MAGIC "MDPSDF"
+#define SDF_FILE_VERSION 1
+
+/**
+ * A sample of a signed distance field, the distance to the nearest geometry (negative inside it) and the unit gradient
+ * of the distance, pointing away from the geometry
+ */
+struct sdf_sample {
+    float distance;
+    float gradient[3];
+};
+
+/**
+ * The layout of a signed distance field file, the header is followed by size[0] * size[1] * size[2] samples with x
+ * varying fastest. Sample (i, j, k) lies at origin + resolution * (i, j, k).
+ */
+struct sdf_file_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t size[3];
+    double origin[3];
+    double resolution;
+    uint8_t reserved[8];
+};
+
+/**
+ * A voxelised signed distance field of the static geometry of a flight arena, generated offline by generate_sdf and
+ * memory mapped read only at runtime. Lookups interpolate the distance and gradient trilinearly between the 8 samples
+ * around a point, so they take constant time however complex the geometry is. The field is not modified after it is
+ * loaded, so it can be sampled from any thread.
+ */
+class signed_distance_field {
+public:
+    signed_distance_field() = default;
+    ~signed_distance_field();
+
+    signed_distance_field(const signed_distance_field&) = delete;
+    signed_distance_field& operator=(const signed_distance_field&) = delete;
+
+    /**
+     * maps a signed distance field file, replacing any field already mapped
+     * @param path the path to the file
+     * @param error set to the reason when the file could not be mapped
+     * @return false if the file could not be mapped or is not a valid field
+     */
+    bool load(const std::string& path, std::string& error);
+
+    /**
+     * writes a signed distance field file, replacing any existing file at once so that it can be regenerated while a
+     * drone server has it mapped
+     * @param path the path to the file
+     * @param size the number of samples along x, y and z, at least 2 along each
+     * @param origin the position of the first sample
+     * @param resolution the distance between neighbouring samples
+     * @param samples the samples, x varying fastest
+     * @param error set to the reason when the file could not be written
+     * @return false if the file could not be written
+     */
+    static bool save(const std::string& path, const std::array<uint32_t, 3>& size, const std::array<double, 3>& origin,
+                     double resolution, const std::vector<sdf_sample>& samples, std::string& error);
+
+    /**
+     * returns true if a field is mapped
+     */
+    bool is_loaded() const;
+
+    /**
+     * looks up the distance and gradient at a point
+     * @param point the point
+     * @param distance the interpolated signed distance
+     * @param gradient the interpolated gradient, normalised
+     * @return false if no field is mapped or the point lies outside of the field, leaving distance and gradient unset
+     */
+    bool sample(const geometry_msgs::Vector3& point, double& distance, geometry_msgs::Vector3& gradient) const;
+
+private:
+    void unmap();
+
+    void* mapping = nullptr;
+    size_t mappingSize = 0;
+    const sdf_file_header* header = nullptr;
+    const sdf_sample* samples = nullptr;
+};
+
+#endif //MULTI_DRONE_PLATFORM_SIGNED_DISTANCE_FIELD_H
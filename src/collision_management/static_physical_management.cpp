@@ -6,6 +6,12 @@
 #include "static_physical_management.h"
 
 #define NAIVE_ACCEL_BUFFER 1.1f
+
+/* how quickly (m/s^2) a drone is assumed to be able to slow down before a wall or obstacle */
+#define STOPPING_ACCEL 2.0
+
+/* a requested position is pushed out of the static obstacles at most this many times, each push can land it in another */
+#define OBSTACLE_CLEARANCE_PASSES 4
 // @TODO: Use these two methods from utility functions rather than creating copies
 template<class T>
 T multiply_by_constant(T a, double multiple) {
@@ -29,20 +35,8 @@ static_limits static_physical_management::staticBoundary(
     {{0.10, 2.00}}
 );
 
-geometry_msgs::Vector3 static_physical_management::predict_position(ros::Time lastUpdate, geometry_msgs::Twist currVel, geometry_msgs::Pose currPos, int timeSteps) {
-    double timeSinceMoCapUpdate = ros::Time::now().toSec() - lastUpdate.toSec();
-    if (timeSinceMoCapUpdate < 0.0) {
-        ROS_WARN("time since update returning less than 0");
-        timeSinceMoCapUpdate = 0.0;
-    }
-
-    geometry_msgs::Vector3 pos = mdp_conversions::point_to_vector3(currPos.position);
-    pos.x += (currVel.linear.x * timeSinceMoCapUpdate * (double)timeSteps);
-    pos.y += (currVel.linear.y * timeSinceMoCapUpdate * (double)timeSteps);
-    pos.z += (currVel.linear.z * timeSinceMoCapUpdate * (double)timeSteps);
-
-    return pos;
-}
+obstacle_store static_physical_management::staticObstacles;
+signed_distance_field static_physical_management::arenaField;
 
 double static_physical_management::predict_current_yaw(ros::Time lastUpdate, geometry_msgs::Twist currVel, geometry_msgs::Pose currPos, int timeSteps) {
     double timeSinceMoCapUpdate = ros::Time::now().toSec() - lastUpdate.toSec();
@@ -74,19 +68,39 @@ static_limits static_physical_management::generate_velocity_boundaries(geometry_
     return velocity;
 }
 geometry_msgs::Vector3 static_physical_management::vel_static_limits(rigidbody* d, geometry_msgs::Vector3 requestedVelocity) {
-    // time steps, how far in advance should we predict position
-    auto positionPrediction = predict_position(d->timeOfLastApiUpdate, d->currentVelocity, d->currentPose, 0);
+    // where the drone is now, compensating for the motion capture latency
+    auto positionPrediction = d->predict_position(ros::Time::now());
 
     // acceleration, how quickly can we slow down
     // can change this to have different for x,y,z
-    auto velocityLimits = generate_velocity_boundaries(positionPrediction, 2);
+    double accel = STOPPING_ACCEL;
+    auto velocityLimits = generate_velocity_boundaries(positionPrediction, accel);
 
     geometry_msgs::Vector3 limitAdjustedVel;
 
     limitAdjustedVel.x = std::min(std::max(requestedVelocity.x, velocityLimits.x[0]), velocityLimits.x[1]);
     limitAdjustedVel.y = std::min(std::max(requestedVelocity.y, velocityLimits.y[0]), velocityLimits.y[1]);
     limitAdjustedVel.z = std::min(std::max(requestedVelocity.z, velocityLimits.z[0]), velocityLimits.z[1]);
-    return limitAdjustedVel;
+
+    return check_field_approach(d, positionPrediction, limitAdjustedVel, accel);
+}
+
+geometry_msgs::Vector3 static_physical_management::check_field_approach(rigidbody* d, const geometry_msgs::Vector3& position,
+                                                                        geometry_msgs::Vector3 requestedVelocity, double accel) {
+    // the stopping distance towards the closest wall or obstacle of the arena's field, only the velocity towards it is
+    // limited so the drone can still slide along it
+    double distance;
+    geometry_msgs::Vector3 gradient;
+    if (arenaField.sample(position, distance, gradient)) {
+        double approach = -(requestedVelocity.x * gradient.x + requestedVelocity.y * gradient.y + requestedVelocity.z * gradient.z);
+        double maxApproach = std::sqrt(2.0 * accel * std::max(distance - d->restrictedDistance, 0.0));
+        if (approach > maxApproach) {
+            requestedVelocity.x += gradient.x * (approach - maxApproach);
+            requestedVelocity.y += gradient.y * (approach - maxApproach);
+            requestedVelocity.z += gradient.z * (approach - maxApproach);
+        }
+    }
+    return requestedVelocity;
 }
 
 geometry_msgs::Point static_physical_management::pos_static_limits(rigidbody *d, geometry_msgs::Point requestedPosition, double dur) {
@@ -115,6 +129,23 @@ geometry_msgs::Vector3 static_physical_management::check_physical_limits(geometr
     return limited;
 }
 
+geometry_msgs::Vector3 static_physical_management::check_obstacle_clearance(rigidbody* d, geometry_msgs::Vector3 requestedPosition) {
+    // keep the drone's restricted distance from every static obstacle
+    obstacle_query obstacle;
+    for (int pass = 0; pass < OBSTACLE_CLEARANCE_PASSES; pass++) {
+        if (!staticObstacles.closest(requestedPosition, d->restrictedDistance, obstacle)) break;
+        if (obstacle.distance >= d->restrictedDistance) break;
+        double push = d->restrictedDistance - obstacle.distance;
+        requestedPosition.x += obstacle.normal.x * push;
+        requestedPosition.y += obstacle.normal.y * push;
+        requestedPosition.z += obstacle.normal.z * push;
+        d->log(logger::DEBUG, "Requested position is " + std::to_string(obstacle.distance) + "m from obstacle "
+                + std::to_string(obstacle.obstacle) + ", moving it clear");
+        requestedPosition = check_physical_limits(requestedPosition);
+    }
+    return requestedPosition;
+}
+
 geometry_msgs::Vector3 static_physical_management::check_physical_limits(rigidbody* d, geometry_msgs::Vector3 requestedVelocity) {
     geometry_msgs::Vector3 limited;
     limited.x = std::min(std::max(requestedVelocity.x, d->velocity_limits.x[0]), d->velocity_limits.x[1]);
@@ -124,16 +155,19 @@ geometry_msgs::Vector3 static_physical_management::check_physical_limits(rigidbo
 }
 
 geometry_msgs::Vector3 static_physical_management::adjust_for_physical_limits(rigidbody* d, geometry_msgs::Vector3 requestedVelocity) {
-    return check_physical_limits(d, requestedVelocity);
+    auto limited = check_physical_limits(d, requestedVelocity);
+    if (!arenaField.is_loaded()) return limited;
+    return check_field_approach(d, d->predict_position(ros::Time::now()), limited, STOPPING_ACCEL);
 }
 
 double static_physical_management::adjust_for_physical_limits(rigidbody* d, geometry_msgs::Vector3& requestedPosition, double dur) {
-    auto pos_within_bounds = check_physical_limits(requestedPosition);
+    auto pos_within_bounds = check_obstacle_clearance(d, check_physical_limits(requestedPosition));
+    auto currentPosition = d->predict_position(ros::Time::now());
     geometry_msgs::Vector3 velocity;
     geometry_msgs::Vector3 distToTravel;
-    distToTravel.x = (pos_within_bounds.x - d->currentPose.position.x);
-    distToTravel.y = (pos_within_bounds.y - d->currentPose.position.y);
-    distToTravel.z = (pos_within_bounds.z - d->currentPose.position.z);
+    distToTravel.x = (pos_within_bounds.x - currentPosition.x);
+    distToTravel.y = (pos_within_bounds.y - currentPosition.y);
+    distToTravel.z = (pos_within_bounds.z - currentPosition.z);
 
     velocity.x = distToTravel.x / dur;
     velocity.y = distToTravel.y / dur;
@@ -217,47 +251,39 @@ multi_drone_platform::api_update static_physical_management::adjust_command(rigi
     if (d->maxVel == -1.0) d->set_max_vel();
 //    if duration is less than or equal to 0, opt for default duration
     if (modifiedMsg.duration <= 0.0) modifiedMsg.duration = 4.0f;
-    switch(apiMap[modifiedMsg.msgType]) {
-        /* VELOCITY */
-        case 0:
+    switch(modifiedMsg.opcode) {
+        case multi_drone_platform::api_update::VELOCITY:
             make_absolute_velocity(d, modifiedMsg);
             modifiedMsg.posVel = adjust_for_physical_limits(d, modifiedMsg.posVel);
             break;
-            /* POSITION */
-        case 1:
+        case multi_drone_platform::api_update::POSITION:
             make_absolute_position(d, modifiedMsg);
             modifiedMsg.duration = adjust_for_physical_limits(d, modifiedMsg.posVel, modifiedMsg.duration);
             break;
-            /* TAKEOFF */
-        case 2:
+        case multi_drone_platform::api_update::TAKEOFF:
             // already in absolute form, no need to convert.
             // simply check enough time has been allowed, and the height is not out of bounds
             if (modifiedMsg.posVel.z <= 0.0f) modifiedMsg.posVel.z = 0.25f;
             modifiedMsg.duration = adjust_for_physical_limits(d, modifiedMsg.posVel, modifiedMsg.duration);
             break;
-            /* LAND */
-        case 3:
+        case multi_drone_platform::api_update::LAND:
             // checks enough duration has been added.
             check_land(d, modifiedMsg);
             break;
-            /* HOVER */
-        case 4:
+        case multi_drone_platform::api_update::HOVER:
             break;
-            /* EMERGENCY */
-        case 5:
+        case multi_drone_platform::api_update::EMERGENCY:
 
             break;
-            /* SET_HOME */
-        case 6:
+        case multi_drone_platform::api_update::SET_HOME:
             make_absolute_position(d, modifiedMsg);
             break;
-            /* GOTO_HOME */
-        case 8:
+        case multi_drone_platform::api_update::GOTO_HOME:
             check_go_home(d, modifiedMsg);
             // don't need to check land as 4.0f is allowed on rigidbody which is plenty of time
             break;
         default:
-            d->log(logger::WARN, "The API command, " + modifiedMsg.msgType + ", is not valid");
+            d->log(logger::WARN, std::string("The API command, ") + api_opcode_to_string(modifiedMsg.opcode) + ", is not valid");
             break;
     }
     return modifiedMsg;
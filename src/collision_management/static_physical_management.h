@@ -7,6 +7,8 @@
 #define MULTI_DRONE_PLATFORM_STATIC_PHYSICAL_MANAGEMENT_H
 
 #include "rigidbody.h"
+#include "obstacle_store.h"
+#include "signed_distance_field.h"
 
 using coord_array = std::array<double, 3>;
 struct static_limits {
@@ -33,14 +35,25 @@ class static_physical_management {
 private:
     static std::array<double, 2> individual_velocity_boundaries(std::array<double, 2> limit, double currPos, double accel);
     static static_limits generate_velocity_boundaries(geometry_msgs::Vector3 currPos, double accel);
-    static geometry_msgs::Vector3 predict_position(ros::Time lastUpdate, geometry_msgs::Twist currVel, geometry_msgs::Pose currPos, int timeSteps);
     static double predict_current_yaw(ros::Time lastUpdate, geometry_msgs::Twist currVel, geometry_msgs::Pose currPos, int timeSteps);
     static geometry_msgs::Vector3 vel_static_limits(rigidbody* d, geometry_msgs::Vector3 requestedVelocity);
     static geometry_msgs::Point pos_static_limits(rigidbody* d, geometry_msgs::Point requestedPos, double dur);
     static geometry_msgs::Vector3 check_physical_limits(rigidbody* d, geometry_msgs::Vector3 requestedVelocity);
     static geometry_msgs::Vector3 check_physical_limits(geometry_msgs::Vector3 requestedPosition);
+    static geometry_msgs::Vector3 check_obstacle_clearance(rigidbody* d, geometry_msgs::Vector3 requestedPosition);
+    static geometry_msgs::Vector3 check_field_approach(rigidbody* d, const geometry_msgs::Vector3& position,
+                                                       geometry_msgs::Vector3 requestedVelocity, double accel);
 public:
     static static_limits staticBoundary;
+    /**
+     * the static obstacles of the flying space, loaded by the drone server from the file given on OBSTACLES_PARAM
+     */
+    static obstacle_store staticObstacles;
+    /**
+     * the signed distance field of the arena's walls and static obstacles, mapped by the drone server from the file
+     * given on ARENA_SDF_PARAM. Where it is not loaded, or a point lies outside of it, staticObstacles is queried instead
+     */
+    static signed_distance_field arenaField;
     static double adjust_for_physical_limits(rigidbody* d, geometry_msgs::Vector3& requestedPosition, double dur);
     static geometry_msgs::Vector3 adjust_for_physical_limits(rigidbody* d, geometry_msgs::Vector3 requestedVelocity);
     static multi_drone_platform::api_update adjust_command(rigidbody *d, const multi_drone_platform::api_update msg);
@@ -20,16 +20,14 @@ bool potential_fields::check(rigidbody* d, std::vector<rigidbody*>& rigidbodies)
     if (remainingDuration > 0.00) {
 //        d->log(logger::INFO, "Remaining dur: " + std::to_string(remainingDuration));
 //    @TODO: This is currently not configured for yaw
-        switch(apiMap[d->lastRecievedApiUpdate.msgType]) {
-            /* VELOCITY */
-            case 0:
+        switch(d->lastRecievedApiUpdate.opcode) {
+            case multi_drone_platform::api_update::VELOCITY:
 //                velLimited = vel_static_limits(d, d->desiredVelocity.linear);
 //                if (!coord_equality(velLimited, d->desiredVelocity.linear)) {
 //                    d->set_desired_velocity(velLimited, 0.0, remainingDuration, true, true);
 //                }
                 break;
-                /* POSITION */
-            case 1:
+            case multi_drone_platform::api_update::POSITION:
                 position_based_pf(d, rigidbodies);
 
                 break;
@@ -50,6 +50,8 @@ void debug_window::init(mdp::id droneName, std::array<int, 2> startLocation, boo
 
     std::string batteryTopic = "mdp/drone_" + std::to_string(myDrone.numericID) + "/battery";
 
+    std::string stateTopic = "mdp/drone_" + std::to_string(myDrone.numericID) + "/state";
+
     windowNode.setCallbackQueue(&windowQueue);
 
     /* larger queue size to get log messages between periodic updates */
@@ -94,6 +96,13 @@ void debug_window::init(mdp::id droneName, std::array<int, 2> startLocation, boo
             &debug_window::battery_callback,
             this);
 
+    /* latched, so the current state arrives on subscription */
+    stateSubscriber = windowNode.subscribe<multi_drone_platform::state_event>(
+            stateTopic,
+            10,
+            &debug_window::state_callback,
+            this);
+
     this->expanded = false;
     this->set_title(myDrone.name);
 
@@ -244,13 +253,17 @@ void debug_window::write_to_file() {
     }
 }
 
-void debug_window::fetch_state_param() {
-    if (windowNode.hasParam("/mdp/drone_" + std::to_string(myDrone.numericID) + "/state")) {
-        windowNode.getParam("/mdp/drone_" + std::to_string(myDrone.numericID) + "/state", currState);
-    }
-    else {
-        /* If the state does not exist, the drone has been removed from the drone_server */
-        this->close();
+void debug_window::state_callback(const multi_drone_platform::state_event::ConstPtr& msg) {
+    switch (msg->state) {
+        case multi_drone_platform::state_event::LANDED:     currState = "LANDED"; break;
+        case multi_drone_platform::state_event::HOVERING:   currState = "HOVERING"; break;
+        case multi_drone_platform::state_event::MOVING:     currState = "MOVING"; break;
+        case multi_drone_platform::state_event::DELETED:
+            /* the drone has been removed from the drone_server */
+            currState = "DELETED";
+            this->close();
+            break;
+        default:                                            currState = "UNKNOWN"; break;
     }
 }
 
@@ -259,8 +272,6 @@ bool debug_window::ros_spin() {
     /* Call all ROS events queued since last iteration */
     windowQueue.callAvailable();
 
-    fetch_state_param();
-
     /* Call dispatcher to update UI elements */
     dispatcher.emit();
     return true;
@@ -15,6 +15,7 @@
 #include <std_msgs/Float32.h>
 
 #include "multi_drone_platform/log.h"
+#include "multi_drone_platform/state_event.h"
 #include "gtk_ref.h"
 #include "user_api.h"
 
@@ -90,10 +91,11 @@ private:
     std::string round_to_string(double val, int n);
 
     /**
-     * Updates the state of the drone, into the currentState variable. If this variable does not exist the drone has
-     * been removed and thus the window is closed.
+     * Callback for the drone's latched state event topic. Updates the currState variable, and closes the window once
+     * the drone has been removed from the drone server.
+     * @param msg The drone's new flight state.
      */
-    void fetch_state_param();
+    void state_callback(const multi_drone_platform::state_event::ConstPtr& msg);
 
     /**
      * Called periodically and will call all available queued callback events and update the state of the drone. A
@@ -289,6 +291,7 @@ private:
     ros::Subscriber desTwistSubscriber;
     ros::Subscriber obstacleSubscriber;
     ros::Subscriber batterySubscriber;
+    ros::Subscriber stateSubscriber;
 
     /**
      * ROS message types used to store the most recent updates which are accessed during the Gtk Dispatcher call.
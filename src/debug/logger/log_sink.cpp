@@ -0,0 +1,180 @@
+#include "log_sink.h"
+
+#include <chrono>
+#include <cstdio>
+
+/* how often the writer thread wakes to write queued lines */
+#define LOG_SINK_WRITE_PERIOD_MS 50
+
+log_sink::log_sink(size_t queueCapacity, size_t maxFileBytes, unsigned int maxRotatedFiles)
+    : maxFileBytes(maxFileBytes), maxRotatedFiles(maxRotatedFiles)
+{
+    size_t capacity = 2;
+    while (capacity < queueCapacity) capacity <<= 1;
+    mask = capacity - 1;
+    cells.reset(new cell[capacity]);
+    for (size_t i = 0; i < capacity; i++) {
+        cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    writer = std::thread(&log_sink::writer_loop, this);
+}
+
+log_sink::~log_sink() {
+    {
+        std::lock_guard<std::mutex> lock(fileMutex);
+        shouldExit = true;
+    }
+    wakeCondition.notify_one();
+    writer.join();
+}
+
+bool log_sink::post(logger::log_type type, double stamp, std::string message) {
+    cell* c;
+    size_t pos = enqueuePos.load(std::memory_order_relaxed);
+    while (true) {
+        c = &cells[pos & mask];
+        size_t sequence = c->sequence.load(std::memory_order_acquire);
+        intptr_t dif = (intptr_t)sequence - (intptr_t)pos;
+        if (dif == 0) {
+            if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+        } else if (dif < 0) {
+            /* queue is full, drop rather than block the caller */
+            droppedCount.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        } else {
+            pos = enqueuePos.load(std::memory_order_relaxed);
+        }
+    }
+
+    c->data.type = type;
+    c->data.stamp = stamp;
+    c->data.message = std::move(message);
+    c->sequence.store(pos + 1, std::memory_order_release);
+    return true;
+}
+
+bool log_sink::try_pop(entry& out) {
+    cell* c = &cells[dequeuePos & mask];
+    size_t sequence = c->sequence.load(std::memory_order_acquire);
+    if (sequence != dequeuePos + 1) return false;
+
+    out.type = c->data.type;
+    out.stamp = c->data.stamp;
+    out.message = std::move(c->data.message);
+    c->sequence.store(dequeuePos + mask + 1, std::memory_order_release);
+    dequeuePos++;
+    return true;
+}
+
+void log_sink::set_file(const std::string& directory, const std::string& fileName) {
+    {
+        std::lock_guard<std::mutex> lock(fileMutex);
+        filePath = directory + fileName + ".txt";
+        fileBase = directory + fileName;
+    }
+    wakeCondition.notify_one();
+}
+
+bool log_sink::has_file() const {
+    std::lock_guard<std::mutex> lock(fileMutex);
+    return !filePath.empty();
+}
+
+uint64_t log_sink::get_dropped_count() const {
+    return droppedCount.load(std::memory_order_relaxed);
+}
+
+void log_sink::writer_loop() {
+    bool exiting = false;
+    while (!exiting) {
+        {
+            std::unique_lock<std::mutex> lock(fileMutex);
+            wakeCondition.wait_for(lock, std::chrono::milliseconds(LOG_SINK_WRITE_PERIOD_MS));
+            exiting = shouldExit;
+        }
+
+        entry e;
+        char stampBuffer[32];
+        while (try_pop(e)) {
+            /* keep the same line format as the original session log, seconds modulo 10000 */
+            double stamp = e.stamp - (double)((int64_t)e.stamp / 10000 * 10000);
+            snprintf(stampBuffer, sizeof(stampBuffer), "%.4f: ", stamp);
+            pending += stampBuffer;
+            switch (e.type) {
+                case logger::INFO:  pending += "INFO ";  break;
+                case logger::DEBUG: pending += "DEBUG "; break;
+                case logger::WARN:  pending += "WARN ";  break;
+                case logger::ERROR: pending += "ERROR "; break;
+            }
+            pending += e.message;
+            pending += "\n";
+        }
+
+        uint64_t dropped = droppedCount.load(std::memory_order_relaxed);
+        if (dropped != reportedDropped) {
+            pending += "WARN log queue full, " + std::to_string(dropped - reportedDropped) + " log lines dropped\n";
+            reportedDropped = dropped;
+        }
+
+        this->write_pending();
+    }
+
+    if (file != nullptr) {
+        fclose(file);
+        file = nullptr;
+    }
+}
+
+void log_sink::write_pending() {
+    if (file == nullptr) this->open_file();
+
+    if (file == nullptr) {
+        /* no file yet, hold on to the most recent lines only */
+        if (pending.size() > maxFileBytes) {
+            pending.erase(0, pending.size() - maxFileBytes);
+        }
+        return;
+    }
+    if (pending.empty()) return;
+
+    fwrite(pending.data(), 1, pending.size(), file);
+    fflush(file);
+    fileBytes += pending.size();
+    pending.clear();
+
+    if (fileBytes >= maxFileBytes) {
+        this->rotate_file();
+    }
+}
+
+void log_sink::open_file() {
+    {
+        std::lock_guard<std::mutex> lock(fileMutex);
+        openedPath = filePath;
+    }
+    if (openedPath.empty()) return;
+
+    file = fopen(openedPath.c_str(), "w");
+    fileBytes = 0;
+}
+
+void log_sink::rotate_file() {
+    fclose(file);
+    file = nullptr;
+
+    std::string base;
+    {
+        std::lock_guard<std::mutex> lock(fileMutex);
+        base = fileBase;
+    }
+    if (maxRotatedFiles == 0) {
+        remove(openedPath.c_str());
+    } else {
+        for (unsigned int i = maxRotatedFiles; i > 1; i--) {
+            rename((base + "." + std::to_string(i - 1) + ".txt").c_str(), (base + "." + std::to_string(i) + ".txt").c_str());
+        }
+        rename(openedPath.c_str(), (base + ".1.txt").c_str());
+    }
+    this->open_file();
+}
@@ -0,0 +1,106 @@
+#ifndef MULTI_DRONE_PLATFORM_LOG_SINK_H
+#define MULTI_DRONE_PLATFORM_LOG_SINK_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include "logger.h"
+
+/**
+ * An asynchronous, bounded log file writer. Log lines are pushed onto a fixed size lock-free queue and are formatted
+ * and appended to disk by a background thread, so posting a log line never blocks on file IO. If the queue is full
+ * the line is dropped and counted. The log file is rotated once it exceeds a maximum size
+ * (name.txt -> name.1.txt -> name.2.txt ...), keeping a bounded number of old files.
+ */
+class log_sink {
+public:
+    /**
+     * @param queueCapacity the number of log lines that may be waiting to be written, rounded up to a power of two
+     * @param maxFileBytes the size at which the log file is rotated
+     * @param maxRotatedFiles the number of rotated files to keep alongside the current file
+     */
+    log_sink(size_t queueCapacity, size_t maxFileBytes, unsigned int maxRotatedFiles);
+
+    /**
+     * flushes all queued lines and closes the log file
+     */
+    ~log_sink();
+
+    /**
+     * queues a log line to be written, never blocks
+     * @param type the log level
+     * @param stamp the time of the log in seconds
+     * @param message the log message
+     * @return false if the queue was full and the line was dropped
+     */
+    bool post(logger::log_type type, double stamp, std::string message);
+
+    /**
+     * sets the file that log lines are written to. Lines posted before a file is set are held in memory (up to the
+     * maximum file size) and written once it is.
+     * @param directory the directory to log to, including a trailing slash (i.e. the session directory)
+     * @param fileName the base name of the log file ("drone_server")
+     */
+    void set_file(const std::string& directory, const std::string& fileName);
+
+    /**
+     * returns whether a file has been set
+     */
+    bool has_file() const;
+
+    /**
+     * returns the total number of dropped log lines
+     */
+    uint64_t get_dropped_count() const;
+
+private:
+    struct entry {
+        logger::log_type type;
+        double stamp;
+        std::string message;
+    };
+
+    struct cell {
+        std::atomic<size_t> sequence;
+        entry data;
+    };
+
+    bool try_pop(entry& out);
+    void writer_loop();
+    void write_pending();
+    void open_file();
+    void rotate_file();
+
+    /* bounded multi producer queue (Vyukov), popped only by the writer thread */
+    std::unique_ptr<cell[]> cells;
+    size_t mask;
+    std::atomic<size_t> enqueuePos{0};
+    size_t dequeuePos = 0;
+    std::atomic<uint64_t> droppedCount{0};
+
+    const size_t maxFileBytes;
+    const unsigned int maxRotatedFiles;
+
+    /* protects the file path and wakes the writer */
+    mutable std::mutex fileMutex;
+    std::condition_variable wakeCondition;
+    std::string filePath;
+    std::string fileBase;
+    bool shouldExit = false;
+
+    /* only touched by the writer thread */
+    FILE* file = nullptr;
+    std::string openedPath;
+    size_t fileBytes = 0;
+    std::string pending;
+    uint64_t reportedDropped = 0;
+
+    std::thread writer;
+};
+
+#endif //MULTI_DRONE_PLATFORM_LOG_SINK_H
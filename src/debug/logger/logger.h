@@ -1,4 +1,5 @@
 
+#pragma once
 #include <ros/ros.h>
 #include "multi_drone_platform/log.h"
 
@@ -0,0 +1,175 @@
+#include "tracer.h"
+
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <time.h>
+
+std::atomic<bool> tracer::enabled(false);
+
+namespace {
+    /**
+     * single producer (the owning thread), single consumer (the draining thread) ring of trace events
+     */
+    struct thread_ring {
+        std::atomic<uint64_t> head{0};
+        std::atomic<uint64_t> tail{0};
+        std::atomic<uint64_t> dropped{0};
+        uint32_t threadID = 0;
+        std::string threadName;
+        tracer::event events[TRACER_RING_CAPACITY];
+    };
+
+    struct drained_event {
+        tracer::event e;
+        uint32_t threadID;
+    };
+
+    /* rings are kept alive by the registry so that events from exited threads can still be drained */
+    std::mutex registryMutex;
+    std::vector<std::shared_ptr<thread_ring>> registry;
+
+    /* only touched by the draining thread */
+    std::vector<drained_event> drainedEvents;
+    uint64_t drainDropped = 0;
+
+    thread_local thread_ring* localRing = nullptr;
+
+    thread_ring* get_local_ring() {
+        if (localRing == nullptr) {
+            std::shared_ptr<thread_ring> ring(new thread_ring());
+            std::lock_guard<std::mutex> lock(registryMutex);
+            ring->threadID = (uint32_t)registry.size() + 1;
+            ring->threadName = "thread " + std::to_string(ring->threadID);
+            registry.push_back(ring);
+            localRing = ring.get();
+        }
+        return localRing;
+    }
+
+    void write_json_string(std::ofstream& file, const std::string& str) {
+        file << '"';
+        for (char c : str) {
+            if (c == '"' || c == '\\') file << '\\';
+            file << c;
+        }
+        file << '"';
+    }
+}
+
+void tracer::set_enabled(bool shouldEnable) {
+    if (shouldEnable && !is_enabled()) {
+        /* discard anything left over from a previous trace */
+        drain();
+        drainedEvents.clear();
+        drainDropped = 0;
+        std::lock_guard<std::mutex> lock(registryMutex);
+        for (auto& ring : registry) {
+            ring->dropped.store(0, std::memory_order_relaxed);
+        }
+    }
+    enabled.store(shouldEnable, std::memory_order_relaxed);
+}
+
+void tracer::record(const char* name, uint64_t startNs, uint64_t endNs, int64_t id) {
+    thread_ring* ring = get_local_ring();
+    uint64_t head = ring->head.load(std::memory_order_relaxed);
+    uint64_t tail = ring->tail.load(std::memory_order_acquire);
+    if (head - tail >= TRACER_RING_CAPACITY) {
+        ring->dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    event& e = ring->events[head & (TRACER_RING_CAPACITY - 1)];
+    e.name = name;
+    e.startNs = startNs;
+    e.durationNs = (endNs > startNs) ? (endNs - startNs) : 0;
+    e.id = id;
+    ring->head.store(head + 1, std::memory_order_release);
+}
+
+void tracer::set_thread_name(const std::string& name) {
+    thread_ring* ring = get_local_ring();
+    std::lock_guard<std::mutex> lock(registryMutex);
+    ring->threadName = name;
+}
+
+void tracer::drain() {
+    std::vector<std::shared_ptr<thread_ring>> rings;
+    {
+        std::lock_guard<std::mutex> lock(registryMutex);
+        rings = registry;
+    }
+
+    for (auto& ring : rings) {
+        uint64_t tail = ring->tail.load(std::memory_order_relaxed);
+        uint64_t head = ring->head.load(std::memory_order_acquire);
+        for (; tail != head; tail++) {
+            if (drainedEvents.size() >= TRACER_MAX_EVENTS) {
+                drainDropped += head - tail;
+                tail = head;
+                break;
+            }
+            drained_event d;
+            d.e = ring->events[tail & (TRACER_RING_CAPACITY - 1)];
+            d.threadID = ring->threadID;
+            drainedEvents.push_back(d);
+        }
+        ring->tail.store(tail, std::memory_order_release);
+    }
+}
+
+bool tracer::dump(const std::string& path) {
+    drain();
+
+    std::ofstream file(path);
+    if (!file.is_open()) return false;
+
+    file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    bool first = true;
+    {
+        std::lock_guard<std::mutex> lock(registryMutex);
+        for (auto& ring : registry) {
+            if (!first) file << ",\n";
+            first = false;
+            file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << ring->threadID << ",\"args\":{\"name\":";
+            write_json_string(file, ring->threadName);
+            file << "}}";
+        }
+    }
+
+    /* chrome trace timestamps are in microseconds */
+    file.setf(std::ios::fixed);
+    file.precision(3);
+    for (auto& d : drainedEvents) {
+        if (!first) file << ",\n";
+        first = false;
+        file << "{\"name\":\"" << d.e.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << d.threadID
+             << ",\"ts\":" << (double)d.e.startNs * 1e-3 << ",\"dur\":" << (double)d.e.durationNs * 1e-3;
+        if (d.e.id >= 0) {
+            file << ",\"args\":{\"id\":" << d.e.id << "}";
+        }
+        file << "}";
+    }
+    file << "\n]}\n";
+    file.close();
+
+    drainedEvents.clear();
+    return !file.fail();
+}
+
+uint64_t tracer::get_dropped_count() {
+    uint64_t dropped = drainDropped;
+    std::lock_guard<std::mutex> lock(registryMutex);
+    for (auto& ring : registry) {
+        dropped += ring->dropped.load(std::memory_order_relaxed);
+    }
+    return dropped;
+}
+
+uint64_t tracer::now_ns() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t)ts.tv_sec * 1000000000ull) + (uint64_t)ts.tv_nsec;
+}
@@ -0,0 +1,120 @@
+#ifndef MULTI_DRONE_PLATFORM_TRACER_H
+#define MULTI_DRONE_PLATFORM_TRACER_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+/**
+ * number of trace events each thread can buffer between drains, must be a power of two
+ */
+#define TRACER_RING_CAPACITY (1u << 16)
+
+/**
+ * maximum number of drained events held for a single dump, further events are dropped
+ */
+#define TRACER_MAX_EVENTS 2000000
+
+/**
+ * A low overhead timeline tracer. Each thread records scoped events into its own lock-free single producer, single
+ * consumer ring buffer, these rings are drained by one consumer thread (the drone server loop) and dumped as Chrome
+ * trace-event JSON (viewable in chrome://tracing or Perfetto). When tracing is disabled a trace scope costs a single
+ * relaxed atomic load.
+ */
+class tracer {
+public:
+    /**
+     * a single completed scope
+     */
+    struct event {
+        const char* name;
+        uint64_t startNs;
+        uint64_t durationNs;
+        int64_t id;
+    };
+
+    /**
+     * returns whether trace events are currently being recorded
+     */
+    static inline bool is_enabled() {return enabled.load(std::memory_order_relaxed);}
+
+    /**
+     * enables or disables recording. Enabling discards any previously drained events.
+     * Should only be called from the draining thread.
+     * @param shouldEnable the desired state
+     */
+    static void set_enabled(bool shouldEnable);
+
+    /**
+     * records a completed scope to the calling thread's ring, dropping the event if the ring is full
+     * @param name the name of the scope, must be a string with static storage duration (a literal)
+     * @param startNs the start time of the scope from now_ns()
+     * @param endNs the end time of the scope from now_ns()
+     * @param id an optional id shown as an argument on the event (i.e. drone id), negative for none
+     */
+    static void record(const char* name, uint64_t startNs, uint64_t endNs, int64_t id = -1);
+
+    /**
+     * names the calling thread in the exported trace
+     * @param name the thread name
+     */
+    static void set_thread_name(const std::string& name);
+
+    /**
+     * moves all events from the per-thread rings into the drained event list. Only one thread may drain.
+     */
+    static void drain();
+
+    /**
+     * drains and writes all events recorded since tracing was enabled to a Chrome trace-event JSON file, then clears them
+     * @param path the output file path
+     * @return whether the file was written
+     */
+    static bool dump(const std::string& path);
+
+    /**
+     * returns the number of events dropped due to full rings or the event cap since tracing was last enabled
+     */
+    static uint64_t get_dropped_count();
+
+    /**
+     * returns the current time on CLOCK_MONOTONIC in nanoseconds
+     */
+    static uint64_t now_ns();
+
+private:
+    static std::atomic<bool> enabled;
+};
+
+/**
+ * RAII helper recording the lifetime of a scope as a trace event, prefer the MDP_TRACE_SCOPE macros
+ */
+class trace_scope {
+public:
+    explicit trace_scope(const char* name, int64_t id = -1) : name(name), id(id) {
+        startNs = tracer::is_enabled() ? tracer::now_ns() : 0;
+    }
+
+    ~trace_scope() {
+        if (startNs != 0) tracer::record(name, startNs, tracer::now_ns(), id);
+    }
+
+    trace_scope(const trace_scope&) = delete;
+    trace_scope& operator=(const trace_scope&) = delete;
+
+private:
+    const char* name;
+    int64_t id;
+    uint64_t startNs;
+};
+
+#define MDP_TRACE_CONCAT_INNER(a, b) a##b
+#define MDP_TRACE_CONCAT(a, b) MDP_TRACE_CONCAT_INNER(a, b)
+
+/**
+ * traces the enclosing scope under the given name, MDP_TRACE_SCOPE_ID additionally tags the event with an id
+ */
+#define MDP_TRACE_SCOPE(name) trace_scope MDP_TRACE_CONCAT(mdpTraceScope, __LINE__)(name)
+#define MDP_TRACE_SCOPE_ID(name, id) trace_scope MDP_TRACE_CONCAT(mdpTraceScope, __LINE__)(name, (int64_t)(id))
+
+#endif //MULTI_DRONE_PLATFORM_TRACER_H
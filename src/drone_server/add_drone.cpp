@@ -1,7 +1,12 @@
 #include <ros/ros.h>
 #include <boost/algorithm/string/split.hpp>
+#include <yaml-cpp/yaml.h>
+#include <algorithm>
+#include <iomanip>
 #include "wrappers.h"
+#include "shard_layout.h"
 #include "multi_drone_platform/add_drone.h"
+#include "multi_drone_platform/add_drones.h"
 
 #define RESET   "\033[0m"
 #define BOLDRED     "\033[1m\033[31m"      /* Bold Red */
@@ -69,10 +74,108 @@ void do_add_by_prompts(ros::ServiceClient& client) {
     }
 }
 
+/**
+ * reads a drone manifest into a list of declarations. The manifest lists each drone's tag and its wrapper arguments:
+ *
+ * drones:
+ *   - tag: vflie_00
+ *     args: [0.0, 0.0]
+ *   - tag: cflie_E7
+ *     args: [d, d]
+ *     shard: 1
+ *
+ * On a sharded drone server each drone is added to the shard given by its optional 'shard' key, drones without one are
+ * spread over the shards in turn.
+ *
+ * @param path the path to the manifest file
+ * @param pRequests one add drones request per shard, filled with the drones declared for that shard
+ * @return false if the manifest could not be read, after printing the reason
+ */
+bool load_manifest(const std::string& path, std::vector<multi_drone_platform::add_drones>& pRequests) {
+    size_t nextShard = 0;
+    try {
+        YAML::Node manifest = YAML::LoadFile(path);
+        YAML::Node drones = manifest["drones"];
+        if (!drones || !drones.IsSequence()) {
+            print_error("Manifest '" + path + "' has no 'drones' list");
+            return false;
+        }
+        for (const YAML::Node& drone : drones) {
+            multi_drone_platform::drone_declaration declaration;
+            declaration.droneName = drone["tag"].as<std::string>();
+            if (drone["args"]) {
+                for (const YAML::Node& arg : drone["args"]) {
+                    declaration.arguments.push_back(arg.as<std::string>());
+                }
+            }
+
+            std::string dataDesc = mdp_wrappers::get_data_desc(declaration.droneName);
+            size_t expectedArgs = dataDesc.empty() ? 0 : (size_t)std::count(dataDesc.begin(), dataDesc.end(), ',') + 1;
+            if (declaration.arguments.size() < expectedArgs) {
+                print_error("'" + declaration.droneName + "' expects " + std::to_string(expectedArgs) + " arguments ("
+                    + dataDesc + ") but the manifest gives " + std::to_string(declaration.arguments.size()));
+                return false;
+            }
+            size_t shard = nextShard++ % pRequests.size();
+            if (drone["shard"]) {
+                shard = drone["shard"].as<size_t>();
+                if (shard >= pRequests.size()) {
+                    print_error("'" + declaration.droneName + "' is declared for shard " + std::to_string(shard)
+                        + " but the drone server has " + std::to_string(pRequests.size()) + " shards");
+                    return false;
+                }
+            }
+            pRequests[shard].request.drones.push_back(declaration);
+        }
+    } catch (const YAML::Exception& e) {
+        print_error("Unable to read manifest '" + path + "': " + e.what());
+        return false;
+    }
+    return true;
+}
+
+void do_add_by_manifest(const std::string& path, ros::NodeHandle& node) {
+    int shardCount = 1;
+    node.param<int>(SHARD_COUNT_PARAM, shardCount, 1);
+    std::vector<multi_drone_platform::add_drones> requests((size_t)std::max(shardCount, 1));
+    if (!load_manifest(path, requests)) return;
+
+    cout << endl;
+    size_t addedCount = 0, declaredCount = 0;
+    for (size_t shard = 0; shard < requests.size(); shard++) {
+        multi_drone_platform::add_drones& msg = requests[shard];
+        if (msg.request.drones.empty()) continue;
+        declaredCount += msg.request.drones.size();
+
+        ros::ServiceClient client = node.serviceClient<multi_drone_platform::add_drones>(
+                shard_layout::get_topic((uint32_t)shard, "mdp/add_drones_srv"), false);
+        if (!client.call(msg)) {
+            print_error("Failed to contact drone server shard " + std::to_string(shard) + " to make add drones request");
+            continue;
+        }
+
+        for (size_t i = 0; i < msg.request.drones.size(); i++) {
+            const std::string& tag = msg.request.drones[i].droneName;
+            if (msg.response.success[i]) {
+                addedCount++;
+                cout << BOLDGREEN << "Added " << tag << " with id " << msg.response.droneIDs[i] << RESET
+                     << " (init " << std::fixed << std::setprecision(3) << msg.response.initTimes[i] << "s)" << endl;
+            } else {
+                print_error("Failed adding " + tag + ": " + msg.response.reasons[i]);
+            }
+        }
+        cout << "Shard " << shard << " added its drones in " << std::fixed << std::setprecision(3)
+             << msg.response.totalTime << "s" << endl;
+    }
+    cout << "Added " << addedCount << " of " << declaredCount << " drones" << endl;
+}
+
 void print_help() {
     cout << "To add a drone through prompts, run this program with no arguments" << endl;
     cout << "To add a drone through arguments enter one of the following templates with the add drone program being 'add_drone'" << endl;
     cout << "add_drone <drone_tag> <..arguments>. Where drone_tag refers to the name of the drone rigidbody on Optitrack" << endl;
+    cout << "To add many drones at once from a YAML manifest listing each drone's 'tag' and 'args' under 'drones'" << endl;
+    cout << "\tadd_drone --manifest <file.yaml>" << endl;
     for (const auto & it : droneTypeMap) {
         cout << "\tadd_drone " << it.first << "_##";
         std::string dataDesc = mdp_wrappers::get_data_desc(it.first);
@@ -129,6 +232,12 @@ int main(int argc, char** argv)
 
     ros::init(argc, argv, "mdp_add_drone_node");
     ros::NodeHandle node;
+    if (argc > 2 && (strcmp(argv[1], "--manifest") == 0)) {
+        do_add_by_manifest(argv[2], node);
+        cout << endl;
+        return 0;
+    }
+
     ros::ServiceClient client = node.serviceClient<multi_drone_platform::add_drone>("mdp/add_drone_srv", false);
     if (argc == 1) {
         do_add_by_prompts(client);
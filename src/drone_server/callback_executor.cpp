@@ -0,0 +1,135 @@
+#include "callback_executor.h"
+#include "command_trace.h"
+
+#include <algorithm>
+
+void strand_queue::addCallback(const ros::CallbackInterfacePtr& callback, uint64_t removalID) {
+    {
+        std::lock_guard<std::mutex> lock(statsLock);
+        enqueueStamps.push_back(command_trace::now_ns());
+        maxDepth = std::max(maxDepth, enqueueStamps.size());
+    }
+    ros::CallbackQueue::addCallback(callback, removalID);
+
+    callback_executor* current = executor.load(std::memory_order_acquire);
+    if (current != nullptr) {
+        current->schedule(this);
+    }
+}
+
+size_t strand_queue::get_depth() {
+    std::lock_guard<std::mutex> lock(statsLock);
+    return enqueueStamps.size();
+}
+
+void strand_queue::take_period_stats(latency_histogram& pWaitTime, size_t& pMaxDepth) {
+    std::lock_guard<std::mutex> lock(statsLock);
+    pWaitTime = periodWaitTime;
+    pMaxDepth = maxDepth;
+    sessionWaitTime.merge(periodWaitTime);
+    periodWaitTime.reset();
+    maxDepth = enqueueStamps.size();
+}
+
+void strand_queue::get_session_wait_time(latency_histogram& pWaitTime) {
+    std::lock_guard<std::mutex> lock(statsLock);
+    pWaitTime = sessionWaitTime;
+    pWaitTime.merge(periodWaitTime);
+}
+
+bool strand_queue::run() {
+    while (true) {
+        uint64_t start = command_trace::now_ns();
+        ros::CallbackQueue::CallOneResult result = this->callOne(ros::WallDuration());
+
+        std::lock_guard<std::mutex> lock(statsLock);
+        if (result == ros::CallbackQueue::Called) {
+            /* callbacks run in the order they were added, so the oldest stamp belongs to this callback */
+            if (!enqueueStamps.empty()) {
+                uint64_t enqueued = enqueueStamps.front();
+                enqueueStamps.pop_front();
+                periodWaitTime.record((start > enqueued) ? start - enqueued : 0);
+            }
+        } else {
+            /* callbacks removed from the queue (i.e. a subscriber shutting down) leave stamps behind */
+            if (result == ros::CallbackQueue::Empty) enqueueStamps.clear();
+            return result != ros::CallbackQueue::TryAgain;
+        }
+    }
+}
+
+callback_executor::callback_executor(unsigned int workerCount) {
+    if (workerCount == 0) workerCount = std::thread::hardware_concurrency();
+    workerCount = std::max(workerCount, 1u);
+    workers.reserve(workerCount);
+    for (unsigned int i = 0; i < workerCount; i++) {
+        workers.emplace_back(&callback_executor::worker_loop, this);
+    }
+}
+
+callback_executor::~callback_executor() {
+    {
+        std::lock_guard<std::mutex> lock(executorLock);
+        shouldExit = true;
+    }
+    readyCondition.notify_all();
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+void callback_executor::attach(strand_queue* queue) {
+    queue->executor.store(this, std::memory_order_release);
+    if (!queue->isEmpty()) {
+        this->schedule(queue);
+    }
+}
+
+void callback_executor::detach(strand_queue* queue) {
+    std::unique_lock<std::mutex> lock(executorLock);
+    queue->executor.store(nullptr, std::memory_order_release);
+    readyQueues.erase(std::remove(readyQueues.begin(), readyQueues.end(), queue), readyQueues.end());
+    idleCondition.wait(lock, [queue] { return !queue->running; });
+    queue->scheduled = false;
+}
+
+unsigned int callback_executor::get_worker_count() const {
+    return (unsigned int)workers.size();
+}
+
+void callback_executor::schedule(strand_queue* queue) {
+    {
+        std::lock_guard<std::mutex> lock(executorLock);
+        /* already waiting or running, a running queue is rescheduled by its worker if callbacks remain */
+        if (queue->scheduled || queue->executor.load(std::memory_order_relaxed) != this) return;
+        queue->scheduled = true;
+        readyQueues.push_back(queue);
+    }
+    readyCondition.notify_one();
+}
+
+void callback_executor::worker_loop() {
+    std::unique_lock<std::mutex> lock(executorLock);
+    while (true) {
+        readyCondition.wait(lock, [this] { return shouldExit || !readyQueues.empty(); });
+        if (shouldExit) return;
+
+        strand_queue* queue = readyQueues.front();
+        readyQueues.pop_front();
+        queue->running = true;
+
+        lock.unlock();
+        bool canRetry = queue->run();
+        lock.lock();
+
+        queue->running = false;
+        queue->scheduled = false;
+        /* callbacks added while the queue was running did not schedule it again */
+        if (canRetry && queue->executor.load(std::memory_order_relaxed) == this && !queue->isEmpty()) {
+            queue->scheduled = true;
+            readyQueues.push_back(queue);
+            readyCondition.notify_one();
+        }
+        idleCondition.notify_all();
+    }
+}
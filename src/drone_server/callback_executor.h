@@ -0,0 +1,126 @@
+#ifndef MULTI_DRONE_PLATFORM_CALLBACK_EXECUTOR_H
+#define MULTI_DRONE_PLATFORM_CALLBACK_EXECUTOR_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <ros/callback_queue.h>
+#include "latency_histogram.h"
+
+class callback_executor;
+
+/**
+ * A ROS callback queue run as a strand of a callback_executor: whenever callbacks are added the queue is handed to one
+ * of the executor's workers, and no two workers run the same queue at once, so the callbacks of a queue keep their
+ * order without a thread of their own. Records how long callbacks wait in the queue and how deep it gets.
+ */
+class strand_queue : public ros::CallbackQueue {
+public:
+    void addCallback(const ros::CallbackInterfacePtr& callback, uint64_t removalID = 0) override;
+
+    /**
+     * returns the number of callbacks waiting in the queue
+     */
+    size_t get_depth();
+
+    /**
+     * hands over the queue's statistics since the last call
+     * @param pWaitTime the returned histogram of enqueue to start of callback
+     * @param pMaxDepth the returned deepest the queue has been
+     */
+    void take_period_stats(latency_histogram& pWaitTime, size_t& pMaxDepth);
+
+    /**
+     * copies the wait time of every callback run on this queue since it was created
+     * @param pWaitTime the returned histogram of enqueue to start of callback
+     */
+    void get_session_wait_time(latency_histogram& pWaitTime);
+
+    /**
+     * runs the callbacks waiting in the queue on the calling thread, called by the executor's workers and in place of
+     * callAvailable for a queue not attached to an executor
+     * @return false if a callback asked to be tried again later, in which case the queue is not rescheduled
+     */
+    bool run();
+
+private:
+    friend class callback_executor;
+
+    /* the executor running this queue, null while detached (i.e. a lock-step simulation drains it by hand) */
+    std::atomic<callback_executor*> executor{nullptr};
+
+    /* guarded by the executor's lock, scheduled is true from being made ready until its worker has finished */
+    bool scheduled = false;
+    bool running = false;
+
+    /* enqueue time of each waiting callback, oldest first */
+    std::mutex statsLock;
+    std::deque<uint64_t> enqueueStamps;
+    size_t maxDepth = 0;
+    latency_histogram periodWaitTime;
+    latency_histogram sessionWaitTime;
+};
+
+/**
+ * A fixed pool of worker threads running the callbacks of every attached strand_queue, replacing a spinner thread per
+ * queue. Queues are served in the order they became ready.
+ */
+class callback_executor {
+public:
+    /**
+     * creates the executor and starts its workers
+     * @param workerCount the number of worker threads, 0 for one per core
+     */
+    explicit callback_executor(unsigned int workerCount);
+
+    /**
+     * stops and joins all worker threads, every queue must have been detached
+     */
+    ~callback_executor();
+
+    callback_executor(const callback_executor&) = delete;
+    callback_executor& operator=(const callback_executor&) = delete;
+
+    /**
+     * starts running a queue's callbacks on the executor, including any already waiting
+     * @param queue the queue
+     */
+    void attach(strand_queue* queue);
+
+    /**
+     * stops running a queue's callbacks, blocking until none of them is running so that the queue can be destroyed
+     * @param queue the queue
+     */
+    void detach(strand_queue* queue);
+
+    /**
+     * returns the number of worker threads
+     */
+    unsigned int get_worker_count() const;
+
+private:
+    friend class strand_queue;
+
+    /**
+     * makes a queue ready to be run by a worker if it is not already
+     * @param queue the queue
+     */
+    void schedule(strand_queue* queue);
+
+    void worker_loop();
+
+    std::vector<std::thread> workers;
+
+    std::mutex executorLock;
+    std::condition_variable readyCondition;
+    std::condition_variable idleCondition;
+    std::deque<strand_queue*> readyQueues;
+    bool shouldExit = false;
+};
+
+#endif //MULTI_DRONE_PLATFORM_CALLBACK_EXECUTOR_H
@@ -0,0 +1,72 @@
+#ifndef MULTI_DRONE_PLATFORM_COMMAND_TRACE_H
+#define MULTI_DRONE_PLATFORM_COMMAND_TRACE_H
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <time.h>
+
+/**
+ * End-to-end latency tracing of drone commands. Each command sent by the user API carries a unique commandID and the
+ * CLOCK_MONOTONIC time it was sent, the drone server stamps it again on receipt and when it is queued to the rigidbody,
+ * and the rigidbody records the time between each stage (hop) once the command has been handled. Monotonic stamps are
+ * only comparable within a host, so commands also carry the clock_id() of their sender and hops from a sender with
+ * another clock are not recorded.
+ */
+namespace command_trace {
+
+/**
+ * the stages of a command, indexes of the per drone hop histograms
+ */
+enum hop : uint8_t {
+    /* user API publish to drone server receive */
+    TRANSPORT = 0,
+    /* drone server receive to rigidbody queue */
+    SERVER,
+    /* waiting in the rigidbody queue for its spinner */
+    QUEUE,
+    /* static limit adjustment of the command */
+    ADJUST,
+    /* rigidbody command handling including the wrapper's on_* call */
+    HANDLE,
+    /* user API publish to end of handling */
+    TOTAL,
+    HOP_COUNT
+};
+
+inline const char* get_hop_name(uint8_t index) {
+    static const char* names[HOP_COUNT] = {"transport", "server", "queue", "adjust", "handle", "total"};
+    return (index < HOP_COUNT) ? names[index] : "invalid";
+}
+
+/**
+ * returns the current CLOCK_MONOTONIC time in nanoseconds, used for every command stamp
+ */
+inline uint64_t now_ns() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t)ts.tv_sec * 1000000000ull) + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * returns an identifier of the CLOCK_MONOTONIC of this host, a hash of the kernel's boot id which every process (and
+ * container) of a boot shares, or 0 if the boot id can not be read
+ */
+inline uint64_t clock_id() {
+    static const uint64_t id = []() {
+        std::ifstream file("/proc/sys/kernel/random/boot_id");
+        std::string bootID;
+        if (!std::getline(file, bootID) || bootID.empty()) return (uint64_t)0;
+        /* 64 bit FNV-1a */
+        uint64_t hash = 14695981039346656037ull;
+        for (char c : bootID) {
+            hash = (hash ^ (uint8_t)c) * 1099511628211ull;
+        }
+        return (hash != 0) ? hash : (uint64_t)1;
+    }();
+    return id;
+}
+
+}
+
+#endif //MULTI_DRONE_PLATFORM_COMMAND_TRACE_H
@@ -1,198 +1,826 @@
 #include "drone_server.h"
 
 #include <csignal>
+#include <cstring>
+#include <pthread.h>
 #include <utility>
 #include <fstream>
+#include <iomanip>
+#include <algorithm>
+#include <atomic>
+#include <set>
+#include <thread>
 
 #include "multi_drone_platform/api_update.h"
 #include "multi_drone_platform/add_drone.h"
+#include "../collision_management/potential_fields.h"
+#include "../collision_management/static_physical_management.h"
 
 #if POINT_SET_REG
-#   define ICP_IMPL_INIT ,icpImplementation(&this->rigidbodyList, this->node)
+#   define ICP_IMPL_INIT ,icpImplementation(&this->rigidbodies.get_live(), this->node)
 #else
 #   define ICP_IMPL_INIT
 #endif /* POINT_SET_REG */
 
+/**
+ * reads the shard this process runs as, before the slot map is constructed with the shard's first slot
+ * @return the shard index
+ */
+uint32_t read_shard_index() {
+    int shard = 0;
+    ros::param::param<int>(SHARD_INDEX_PARAM, shard, 0);
+    if (shard < 0 || (uint32_t)shard >= MAX_SHARDS) {
+        ROS_ERROR("Shard index %d is out of range, running as shard 0", shard);
+        shard = 0;
+    }
+    return (uint32_t)shard;
+}
+
 drone_server* globalDroneServer = nullptr;
 bool globalShouldShutdown = false;
 bool globalGoodShutDown = true;
 
 
-drone_server::drone_server() : node(), loopRate(LOOP_RATE_HZ) ICP_IMPL_INIT
+drone_server::drone_server() : shardIndex(read_shard_index()),
+    rigidbodies(shard_layout::get_first_slot(shardIndex), 1u << SHARD_SLOT_BITS), node(), loopScheduler(LOOP_RATE_HZ),
+    stateEstimator(shard_layout::get_first_slot(shardIndex)),
+    sessionLog(LOG_QUEUE_CAPACITY, LOG_FILE_MAX_BYTES, LOG_FILE_ROTATIONS) ICP_IMPL_INIT
 {
+    int shards = 1;
+    node.param<int>(SHARD_COUNT_PARAM, shards, 1);
+    shardCount = (uint32_t)std::max(shards, 1);
+    if (shardIndex >= shardCount) {
+        ROS_ERROR("Shard index %u is not below the shard count of %u", shardIndex, shardCount);
+    }
+
+    /* take over ros::Time before anything reads it */
+    node.param<double>(SIM_STEP_PARAM, simStep, 0.0);
+    node.param<double>(SIM_END_TIME_PARAM, simEndTime, 0.0);
+    if (is_lockstep() && is_sharded()) {
+        /* several shards can not each own the clock */
+        ROS_WARN("Ignoring " SIM_STEP_PARAM ", a lock-step simulation needs a single drone server shard");
+        simStep = 0.0;
+    }
+    if (is_lockstep()) {
+        simTime = ros::Time(SIM_START_TIME);
+        ros::Time::setNow(simTime);
+        clockPublisher = node.advertise<rosgraph_msgs::Clock> (CLOCK_TOPIC, 1);
+        /* user programs started from here on follow the simulated clock */
+        node.setParam(USE_SIM_TIME_PARAM, true);
+    }
+
     node.setParam(SHUTDOWN_PARAM, false);
-    inputAPISub = node.subscribe<geometry_msgs::TransformStamped> (SUB_TOPIC, 100, &drone_server::api_callback, this);
-    emergencySub = node.subscribe<std_msgs::Empty> (EMERGENCY_TOPIC, 100, &drone_server::emergency_callback, this);
-    std::string logTopic = NODE_NAME;
-    logTopic += "/log";
-    logPublisher = node.advertise<multi_drone_platform::log> (logTopic, 100);
+    /* the emergency topic is shared by every shard, the remaining topics belong to this shard */
+    inputAPISub = node.subscribe<geometry_msgs::TransformStamped> (shard_layout::get_topic(shardIndex, SUB_TOPIC), 100, &drone_server::api_callback, this);
+    commandAPISub = node.subscribe<multi_drone_platform::api_command> (shard_layout::get_topic(shardIndex, COMMAND_TOPIC), 100, &drone_server::command_callback, this);
+    ros::SubscribeOptions emergencyOptions = ros::SubscribeOptions::create<std_msgs::Empty>(EMERGENCY_TOPIC, 100,
+            boost::bind(&drone_server::emergency_callback, this, _1), ros::VoidPtr(), &emergencyQueue);
+    emergencyOptions.transport_hints = ros::TransportHints().tcpNoDelay();
+    emergencySub = node.subscribe(emergencyOptions);
+    batchAPISub = node.subscribe<multi_drone_platform::api_batch> (shard_layout::get_topic(shardIndex, BATCH_TOPIC), 100, &drone_server::batch_callback, this);
+    batchResultPublisher = node.advertise<multi_drone_platform::api_batch_result> (shard_layout::get_topic(shardIndex, BATCH_RESULT_TOPIC), 100);
+    membershipPublisher = node.advertise<multi_drone_platform::membership_event> (shard_layout::get_topic(shardIndex, MEMBERSHIP_TOPIC), 100, true);
+    logPublisher = node.advertise<multi_drone_platform::log> (shard_layout::get_topic(shardIndex, NODE_NAME "/log"), 100);
+    if (is_sharded()) {
+        shardBoundaries.resize(shardCount);
+        boundaryMsg.shard = shardIndex;
+        boundaryPublisher = node.advertise<multi_drone_platform::shard_boundary> (SHARD_BOUNDARY_TOPIC, shardCount);
+        boundarySubscriber = node.subscribe<multi_drone_platform::shard_boundary> (SHARD_BOUNDARY_TOPIC, shardCount,
+                &drone_server::boundary_callback, this, ros::TransportHints().tcpNoDelay());
+    }
     serverStartTime = ros::Time::now();
-    exportLog = "";
+    this->check_session_log();
 
     this->log(logger::INFO, "Start time: " + std::to_string(ros::Time::now().toSec()));
     this->log(logger::INFO, "Initialising...");
 
-    dataServer = node.advertiseService(SRV_TOPIC, &drone_server::api_get_data_service, this);
-    listServer = node.advertiseService(LIST_SRV_TOPIC, &drone_server::api_list_service, this);
-    addDroneServer = node.advertiseService(ADD_DRONE_TOPIC, &drone_server::add_drone_service, this);
+    if (is_sharded()) {
+        this->log(logger::INFO, "Running as shard " + std::to_string(shardIndex) + " of " + std::to_string(shardCount));
+    }
+
+    dataServer = node.advertiseService(shard_layout::get_topic(shardIndex, SRV_TOPIC), &drone_server::api_get_data_service, this);
+    listServer = node.advertiseService(shard_layout::get_topic(shardIndex, LIST_SRV_TOPIC), &drone_server::api_list_service, this);
+    addDroneServer = node.advertiseService(shard_layout::get_topic(shardIndex, ADD_DRONE_TOPIC), &drone_server::add_drone_service, this);
+    addDronesServer = node.advertiseService(shard_layout::get_topic(shardIndex, ADD_DRONES_TOPIC), &drone_server::add_drones_service, this);
+
+    tracer::set_thread_name("drone server");
+
+    std::string obstaclesFile;
+    node.param<std::string>(OBSTACLES_PARAM, obstaclesFile, "");
+    if (!obstaclesFile.empty()) {
+        std::string error;
+        if (static_physical_management::staticObstacles.load(obstaclesFile, error)) {
+            this->log(logger::INFO, "Loaded " + std::to_string(static_physical_management::staticObstacles.size())
+                    + " static obstacles from '" + obstaclesFile + "'");
+        } else {
+            this->log(logger::WARN, "Unable to load static obstacles from " + error);
+        }
+    }
+
+    std::string avoidance;
+    node.param<std::string>(COLLISION_AVOIDANCE_PARAM, avoidance, "none");
+    if (avoidance == "potential_fields") {
+        avoidanceEngine = rigidbody::POTENTIAL_FIELDS;
+    } else if (avoidance == "orca") {
+        avoidanceEngine = rigidbody::ORCA;
+    } else if (avoidance != "none") {
+        this->log(logger::WARN, "Unknown collision avoidance '" + avoidance + "', drones will not avoid each other");
+    }
+
+    /* the arena's signed distance field is generated offline by generate_sdf, from the same obstacles and boundary */
+    std::string arenaFieldFile;
+    node.param<std::string>(ARENA_SDF_PARAM, arenaFieldFile, "");
+    if (!arenaFieldFile.empty()) {
+        std::string error;
+        if (static_physical_management::arenaField.load(arenaFieldFile, error)) {
+            this->log(logger::INFO, "Mapped the arena's signed distance field from '" + arenaFieldFile + "'");
+        } else {
+            this->log(logger::WARN, "Unable to map the arena's signed distance field, " + error);
+        }
+    }
+
+    stateBoard.reset(state_board::create(shardIndex));
+    if (!stateBoard) {
+        this->log(logger::WARN, "Unable to create the shared memory state board, user programs will fall back to ROS topics");
+    }
+
+    int updateWorkers = 0;
+    node.param<int>(UPDATE_WORKERS_PARAM, updateWorkers, 0);
+    if (is_lockstep()) {
+        this->log(logger::INFO, "Running a lock-step simulation with a step of " + std::to_string(simStep) + "s");
+        if (updateWorkers > 0) {
+            this->log(logger::WARN, "Ignoring " UPDATE_WORKERS_PARAM ", drones are updated serially in a lock-step simulation");
+        }
+    } else if (updateWorkers > 0) {
+        updatePool.reset(new update_pool((unsigned int)updateWorkers));
+        this->log(logger::INFO, "Updating drones in parallel on " + std::to_string(updatePool->get_worker_count()) + " workers");
+    }
+
+    if (!is_lockstep()) {
+        int callbackWorkers = 0;
+        node.param<int>(CALLBACK_WORKERS_PARAM, callbackWorkers, 0);
+        callbackExecutor.reset(new callback_executor((unsigned int)std::max(callbackWorkers, 0)));
+        this->log(logger::INFO, "Running drone callbacks on " + std::to_string(callbackExecutor->get_worker_count()) + " workers");
+    }
+
+    this->start_emergency_thread();
 }
 
 drone_server::~drone_server() {
     this->log(logger::INFO, "Shutting down drone server");
     this->shutdown();
+
+    emergencySub.shutdown();
+    emergencyThreadShouldExit = true;
+    if (emergencyThread.joinable()) emergencyThread.join();
+}
+
+void drone_server::start_emergency_thread() {
+    unsigned int emergencyWorkers = std::min(std::max(std::thread::hardware_concurrency(), 1u), (unsigned int)EMERGENCY_MAX_WORKERS);
+    emergencyPool.reset(new update_pool(emergencyWorkers));
+    emergencyThread = std::thread(&drone_server::emergency_loop, this);
+
+    sched_param param = {};
+    param.sched_priority = EMERGENCY_THREAD_PRIORITY;
+    int error = pthread_setschedparam(emergencyThread.native_handle(), SCHED_FIFO, &param);
+    if (error == 0) {
+        error = emergencyPool->set_scheduling(SCHED_FIFO, EMERGENCY_THREAD_PRIORITY);
+    }
+    if (error != 0) {
+        this->log(logger::WARN, "Unable to raise the emergency threads to real-time priority (" + std::string(strerror(error))
+            + "), emergencies are handled at normal priority. Grant CAP_SYS_NICE or an rtprio limit to bound their latency");
+    }
+}
+
+void drone_server::emergency_loop() {
+    tracer::set_thread_name("emergency");
+    while (!emergencyThreadShouldExit) {
+        emergencyQueue.callAvailable(ros::WallDuration(EMERGENCY_POLL_PERIOD));
+    }
 }
 
 void drone_server::shutdown() {
-    for (size_t i = 0; i < rigidbodyList.size(); i++) {
-        if (rigidbodyList[i] != nullptr) {
-            rigidbodyList[i]->shutdown();
-        }
+    for (auto rigidbody : rigidbodies) {
+        rigidbody->shutdown();
     }
     /* sleep until drones have all landed */
     this->log(logger::INFO, "Waiting for drones to land...");
     bool allLanded = false;
     while (!allLanded) {
         allLanded = true;
+        this->latch_snapshots();
+        this->estimate_states();
+        this->collect_neighbours();
+        this->repel_neighbours();
 
-        for (size_t i = 0; i < rigidbodyList.size(); i++) {
-            if (rigidbodyList[i] != nullptr) {
-                rigidbodyList[i]->update(rigidbodyList);
-                auto rState = rigidbodyList[i]->get_state();
-                if (rState != rigidbody::flight_state::LANDED && rState != rigidbody::flight_state::DELETED && rState != rigidbody::flight_state::UNKNOWN) {
-                    allLanded = false;
-                }
+        for (auto RB : rigidbodies) {
+            RB->update(neighbours);
+            auto rState = RB->get_snapshot().state;
+            if (rState != rigidbody::flight_state::LANDED && rState != rigidbody::flight_state::DELETED && rState != rigidbody::flight_state::UNKNOWN) {
+                allLanded = false;
             }
         }
 
         if (!allLanded) {
-            loopRate.sleep();
+            if (is_lockstep()) {
+                this->advance_sim_clock();
+                this->drain_rigidbody_queues();
+            } else {
+                loopScheduler.sleep();
+            }
         }
     }
 
+    if (isTracing) {
+        tracer::set_enabled(false);
+        isTracing = false;
+        this->dump_trace();
+    }
+
+    this->write_command_latency();
+
     this->log(logger::INFO, "Removing drones...");
-    for (size_t i = 0; i < rigidbodyList.size(); i++) {
-        remove_rigidbody(i);
+    while (!rigidbodies.empty()) {
+        remove_rigidbody(rigidbodies.get_live().back()->get_id());
     }
-    rigidbodyList.clear();
 
-    if (ros::param::has(SESSION_PARAM)) {
-        std::string session = "";
-        ros::param::get(SESSION_PARAM, session);
-        std::ofstream file;
-        std::string fileName = "drone_server.txt";
-        file.open(session + fileName);
-        file << exportLog;
-        file.close();
+    this->check_session_log();
+
+    if (is_lockstep()) {
+        node.deleteParam(USE_SIM_TIME_PARAM);
     }
 }
 
-bool drone_server::add_new_rigidbody(const std::string& pTag, std::vector<std::string> args) {
-    rigidbody* RB;
-    if (mdp_wrappers::create_new_rigidbody(pTag, rigidbodyList.size(), std::move(args), RB)) {
-        /* update drone state on param server */
-
-        /* indicate if the drone is a vflie or not */
-        if (mdp_wrappers::get_drone_type_id(pTag) == droneTypeMap["vflie"]) {
-            RB->isVflie = true;
-        }
+void drone_server::check_session_log() {
+    if (sessionLog.has_file()) return;
 
-        rigidbodyList.push_back(RB);
-        RB->mySpin.start();
+    std::string session = "";
+    if (ros::param::get(SESSION_PARAM, session)) {
+        sessionLog.set_file(session, "drone_server" + shard_layout::get_file_suffix(shardIndex));
+    }
+}
 
-        this->log(logger::DEBUG, "Successfully added '" + pTag + "'");
+bool drone_server::add_new_rigidbody(const std::string& pTag, std::vector<std::string> args, std::string& pReason) {
+    rigidbody* RB;
+    uint32_t droneID;
+    if (!rigidbodies.allocate(droneID)) {
+        pReason = "The drone server has no free drone slots left";
+        this->log(logger::ERROR, "Unable to add '" + pTag + "', all " + std::to_string(1u << SHARD_SLOT_BITS)
+                + " drone slots of the shard are in use");
+        return false;
+    }
+    if (mdp_wrappers::create_new_rigidbody(pTag, droneID, std::move(args), RB)) {
+        RB->publish_physical_params();
+        this->register_rigidbody(pTag, droneID, RB);
         return true;
     } else {
+        rigidbodies.release(droneID);
+        pReason = "Unable to construct '" + pTag + "'";
         this->log(logger::ERROR, "Unable to add '" + pTag + "', check if drone type naming is correct.");
         return false;
     }
 }
 
+void drone_server::register_rigidbody(const std::string& pTag, uint32_t droneID, rigidbody* RB) {
+    /* indicate if the drone is a vflie or not */
+    if (mdp_wrappers::get_drone_type_id(pTag) == droneTypeMap["vflie"]) {
+        RB->isVflie = true;
+    }
+    RB->avoidanceEngine = avoidanceEngine;
+
+    /* replaces the publisher of any previous drone in this slot, whose DELETED event is no longer needed */
+    ros::Publisher& statePublisher = statePublishers[droneID & SLOT_MAP_INDEX_MASK];
+    statePublisher = node.advertise<multi_drone_platform::state_event>(
+            "mdp/drone_" + std::to_string(droneID) + "/state", 1, true);
+    RB->statePublisher = statePublisher;
+    RB->publish_state_event();
+
+    {
+        std::lock_guard<std::mutex> lock(membershipLock);
+        rigidbodies.activate(droneID, RB);
+    }
+    if (is_lockstep()) {
+        /* the drone's queue is drained by the server loop instead */
+        RB->isLockstep = true;
+        if (!RB->isVflie) {
+            this->log(logger::WARN, "'" + pTag + "' is not a vflie, its motion capture will not follow the simulated clock");
+        }
+    } else {
+        callbackExecutor->attach(&RB->myQueue);
+    }
+    this->publish_membership_change(multi_drone_platform::membership_event::ADDED, droneID, RB->get_tag());
+
+    this->log(logger::DEBUG, "Successfully added '" + pTag + "' with id " + std::to_string(droneID));
+}
+
+bool drone_server::check_new_drone_tag(const std::string& pTag, std::string& pReason) {
+    if (mdp_wrappers::get_drone_type_id(pTag) == 0) {
+        pReason = "Drone of type declared by tag '" + pTag + "' does not exist";
+        return false;
+    }
+    for (auto r : this->rigidbodies) {
+        if (r->get_tag() == pTag) {
+            pReason = "Drone with tag '" + pTag + "' already exists on the drone server";
+            return false;
+        }
+    }
+    return true;
+}
+
 void drone_server::remove_rigidbody(unsigned int pDroneID) {
-    /* if pDroneID is a valid index and the object at that location is not null, delete */
-    if (pDroneID < rigidbodyList.size()) {
-        if (rigidbodyList[pDroneID] != nullptr) {
-            
-            this->log(logger::INFO, "Removing '" + rigidbodyList[pDroneID]->get_tag() + "'");
+    /* if pDroneID refers to a live drone, delete it and free its slot */
+    rigidbody* RB;
+    if (rigidbodies.get(pDroneID, RB)) {
+        this->log(logger::INFO, "Removing '" + RB->get_tag() + "'");
 
-            rigidbodyList[pDroneID]->mySpin.stop();
-            delete rigidbodyList[pDroneID];
-            /* and set to null */
-            rigidbodyList[pDroneID] = nullptr;
-            
-            /* update drone state on param server */
-            // @FIX: shoudn't we just remove the parameter?
-            // Node.param.deleteParam?
-            node.deleteParam("mdp/drone_" + std::to_string(pDroneID) + "/state");
+        if (callbackExecutor) callbackExecutor->detach(&RB->myQueue);
+        {
+            std::lock_guard<std::mutex> lock(membershipLock);
+            rigidbodies.remove(pDroneID);
         }
+        {
+            /* once removed the emergency thread can no longer copy the rigidbody, wait for a copy in use to be dropped */
+            std::lock_guard<std::mutex> lock(emergencyLock);
+        }
+
+        /* the latched DELETED event stays on the server's state publisher until the slot is reused */
+        RB->set_state(rigidbody::flight_state::DELETED);
+        std::string tag = RB->get_tag();
+        delete RB;
+        if (stateBoard) stateBoard->clear(pDroneID);
+
+        this->publish_membership_change(multi_drone_platform::membership_event::REMOVED, pDroneID, tag);
     }
 }
 
 bool drone_server::get_rigidbody_from_drone_id(uint32_t pID, rigidbody*& pReturnRigidbody) {
-    if (pID >= rigidbodyList.size()) {
-        this->log(logger::WARN, "Supplied ID is greater than size of rigidbody list: " + 
-        std::to_string(pID) + " >= " + std::to_string(rigidbodyList.size()));
-        return false;
+    if (rigidbodies.get(pID, pReturnRigidbody)) return true;
+
+    if (rigidbodies.is_stale(pID)) {
+        this->log(logger::WARN, "Supplied ID " + std::to_string(pID) + " refers to a drone that has been removed");
+    } else {
+        this->log(logger::WARN, "Supplied ID " + std::to_string(pID) + " does not refer to a drone on the drone server");
+    }
+    return false;
+}
+
+void drone_server::update_rigidbodies() {
+    MDP_TRACE_SCOPE("update_rigidbodies");
+    this->collect_neighbours();
+    uint64_t repulsionStart = command_trace::now_ns();
+    this->repel_neighbours();
+    loopRepulsionNs = command_trace::now_ns() - repulsionStart;
+    if (updatePool) {
+        /* fan the update stage out across the workers, run(..) returns once every drone has been updated */
+        const std::vector<rigidbody*>& live = rigidbodies.get_live();
+        const neighbour_grid& states = neighbours;
+        updatePool->run(live.size(), [&live, &states](size_t i) {
+            MDP_TRACE_SCOPE_ID("rigidbody::update", live[i]->get_id());
+            live[i]->update(states);
+        });
+        return;
+    }
+
+    for (auto rigidbody : rigidbodies) {
+        MDP_TRACE_SCOPE_ID("rigidbody::update", rigidbody->get_id());
+        rigidbody->update(neighbours);
+    }
+}
+
+bool drone_server::is_lockstep() const {
+    return simStep > 0.0;
+}
+
+bool drone_server::is_sharded() const {
+    return shardCount > 1;
+}
+
+void drone_server::latch_snapshots() {
+    MDP_TRACE_SCOPE("latch_snapshots");
+    for (auto RB : rigidbodies) {
+        RB->latch_snapshot();
+    }
+}
+
+void drone_server::estimate_states() {
+    MDP_TRACE_SCOPE("estimate_states");
+    for (auto RB : rigidbodies) {
+        const rigidbody::physical_snapshot& snapshot = RB->get_snapshot();
+        if (snapshot.motionCaptureStamp.isZero()) continue;
+        stateEstimator.stage(RB->get_id(), snapshot.motionCaptureStamp, snapshot.timeOfLastMotionCaptureUpdate,
+                             snapshot.pose.position);
+    }
+    stateEstimator.update();
+
+    ros::Time now = ros::Time::now();
+    kalman_estimate estimate;
+    for (auto RB : rigidbodies) {
+        stateEstimator.get_estimate(RB->get_id(), now, estimate);
+        RB->set_estimate(estimate);
+    }
+}
+
+void drone_server::collect_neighbours() {
+    MDP_TRACE_SCOPE("collect_neighbours");
+    neighbours.clear();
+    ros::Time now = ros::Time::now();
+    for (auto RB : rigidbodies) {
+        neighbour_state state;
+        state.droneID = RB->get_id();
+        const rigidbody::physical_snapshot& snapshot = RB->get_snapshot();
+        const kalman_estimate& estimate = RB->get_loop_estimate();
+        if (estimate.valid) {
+            /* compensate for the time since the frame was captured */
+            geometry_msgs::Vector3 predicted = estimate.predict(now);
+            state.position.x = predicted.x;
+            state.position.y = predicted.y;
+            state.position.z = predicted.z;
+            state.velocity = estimate.velocity;
+        } else {
+            state.position = snapshot.pose.position;
+            state.velocity = snapshot.velocity.linear;
+        }
+        state.restrictedDistance = RB->restrictedDistance;
+        state.influenceDistance = RB->influenceDistance;
+        state.maxVel = RB->maxVel;
+        neighbours.add(state);
+    }
+
+    for (const auto& boundary : shardBoundaries) {
+        if (!boundary || (now - boundary->stamp).toSec() > SHARD_BOUNDARY_TIMEOUT) continue;
+
+        size_t count = boundary->droneIDs.size();
+        if (boundary->positions.size() != count * 3 || boundary->velocities.size() != count * 3
+            || boundary->restrictedDistances.size() != count || boundary->influenceDistances.size() != count) continue;
+
+        for (size_t i = 0; i < count; i++) {
+            neighbour_state state;
+            state.droneID = boundary->droneIDs[i];
+            state.position.x = boundary->positions[i * 3];
+            state.position.y = boundary->positions[i * 3 + 1];
+            state.position.z = boundary->positions[i * 3 + 2];
+            state.velocity.x = boundary->velocities[i * 3];
+            state.velocity.y = boundary->velocities[i * 3 + 1];
+            state.velocity.z = boundary->velocities[i * 3 + 2];
+            state.restrictedDistance = boundary->restrictedDistances[i];
+            state.influenceDistance = boundary->influenceDistances[i];
+            neighbours.add(state);
+        }
+    }
+    neighbours.build();
+}
+
+void drone_server::repel_neighbours() {
+    /* only potential fields use the repulsion, the other engines are spared the kernel and the predicted grid */
+    if (avoidanceEngine != rigidbody::POTENTIAL_FIELDS) return;
+    MDP_TRACE_SCOPE("repel_neighbours");
+    predictedNeighbours.clear();
+    for (neighbour_state state : neighbours.get_states()) {
+        /* every drone is repelled from where it and the others will be a prediction horizon from now */
+        state.position.x += state.velocity.x * PREDICTION_HORIZON;
+        state.position.y += state.velocity.y * PREDICTION_HORIZON;
+        state.position.z += state.velocity.z * PREDICTION_HORIZON;
+        predictedNeighbours.add(state);
+    }
+    predictedNeighbours.build();
+    repulsion.load(predictedNeighbours);
+    compute_repulsion(repulsion, predictedNeighbours, K_P, K_D);
+
+    /* collect_neighbours() added this shard's drones first, in the order they are iterated here */
+    size_t i = 0;
+    for (auto RB : rigidbodies) {
+        geometry_msgs::Vector3 force;
+        force.x = repulsion.forceX[i];
+        force.y = repulsion.forceY[i];
+        force.z = repulsion.forceZ[i];
+        RB->set_repulsion(force, repulsion.closest[i]);
+        i++;
+    }
+}
+
+void drone_server::publish_boundary() {
+    MDP_TRACE_SCOPE("publish_boundary");
+    /* the message is kept between loops so that its arrays are only reallocated when the drone count grows */
+    boundaryMsg.stamp = ros::Time::now();
+    boundaryMsg.droneIDs.clear();
+    boundaryMsg.positions.clear();
+    boundaryMsg.velocities.clear();
+    boundaryMsg.restrictedDistances.clear();
+    boundaryMsg.influenceDistances.clear();
+    for (auto RB : rigidbodies) {
+        const geometry_msgs::Point& position = RB->get_snapshot().pose.position;
+        const geometry_msgs::Vector3& velocity = RB->get_snapshot().velocity.linear;
+        boundaryMsg.droneIDs.push_back(RB->get_id());
+        boundaryMsg.positions.insert(boundaryMsg.positions.end(), {(float)position.x, (float)position.y, (float)position.z});
+        boundaryMsg.velocities.insert(boundaryMsg.velocities.end(), {(float)velocity.x, (float)velocity.y, (float)velocity.z});
+        boundaryMsg.restrictedDistances.push_back((float)RB->restrictedDistance);
+        boundaryMsg.influenceDistances.push_back((float)RB->influenceDistance);
+    }
+    boundaryPublisher.publish(boundaryMsg);
+}
+
+void drone_server::boundary_callback(const multi_drone_platform::shard_boundary::ConstPtr& msg) {
+    if (msg->shard == shardIndex || msg->shard >= shardBoundaries.size()) return;
+    shardBoundaries[msg->shard] = msg;
+}
+
+void drone_server::advance_sim_clock() {
+    simTime += ros::Duration(simStep);
+    ros::Time::setNow(simTime);
+
+    rosgraph_msgs::Clock msg;
+    msg.clock = simTime;
+    clockPublisher.publish(msg);
+}
+
+void drone_server::drain_rigidbody_queues() {
+    MDP_TRACE_SCOPE("drain_rigidbody_queues");
+    for (auto RB : rigidbodies) {
+        RB->myQueue.run();
+    }
+}
+
+void drone_server::publish_state_board() {
+    if (!stateBoard) return;
+    MDP_TRACE_SCOPE("publish_state_board");
+
+    state_board_snapshot snapshot;
+    for (auto RB : rigidbodies) {
+        const rigidbody::physical_snapshot& physical = RB->get_snapshot();
+        snapshot.droneID = RB->numericID;
+        snapshot.state = (uint32_t)physical.state;
+        snapshot.poseStamp = physical.timeOfLastMotionCaptureUpdate.toSec();
+
+        const geometry_msgs::Pose& pose = physical.pose;
+        snapshot.position[0] = pose.position.x;
+        snapshot.position[1] = pose.position.y;
+        snapshot.position[2] = pose.position.z;
+        snapshot.orientation[0] = pose.orientation.x;
+        snapshot.orientation[1] = pose.orientation.y;
+        snapshot.orientation[2] = pose.orientation.z;
+        snapshot.orientation[3] = pose.orientation.w;
+
+        const geometry_msgs::Twist& twist = physical.velocity;
+        snapshot.linearVelocity[0] = twist.linear.x;
+        snapshot.linearVelocity[1] = twist.linear.y;
+        snapshot.linearVelocity[2] = twist.linear.z;
+        snapshot.angularVelocity[0] = twist.angular.x;
+        snapshot.angularVelocity[1] = twist.angular.y;
+        snapshot.angularVelocity[2] = twist.angular.z;
+
+        snapshot.homePosition[0] = physical.homePosition.x;
+        snapshot.homePosition[1] = physical.homePosition.y;
+        snapshot.homePosition[2] = physical.homePosition.z;
+
+        stateBoard->write(snapshot);
+    }
+    stateBoard->advance_tick();
+}
+
+std::string drone_server::get_worker_load_info(double timingPeriod) {
+    std::string workerInfo = "Worker Load-- ";
+    auto loads = updatePool->take_worker_loads();
+    for (size_t i = 0; i < loads.size(); i++) {
+        double busyPercent = (timingPeriod > 0.0) ? (100.0 * loads[i].busyTime / timingPeriod) : 0.0;
+        std::ostringstream streamObj;
+        streamObj << std::fixed << std::setprecision(1) << busyPercent;
+        workerInfo += "W" + std::to_string(i) + " [%]: " + streamObj.str() + " (" + std::to_string(loads[i].updates) + " updates)";
+        if (i + 1 < loads.size()) workerInfo += ", ";
+    }
+    return workerInfo;
+}
+
+std::string format_histogram_ms(const latency_histogram& histogram) {
+    std::ostringstream streamObj;
+    streamObj << std::fixed << std::setprecision(3)
+        << histogram.get_percentile_seconds(50.0) * 1000.0 << "/"
+        << histogram.get_percentile_seconds(99.0) * 1000.0 << "/"
+        << histogram.get_percentile_seconds(99.9) * 1000.0 << "/"
+        << histogram.get_max_seconds() * 1000.0;
+    return streamObj.str();
+}
+
+void drone_server::log_timing_period(uint64_t periodOverruns) {
+    size_t maxDepth = 0;
+    double worstWait = 0.0;
+    std::string maxDepthTag = "none", worstWaitTag = "none";
+    latency_histogram droneWaitTime;
+    for (auto RB : rigidbodies) {
+        {
+            std::lock_guard<std::mutex> lock(RB->timingLock);
+            periodTimings.commandAdjustTime.merge(RB->commandAdjustTime);
+            RB->commandAdjustTime.reset();
+        }
+
+        size_t droneDepth = 0;
+        RB->myQueue.take_period_stats(droneWaitTime, droneDepth);
+        periodTimings.callbackWait.merge(droneWaitTime);
+        if (droneDepth > maxDepth) {
+            maxDepth = droneDepth;
+            maxDepthTag = RB->get_tag();
+        }
+        double droneWait = droneWaitTime.get_percentile_seconds(99.0);
+        if (droneWait > worstWait) {
+            worstWait = droneWait;
+            worstWaitTag = RB->get_tag();
+        }
+    }
+
+    double meanPeriod = periodTimings.loopPeriod.get_mean_seconds();
+    achievedLoopRate = (meanPeriod > 0.0) ? (float)(1.0 / meanPeriod) : 0.0f;
+    waitTime = (float)periodTimings.slack.get_mean_seconds();
+    timeToUpdateDrones = (float)periodTimings.updateTime.get_mean_seconds();
+
+    std::string loopInfo = "Avg. Loop Info-- ";
+    loopInfo += "Actual [Hz]: " + std::to_string(achievedLoopRate) +
+    ", Wait [s]: " + std::to_string(waitTime) + ", Drones [s]: "
+    + std::to_string(timeToUpdateDrones);
+    this->log(logger::INFO, loopInfo);
+
+    std::string jitterInfo = "Loop Jitter p50/p99/p99.9/max [ms]-- ";
+    jitterInfo += "Period: " + format_histogram_ms(periodTimings.loopPeriod) +
+    ", Drones: " + format_histogram_ms(periodTimings.updateTime) +
+    ", Slack: " + format_histogram_ms(periodTimings.slack) +
+    ", Command adjust: " + format_histogram_ms(periodTimings.commandAdjustTime) +
+    ", Avoidance: " + format_histogram_ms(periodTimings.avoidanceTime) +
+    ", Overruns: " + std::to_string(periodOverruns) + " (" + std::to_string(loopScheduler.get_overruns()) + " total)";
+    this->log((periodOverruns > 0) ? logger::WARN : logger::INFO, jitterInfo);
+
+    std::ostringstream callbackInfo;
+    callbackInfo << "Callback Queues-- Wait p50/p99/p99.9/max [ms]: " << format_histogram_ms(periodTimings.callbackWait)
+        << ", Max Depth: " << maxDepth << " (" << maxDepthTag << ")"
+        << ", Worst p99 Wait [ms]: " << std::fixed << std::setprecision(3) << worstWait * 1000.0 << " (" << worstWaitTag << ")";
+    this->log(logger::INFO, callbackInfo.str());
+
+    sessionTimings.loopPeriod.merge(periodTimings.loopPeriod);
+    sessionTimings.updateTime.merge(periodTimings.updateTime);
+    sessionTimings.slack.merge(periodTimings.slack);
+    sessionTimings.commandAdjustTime.merge(periodTimings.commandAdjustTime);
+    sessionTimings.callbackWait.merge(periodTimings.callbackWait);
+    sessionTimings.avoidanceTime.merge(periodTimings.avoidanceTime);
+    periodTimings.loopPeriod.reset();
+    periodTimings.updateTime.reset();
+    periodTimings.slack.reset();
+    periodTimings.commandAdjustTime.reset();
+    periodTimings.callbackWait.reset();
+    periodTimings.avoidanceTime.reset();
+}
+
+void drone_server::update_tracing() {
+    bool shouldTrace = false;
+    node.getParamCached(TRACE_PARAM, shouldTrace);
+    if (shouldTrace != isTracing) {
+        isTracing = shouldTrace;
+        tracer::set_enabled(isTracing);
+        if (isTracing) {
+            this->log(logger::INFO, "Tracing enabled");
+        } else {
+            this->dump_trace();
+        }
+    }
+
+    if (isTracing) {
+        MDP_TRACE_SCOPE("tracer::drain");
+        tracer::drain();
+    }
+}
+
+void drone_server::dump_trace() {
+    std::string session = "";
+    if (!ros::param::get(SESSION_PARAM, session)) {
+        this->log(logger::WARN, "Discarding trace, no session directory set on '" SESSION_PARAM "'");
+        return;
+    }
+
+    std::string fileName = session + "drone_server" + shard_layout::get_file_suffix(shardIndex) + "_trace_"
+        + std::to_string(traceDumpCount++) + ".json";
+    uint64_t dropped = tracer::get_dropped_count();
+    if (tracer::dump(fileName)) {
+        this->log(logger::INFO, "Wrote trace to '" + fileName + "' (" + std::to_string(dropped) + " events dropped)");
+    } else {
+        this->log(logger::ERROR, "Unable to write trace to '" + fileName + "'");
+    }
+}
+
+void drone_server::write_command_latency() {
+    std::string session = "";
+    if (!ros::param::get(SESSION_PARAM, session)) return;
+
+    std::string fileName = session + "command_latency" + shard_layout::get_file_suffix(shardIndex) + ".csv";
+    std::ofstream file(fileName);
+    if (!file) {
+        this->log(logger::ERROR, "Unable to write command latencies to '" + fileName + "'");
+        return;
     }
 
-    pReturnRigidbody = rigidbodyList[pID];
-    return (pReturnRigidbody != nullptr);
+    file << "drone_id,tag,hop,count,p50_ms,p99_ms,p999_ms,max_ms,mean_ms\n";
+    file << std::fixed << std::setprecision(3);
+    auto write_row = [&file](rigidbody* RB, const std::string& hop, const latency_histogram& histogram) {
+        file << RB->get_id() << "," << RB->get_tag() << "," << hop << ","
+            << histogram.get_count() << ","
+            << histogram.get_percentile_seconds(50.0) * 1000.0 << ","
+            << histogram.get_percentile_seconds(99.0) * 1000.0 << ","
+            << histogram.get_percentile_seconds(99.9) * 1000.0 << ","
+            << histogram.get_max_seconds() * 1000.0 << ","
+            << histogram.get_mean_seconds() * 1000.0 << "\n";
+    };
+    latency_histogram callbackWait;
+    for (auto RB : rigidbodies) {
+        {
+            std::lock_guard<std::mutex> lock(RB->timingLock);
+            for (uint8_t hop = 0; hop < command_trace::HOP_COUNT; hop++) {
+                write_row(RB, command_trace::get_hop_name(hop), RB->commandHops[hop]);
+            }
+        }
+        /* time each of the drone's callbacks waited in its queue for a callback executor worker */
+        RB->myQueue.get_session_wait_time(callbackWait);
+        write_row(RB, "callback_wait", callbackWait);
+        {
+            std::lock_guard<std::mutex> lock(RB->timingLock);
+            write_row(RB, "emergency", RB->emergencyLatency);
+        }
+    }
+    this->log(logger::INFO, "Wrote command latencies to '" + fileName + "'");
 }
 
 void drone_server::run() {
-    ros::Time frameStart, frameEnd, rigidbodyStart, rigidbodyEnd, waitTimeStart, waitTimeEnd;
-    int timingPrint = 0;
+    uint64_t frameStart, lastFrameStart = 0, rigidbodyStart, rigidbodyEnd;
+    ros::Time timingPeriodStart = ros::Time::now();
+    uint64_t timingPeriodOverruns = loopScheduler.get_overruns();
     node.getParam(SHUTDOWN_PARAM, globalShouldShutdown);
+    loopScheduler.reset();
     while (!globalShouldShutdown) {
-        frameStart = ros::Time::now();
+        if (is_lockstep()) {
+            this->advance_sim_clock();
+        }
+
+        frameStart = loop_scheduler::now_ns();
+        if (lastFrameStart != 0) {
+            periodTimings.loopPeriod.record(frameStart - lastFrameStart);
+        }
+        lastFrameStart = frameStart;
+
         /* do all the ros callback event stuff */
-        ros::spinOnce();
+        {
+            MDP_TRACE_SCOPE("ros::spinOnce");
+            ros::spinOnce();
+        }
+
+        if (is_lockstep()) {
+            this->drain_rigidbody_queues();
+        }
+        this->latch_snapshots();
+        this->estimate_states();
 
         /* call update on every valid rigidbody */
-        rigidbodyStart = ros::Time::now();
-        for (auto & rigidbody : rigidbodyList) {
-            if (rigidbody == nullptr) continue;
-
-            rigidbody->update(rigidbodyList);
-        }
-        rigidbodyEnd = ros::Time::now();
-        
-        /* wait remainder of looprate */
-        waitTimeStart = ros::Time::now();
-        if (desiredLoopRate > 0.0) {
-            if (!loopRate.sleep()) {
-                // ROS_WARN("Looprate false");
+        rigidbodyStart = loop_scheduler::now_ns();
+        update_rigidbodies();
+        rigidbodyEnd = loop_scheduler::now_ns();
+        periodTimings.updateTime.record(rigidbodyEnd - rigidbodyStart);
+        if (avoidanceEngine != rigidbody::NO_AVOIDANCE) {
+            uint64_t avoidanceNs = loopRepulsionNs;
+            for (auto RB : rigidbodies) {
+                avoidanceNs += RB->loopAvoidanceNs;
             }
+            periodTimings.avoidanceTime.record(avoidanceNs);
         }
-        waitTimeEnd = ros::Time::now();
 
-        frameEnd = ros::Time::now();
+        this->publish_state_board();
+        if (is_sharded()) {
+            this->publish_boundary();
+        }
 
-        /* record timing information */
-        achievedLoopRate += (1.0 / (frameEnd.toSec() - frameStart.toSec()));
-        waitTime += (waitTimeEnd.toSec() - waitTimeStart.toSec());
-        timeToUpdateDrones += (rigidbodyEnd.toSec() - rigidbodyStart.toSec());
+        /* wait until the next deadline, a lock-step simulation runs as fast as it can */
+        if (desiredLoopRate > 0.0 && !is_lockstep()) {
+            int64_t slack = loopScheduler.get_slack_ns();
+            periodTimings.slack.record((slack > 0) ? (uint64_t)slack : 0);
+            MDP_TRACE_SCOPE("sleep");
+            loopScheduler.sleep();
+        }
 
-        // 5 Seconds
-        if (timingPrint >= TIMING_UPDATE*LOOP_RATE_HZ) {
-            float avgLoopRate = achievedLoopRate/timingPrint;
-            float avgWaitTime = waitTime/timingPrint;
-            float avgDroneUpdate = timeToUpdateDrones/timingPrint;
-            timingPrint = 0;
+        /* record timing information every 5 seconds */
+        ros::Time frameEnd = ros::Time::now();
+        if ((frameEnd - timingPeriodStart).toSec() >= TIMING_UPDATE) {
+            this->log_timing_period(loopScheduler.get_overruns() - timingPeriodOverruns);
+            timingPeriodOverruns = loopScheduler.get_overruns();
 
-            std::string loopInfo = "Avg. Loop Info-- ";
-            loopInfo += "Actual [Hz]: " + std::to_string(avgLoopRate) + 
-            ", Wait [s]: " + std::to_string(avgWaitTime) + ", Drones [s]: " 
-            + std::to_string(avgDroneUpdate);
+            if (updatePool) {
+                this->log(logger::INFO, get_worker_load_info(frameEnd.toSec() - timingPeriodStart.toSec()));
+            }
+            this->check_session_log();
+            timingPeriodStart = frameEnd;
+        }
 
-            this->log(logger::INFO, loopInfo);
+        this->update_tracing();
 
-            achievedLoopRate = 0.0f;
-            waitTime = 0.0f;
-            timeToUpdateDrones = 0.0f;
+        if (is_lockstep() && simEndTime > 0.0 && simTime.toSec() >= simEndTime) {
+            this->log(logger::INFO, "Simulation reached its end time of " + std::to_string(simEndTime) + "s");
+            globalShouldShutdown = true;
         }
-        timingPrint++;
+
         if (!globalShouldShutdown) {
-            if (!node.getParam(SHUTDOWN_PARAM, globalShouldShutdown)) {
+            /* cached so that the loop does not make a parameter server round trip every frame */
+            if (!node.getParamCached(SHUTDOWN_PARAM, globalShouldShutdown)) {
                 globalShouldShutdown = true;
             }
         }
@@ -200,18 +828,42 @@ void drone_server::run() {
 }
 
 void drone_server::emergency_callback(const std_msgs::Empty::ConstPtr& msg) {
-    // twice for assurance
-    this->log(logger::ERROR, "EMERGENCY CALLED");
-    for (size_t i = 0; i < rigidbodyList.size(); i++) {
-        if (rigidbodyList[i] != nullptr) {
-            rigidbodyList[i]->emergency();
-        }
+    uint64_t received = command_trace::now_ns();
+    uint64_t slowest = 0;
+    std::string slowestTag = "none";
+    std::lock_guard<std::mutex> emergencyGuard(emergencyLock);
+    std::vector<rigidbody*> live;
+    {
+        /* the wrappers are called outside of the membership lock, so a slow wrapper does not hold up adding drones */
+        std::lock_guard<std::mutex> lock(membershipLock);
+        live = rigidbodies.get_live();
     }
-    for (size_t i = 0; i < rigidbodyList.size(); i++) {
-        if (rigidbodyList[i] != nullptr) {
-            rigidbodyList[i]->emergency();
+    size_t droneCount = live.size();
+
+    /* every drone is reached in parallel, the wrappers' on_emergency no longer waits on their other wrapper calls */
+    std::vector<uint64_t> latencies(droneCount, 0);
+    emergencyPool->run(droneCount, [&live, &latencies, received](size_t i) {
+        live[i]->emergency();
+
+        /* latency from receiving the emergency to the drone's wrapper having handled it */
+        latencies[i] = command_trace::now_ns() - received;
+
+        // twice for assurance
+        live[i]->emergency();
+        std::lock_guard<std::mutex> timingGuard(live[i]->timingLock);
+        live[i]->emergencyLatency.record(latencies[i]);
+    });
+    for (size_t i = 0; i < droneCount; i++) {
+        if (latencies[i] >= slowest) {
+            slowest = latencies[i];
+            slowestTag = live[i]->get_tag();
         }
     }
+
+    std::ostringstream latencyInfo;
+    latencyInfo << std::fixed << std::setprecision(3) << "EMERGENCY CALLED, reached " << droneCount
+        << " drones within " << slowest / 1.0e6 << "ms (slowest '" << slowestTag << "')";
+    this->log(logger::ERROR, latencyInfo.str());
 }
 
 std::array<bool, 2> dencoded_relative(double pEncoded) {
@@ -223,16 +875,16 @@ std::array<bool, 2> dencoded_relative(double pEncoded) {
 }
 
 void drone_server::api_callback(const geometry_msgs::TransformStamped::ConstPtr& input) {
+    /* compatibility shim for clients still sending string commands encoded in a TransformStamped */
+    MDP_TRACE_SCOPE("drone_server::api_callback");
     mdp_translations::input_msg inputMsg((geometry_msgs::TransformStamped*)input.get());
     multi_drone_platform::api_update msg;
 
-
-    rigidbody* RB;
-    if (!get_rigidbody_from_drone_id(inputMsg.drone_id().numeric_id(), RB)) {
+    msg.opcode = api_opcode_from_string(inputMsg.msg_type());
+    if (msg.opcode >= multi_drone_platform::api_update::OPCODE_COUNT) {
+        this->log(logger::WARN, "The API command '" + inputMsg.msg_type() + "' is not a valid command");
         return;
     }
-
-    msg.msgType = inputMsg.msg_type();
     
     msg.posVel.x   = inputMsg.pos_vel().x;
     msg.posVel.y   = inputMsg.pos_vel().y;
@@ -245,8 +897,86 @@ void drone_server::api_callback(const geometry_msgs::TransformStamped::ConstPtr&
     msg.relativeXY = relativeArr[0];
     msg.relativeZ  = relativeArr[1];
 
-    RB->apiPublisher.publish(msg);    
-    // send the message off to the relevant rigidbody
+    this->dispatch_command(inputMsg.drone_id().numeric_id(), msg);
+}
+
+void drone_server::command_callback(const multi_drone_platform::api_command::ConstPtr& input) {
+    MDP_TRACE_SCOPE("drone_server::command_callback");
+    if (input->version != multi_drone_platform::api_command::VERSION) {
+        this->log(logger::WARN, "Rejecting command with protocol version " + std::to_string(input->version)
+        + ", expected " + std::to_string(multi_drone_platform::api_command::VERSION));
+        return;
+    }
+    if (input->command.opcode >= multi_drone_platform::api_update::OPCODE_COUNT) {
+        this->log(logger::WARN, "Rejecting command with invalid opcode " + std::to_string(input->command.opcode));
+        return;
+    }
+
+    multi_drone_platform::api_update command = input->command;
+    command.receivedStamp = command_trace::now_ns();
+    this->dispatch_command(input->droneID, command);
+}
+
+void drone_server::dispatch_command(uint32_t droneID, const multi_drone_platform::api_update& msg) {
+    if (msg.opcode == multi_drone_platform::api_update::DRONE_SERVER_FREQ) {
+        desiredLoopRate = (float)msg.posVel.x;
+        loopScheduler.set_rate(desiredLoopRate);
+        this->log(logger::INFO, "Drone server update frequency set to " + std::to_string(desiredLoopRate) + "Hz");
+        return;
+    }
+
+    /* send the message off to the relevant rigidbody */
+    rigidbody* RB;
+    if (!get_rigidbody_from_drone_id(droneID, RB)) {
+        return;
+    }
+    RB->enqueue_api_update(msg);
+}
+
+void drone_server::batch_callback(const multi_drone_platform::api_batch::ConstPtr& msg) {
+    MDP_TRACE_SCOPE("drone_server::batch_callback");
+    multi_drone_platform::api_batch_result result;
+    result.batchID = msg->batchID;
+
+    if (msg->droneIDs.size() != msg->commands.size()) {
+        this->log(logger::ERROR, "Rejecting command batch " + std::to_string(msg->batchID) + ", "
+        + std::to_string(msg->droneIDs.size()) + " drone ids given for " + std::to_string(msg->commands.size()) + " commands");
+        result.rejected = (uint32_t)msg->commands.size();
+        result.rejectedIDs = msg->droneIDs;
+        batchResultPublisher.publish(result);
+        return;
+    }
+
+    uint64_t received = command_trace::now_ns();
+    for (size_t i = 0; i < msg->commands.size(); i++) {
+        rigidbody* RB;
+        multi_drone_platform::api_update command = msg->commands[i];
+        command.receivedStamp = received;
+        bool accepted = rigidbodies.get(msg->droneIDs[i], RB)
+                && command.opcode < multi_drone_platform::api_update::OPCODE_COUNT
+                && RB->enqueue_api_update(command);
+        if (accepted) {
+            result.accepted++;
+        } else {
+            result.rejected++;
+            result.rejectedIDs.push_back(msg->droneIDs[i]);
+        }
+    }
+
+    if (result.rejected > 0) {
+        this->log(logger::WARN, "Command batch " + std::to_string(msg->batchID) + " rejected "
+        + std::to_string(result.rejected) + " of " + std::to_string(msg->commands.size()) + " commands");
+    }
+    batchResultPublisher.publish(result);
+}
+
+void encode_histogram(const latency_histogram& histogram, geometry_msgs::Pose& pose) {
+    pose.position.x = histogram.get_percentile_seconds(50.0);
+    pose.position.y = histogram.get_percentile_seconds(99.0);
+    pose.position.z = histogram.get_percentile_seconds(99.9);
+    pose.orientation.x = histogram.get_max_seconds();
+    pose.orientation.y = histogram.get_mean_seconds();
+    pose.orientation.z = (double)histogram.get_count();
 }
 
 bool drone_server::api_get_data_service(nav_msgs::GetPlan::Request &pReq, nav_msgs::GetPlan::Response &pRes) {
@@ -254,26 +984,44 @@ bool drone_server::api_get_data_service(nav_msgs::GetPlan::Request &pReq, nav_ms
     mdp_translations::drone_feedback_srv_res res(&pRes);
     this->log(logger::INFO, "Server recieved get data service of type: " + req.msgType());
     
-    rigidbody* RB;
-    if (!get_rigidbody_from_drone_id(req.drone_id().numeric_id(), RB)) return false;
-
-    switch(apiMap[req.msgType()]) {
-        case 7: {   /* GET_HOME */
+    switch(api_opcode_from_string(req.msgType())) {
+        case multi_drone_platform::api_update::GET_HOME: {
         // RB SIDE
-            geometry_msgs::Vector3 Pos = RB->get_home_coordinates();
+            rigidbody* RB;
+            if (!get_rigidbody_from_drone_id(req.drone_id().numeric_id(), RB)) break;
+
+            const geometry_msgs::Vector3& Pos = RB->get_snapshot().homePosition;
             res.vec3().x = Pos.x;
             res.vec3().y = Pos.y;
             res.vec3().z = Pos.z;
             this->log(logger::DEBUG, "Server completed get data service of type: " + req.msgType());
             return true;
         } break;
-        case 10: {  /* TIME */
+        case multi_drone_platform::api_update::LATENCY: {
+        // RB SIDE
+            rigidbody* RB;
+            if (!get_rigidbody_from_drone_id(req.drone_id().numeric_id(), RB)) break;
+
+            std::lock_guard<std::mutex> lock(RB->timingLock);
+            for (uint8_t hop = 0; hop < command_trace::HOP_COUNT; hop++) {
+                encode_histogram(RB->commandHops[hop], res.histogram(hop));
+            }
+            this->log(logger::DEBUG, "Server completed get data service of type: " + req.msgType());
+            return true;
+        } break;
+        case multi_drone_platform::api_update::TIME: {
         // SERVER SIDE
             res.vec3().x = desiredLoopRate;
             res.vec3().y = achievedLoopRate;
             res.vec3().z = motionCaptureUpdateRate;
             res.forward_x() = timeToUpdateDrones;
             res.forward_y() = waitTime;
+            res.overruns() = (double)loopScheduler.get_overruns();
+            encode_histogram(sessionTimings.loopPeriod, res.histogram(mdp_translations::LOOP_PERIOD_HISTOGRAM));
+            encode_histogram(sessionTimings.updateTime, res.histogram(mdp_translations::UPDATE_TIME_HISTOGRAM));
+            encode_histogram(sessionTimings.slack, res.histogram(mdp_translations::SLACK_HISTOGRAM));
+            encode_histogram(sessionTimings.commandAdjustTime, res.histogram(mdp_translations::COMMAND_ADJUST_TIME_HISTOGRAM));
+            encode_histogram(sessionTimings.avoidanceTime, res.histogram(mdp_translations::AVOIDANCE_TIME_HISTOGRAM));
             this->log(logger::DEBUG, "Server completed get data service of type: " + req.msgType());
             return true;
         } break;
@@ -285,63 +1033,124 @@ bool drone_server::api_get_data_service(nav_msgs::GetPlan::Request &pReq, nav_ms
     return false;
 }
 
-bool drone_server::api_list_service(tf2_msgs::FrameGraph::Request &req, tf2_msgs::FrameGraph::Response &res) {
-    /* encoding for the list service is done here without a helper class */
-    /* check API functions documentation for clarity */
-    res.frame_yaml = "";
-    for (size_t i = 0; i < rigidbodyList.size(); i++) {
-        if (rigidbodyList[i] == nullptr) continue;
-        res.frame_yaml += std::to_string(i) + ":" + rigidbodyList[i]->get_tag() + " ";
+bool drone_server::api_list_service(multi_drone_platform::list_drones::Request &req, multi_drone_platform::list_drones::Response &res) {
+    res.version = membershipVersion;
+    res.changed = (req.knownVersion != membershipVersion);
+    if (!res.changed) return true;
+
+    res.droneIDs.reserve(rigidbodies.size());
+    res.tags.reserve(rigidbodies.size());
+    for (auto rigidbody : rigidbodies) {
+        res.droneIDs.push_back(rigidbody->get_id());
+        res.tags.push_back(rigidbody->get_tag());
     }
     return true;
 }
 
+void drone_server::publish_membership_change(uint8_t change, uint32_t droneID, const std::string& tag) {
+    /* skip 0 on wrap around, it is reserved for clients without a cached list */
+    if (++membershipVersion == 0) membershipVersion = 1;
+
+    multi_drone_platform::membership_event msg;
+    msg.version = membershipVersion;
+    msg.change = change;
+    msg.droneID = droneID;
+    msg.tag = tag;
+    membershipPublisher.publish(msg);
+}
+
 bool drone_server::add_drone_service(multi_drone_platform::add_drone::Request &req, multi_drone_platform::add_drone::Response &res) {
-    if (mdp_wrappers::get_drone_type_id(req.droneName) == 0) {
+    if (!this->check_new_drone_tag(req.droneName, res.reason)) {
         res.success = false;
-        res.reason = "Drone of type declared by tag '" + req.droneName + "' does not exist";
         return true;
     }
-    for (auto& r : this->rigidbodyList) {
-        if (r->get_tag() == req.droneName) {
-            res.success = false;
-            res.reason = "Drone with tag '" + req.droneName + "' already exists on the drone server";
-            return true;
+
+    res.success = this->add_new_rigidbody(req.droneName, req.arguments, res.reason);
+    return true;
+}
+
+bool drone_server::add_drones_service(multi_drone_platform::add_drones::Request &req, multi_drone_platform::add_drones::Response &res) {
+    ros::WallTime requestStart = ros::WallTime::now();
+    size_t droneCount = req.drones.size();
+    res.success.assign(droneCount, false);
+    res.reasons.assign(droneCount, "");
+    res.droneIDs.assign(droneCount, 0);
+    res.initTimes.assign(droneCount, 0.0);
+
+    /* ids are reserved on the server thread as the slot map is not thread safe */
+    std::vector<size_t> pending;
+    std::set<std::string> declaredTags;
+    for (size_t i = 0; i < droneCount; i++) {
+        const std::string& tag = req.drones[i].droneName;
+        if (!this->check_new_drone_tag(tag, res.reasons[i])) continue;
+        if (!declaredTags.insert(tag).second) {
+            res.reasons[i] = "Drone with tag '" + tag + "' is declared more than once";
+            continue;
+        }
+        if (!rigidbodies.allocate(res.droneIDs[i])) {
+            res.reasons[i] = "The drone server has no free drone slots left";
+            continue;
         }
+        pending.push_back(i);
     }
 
-    this->add_new_rigidbody(req.droneName, req.arguments);
-    res.success = true;
+    /* wrapper initialisation is dominated by blocking ROS calls (advertising, parameters, driver services), so each
+     * worker thread constructs drones until none are left. Every worker only writes the entries of the drones it took */
+    std::vector<rigidbody*> constructed(droneCount, nullptr);
+    std::atomic<size_t> nextPending{0};
+    auto construct_drones = [&]() {
+        size_t p;
+        while ((p = nextPending.fetch_add(1)) < pending.size()) {
+            size_t i = pending[p];
+            ros::WallTime start = ros::WallTime::now();
+            try {
+                if (mdp_wrappers::create_new_rigidbody(req.drones[i].droneName, res.droneIDs[i], req.drones[i].arguments, constructed[i])) {
+                    constructed[i]->publish_physical_params();
+                } else {
+                    res.reasons[i] = "Unable to construct '" + req.drones[i].droneName + "'";
+                }
+            } catch (const std::exception& e) {
+                constructed[i] = nullptr;
+                res.reasons[i] = "Initialising '" + req.drones[i].droneName + "' failed: " + e.what();
+            }
+            res.initTimes[i] = (ros::WallTime::now() - start).toSec();
+        }
+    };
+
+    size_t workerCount = std::min<size_t>(pending.size(), ADD_DRONES_MAX_WORKERS);
+    std::vector<std::thread> workers;
+    for (size_t w = 0; w < workerCount; w++) {
+        workers.emplace_back(construct_drones);
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+
+    size_t addedCount = 0;
+    for (size_t i : pending) {
+        if (constructed[i] == nullptr) {
+            rigidbodies.release(res.droneIDs[i]);
+            res.droneIDs[i] = 0;
+            this->log(logger::ERROR, res.reasons[i]);
+            continue;
+        }
+        this->register_rigidbody(req.drones[i].droneName, res.droneIDs[i], constructed[i]);
+        res.success[i] = true;
+        addedCount++;
+    }
+
+    res.totalTime = (ros::WallTime::now() - requestStart).toSec();
+    this->log(logger::INFO, "Added " + std::to_string(addedCount) + " of " + std::to_string(droneCount)
+        + " declared drones in " + std::to_string(res.totalTime) + "s on " + std::to_string(workerCount) + " threads");
     return true;
 }
 
 
 void drone_server::log(logger::log_type logType, std::string message) {
-    logger::post_log(logType, "Drone Server", logPublisher, std::move(message));
+    logger::post_log(logType, "Drone Server", logPublisher, message);
 
-    double time = ros::Time::now().toSec();
-    double deci = time - (int)time;
-    time = (int)time % 10000;
-    time += deci;
-    std::ostringstream streamObj;
-    streamObj << std::fixed << std::setprecision(4) << time;
-    std::string level;
-    switch (logType) {
-        case logger::INFO:
-            level = "INFO";
-            break;
-        case logger::DEBUG:
-            level = "DEBUG";
-            break;
-        case logger::WARN:
-            level = "WARN";
-            break;
-        case logger::ERROR:
-            level = "ERROR";
-            break;
-    }
-    std::string newLogLine = streamObj.str() + ": " + level + " " + message + "\n";
-    exportLog += newLogLine;
+    /* formatting and file IO happen on the session log's writer thread */
+    sessionLog.post(logType, ros::Time::now().toSec(), std::move(message));
 }
 
 
@@ -1,12 +1,37 @@
 #include "ros/ros.h"
 #include <vector>
 #include <memory>
+#include <unordered_map>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <ros/callback_queue.h>
 #include <multi_drone_platform/add_drone.h>
+#include <multi_drone_platform/add_drones.h>
+#include <multi_drone_platform/api_batch.h>
+#include <multi_drone_platform/api_batch_result.h>
+#include <multi_drone_platform/api_command.h>
+#include <multi_drone_platform/list_drones.h>
+#include <multi_drone_platform/membership_event.h>
+#include <multi_drone_platform/shard_boundary.h>
+#include <rosgraph_msgs/Clock.h>
 
 #include "rigidbody.h"
 #include "wrappers.h"
 #include "../src/drone_server/drone_server_msg_translations.cpp"
 #include "../icp_implementation/icp_impl.h"
+#include "update_pool.h"
+#include "callback_executor.h"
+#include "rigidbody_slot_map.h"
+#include "state_board.h"
+#include "shard_layout.h"
+#include "../collision_management/neighbour_grid.h"
+#include "../collision_management/repulsion_kernel.h"
+#include "loop_scheduler.h"
+#include "latency_histogram.h"
+#include "kalman_bank.h"
+#include "../debug/tracer/tracer.h"
+#include "../debug/logger/log_sink.h"
 
 #define LOOP_RATE_HZ 100
 #define TIMING_UPDATE 5
@@ -15,20 +40,65 @@
 #define NODE_NAME "mdp_drone_server"
 #define SRV_TOPIC "mdp_data_srv"
 #define LIST_SRV_TOPIC "mdp_list_srv"
+#define MEMBERSHIP_TOPIC "mdp_membership"
 #define SUB_TOPIC "mdp"
+#define COMMAND_TOPIC "mdp_command"
+#define BATCH_TOPIC "mdp_batch"
+#define BATCH_RESULT_TOPIC "mdp_batch_result"
 #define EMERGENCY_TOPIC "mdp_emergency"
 #define SHUTDOWN_PARAM "mdp/should_shut_down"
 #define SESSION_PARAM "/mdp/session_directory"
 #define ADD_DRONE_TOPIC "mdp/add_drone_srv"
+#define ADD_DRONES_TOPIC "mdp/add_drones_srv"
+#define UPDATE_WORKERS_PARAM "mdp/update_workers"
+#define CALLBACK_WORKERS_PARAM "mdp/callback_workers"
+#define TRACE_PARAM "mdp/trace"
+#define SIM_STEP_PARAM "mdp/sim_step"
+#define SIM_END_TIME_PARAM "mdp/sim_end_time"
+#define OBSTACLES_PARAM "mdp/obstacles_file"
+#define ARENA_SDF_PARAM "mdp/arena_sdf_file"
+#define COLLISION_AVOIDANCE_PARAM "mdp/collision_avoidance"
+#define USE_SIM_TIME_PARAM "/use_sim_time"
+#define CLOCK_TOPIC "/clock"
+
+/* simulated time at which a lock-step simulation starts, kept fixed so that every run produces identical timestamps */
+#define SIM_START_TIME 1.0
+
+/* other shards' boundaries older than this (in seconds) are ignored, as their shard has stopped publishing */
+#define SHARD_BOUNDARY_TIMEOUT 0.5
+
+/* upper bound on the threads initialising drone wrappers for a single add_drones request */
+#define ADD_DRONES_MAX_WORKERS 16
+
+/* SCHED_FIFO priority of the emergency thread, above the control loop and every other platform thread */
+#define EMERGENCY_THREAD_PRIORITY 80
+
+/* upper bound on the threads the emergency thread hands the drones' emergencies to */
+#define EMERGENCY_MAX_WORKERS 8
+
+/* how often the emergency thread checks whether it should exit while waiting for an emergency (in seconds) */
+#define EMERGENCY_POLL_PERIOD 0.1
+
+#define LOG_QUEUE_CAPACITY 4096
+#define LOG_FILE_MAX_BYTES (16 * 1024 * 1024)
+#define LOG_FILE_ROTATIONS 4
 
 
 
 class drone_server {
     private:
         /**
-         * A vector containing all the rigidbodies on the drone server
+         * the shard this drone server runs as and the number of shards, read from SHARD_INDEX_PARAM and
+         * SHARD_COUNT_PARAM on startup. See shard_layout.h
+         */
+        uint32_t shardIndex = 0;
+        uint32_t shardCount = 1;
+
+        /**
+         * All the rigidbodies on the drone server, keyed by drone id. Iterating yields only live rigidbodies. The ids
+         * start at the first slot of this server's shard
          */
-        std::vector<rigidbody*> rigidbodyList{};
+        rigidbody_slot_map rigidbodies;
 
         /**
          * The ROS time that the server started
@@ -41,14 +111,45 @@ class drone_server {
         ros::NodeHandle node;
 
         /**
-         * Subscriber to read all incomming drone server and rigidbody API messages from user API programs
+         * Subscribers to read all incomming drone server and rigidbody API messages from user API programs. inputAPISub
+         * receives the legacy TransformStamped encoding, commandAPISub receives versioned api_command messages
          */
         ros::Subscriber inputAPISub;
+        ros::Subscriber commandAPISub;
 
         /**
-         * Subscriber dedicated to receive platform-wide emergency calls
+         * Subscriber for batches of commands from user API programs, and the publisher reporting the result of each batch
          */
+        ros::Subscriber batchAPISub;
+        ros::Publisher batchResultPublisher;
+
+        /**
+         * Subscriber dedicated to receive platform-wide emergency calls. Emergencies are received on their own callback
+         * queue, served by a high priority thread, so that they reach the drones immediately instead of waiting for the
+         * control loop to finish its tick and spin
+         */
+        ros::CallbackQueue emergencyQueue;
         ros::Subscriber emergencySub;
+        std::thread emergencyThread;
+        std::atomic<bool> emergencyThreadShouldExit{false};
+
+        /**
+         * workers at EMERGENCY_THREAD_PRIORITY that the emergency thread fans an emergency out to, so every drone is
+         * reached in parallel rather than one after another
+         */
+        std::unique_ptr<update_pool> emergencyPool;
+
+        /**
+         * guards making drones live and removing them from rigidbodies, so the emergency thread can copy them while the
+         * drone server adds and removes drones
+         */
+        std::mutex membershipLock;
+
+        /**
+         * held by the emergency thread while it calls into the drones it copied, a removed drone is only deleted once
+         * the emergency thread is done with it
+         */
+        std::mutex emergencyLock;
 
         ros::Publisher logPublisher;
 
@@ -58,25 +159,133 @@ class drone_server {
         ros::ServiceServer listServer;
         ros::ServiceServer dataServer;
         ros::ServiceServer addDroneServer;
+        ros::ServiceServer addDronesServer;
 
         /**
-         * the loop rate that the server runs at
+         * latched publisher announcing each drone added or removed, and the membership version it produced. Version 0 is
+         * never used so that clients can use it to mean they have no cached list
          */
-        ros::Rate loopRate;
+        ros::Publisher membershipPublisher;
+        uint32_t membershipVersion = 1;
 
         /**
-         * various time keeping variables
+         * absolute deadline scheduler pacing the server loop at desiredLoopRate
+         */
+        loop_scheduler loopScheduler;
+
+        /**
+         * various time keeping variables, averaged over the last timing period
          */
         float desiredLoopRate = LOOP_RATE_HZ;
-        float achievedLoopRate;
-        float motionCaptureUpdateRate;
-        float timeToUpdateDrones;
-        float waitTime;
+        float achievedLoopRate = 0.0f;
+        float motionCaptureUpdateRate = 0.0f;
+        float timeToUpdateDrones = 0.0f;
+        float waitTime = 0.0f;
+
+        /**
+         * histograms of the loop period, time to update drones, and slack before each deadline
+         */
+        struct loop_timing_histograms {
+            latency_histogram loopPeriod;
+            latency_histogram updateTime;
+            latency_histogram slack;
+            /* time to adjust each command to the static limits, collected from the rigidbodies */
+            latency_histogram commandAdjustTime;
+            /* time drone callbacks waited in their queues, collected from the rigidbodies' queues */
+            latency_histogram callbackWait;
+            /* time spent in collision avoidance each loop, the shared repulsion plus the sum over every drone */
+            latency_histogram avoidanceTime;
+        };
 
         /**
-         * The entire drone server log for the session
+         * the timing histograms of the current timing period, and of the entire session up to the last timing period
          */
-        std::string exportLog;
+        loop_timing_histograms periodTimings;
+        loop_timing_histograms sessionTimings;
+
+        /**
+         * time spent in repel_neighbours() by the last update_rigidbodies(), counted into the loop's avoidance time
+         * alongside the rigidbodies' own avoidance
+         */
+        uint64_t loopRepulsionNs = 0;
+
+        /**
+         * the collision avoidance applied to every drone, read from the COLLISION_AVOIDANCE_PARAM ros param on startup as
+         * "none" (default), "potential_fields" or "orca"
+         */
+        rigidbody::avoidance_engine avoidanceEngine = rigidbody::NO_AVOIDANCE;
+
+        /**
+         * optional worker pool used to update rigidbodies in parallel, null when updating on the main thread.
+         * The number of workers is read from the UPDATE_WORKERS_PARAM ros param on startup (0 for serial update)
+         */
+        std::unique_ptr<update_pool> updatePool;
+
+        /**
+         * shared worker threads running every rigidbody's callback queue, null in a lock-step simulation.
+         * The number of workers is read from the CALLBACK_WORKERS_PARAM ros param on startup (0 for one per core)
+         */
+        std::unique_ptr<callback_executor> callbackExecutor;
+
+        /**
+         * Kalman filters estimating the position, velocity and acceleration of this shard's drones
+         */
+        kalman_bank stateEstimator;
+
+        /**
+         * shared memory table of drone states for user API programs on this host, null if it could not be created
+         */
+        std::unique_ptr<state_board> stateBoard;
+
+        /**
+         * lock-step simulation, enabled when the SIM_STEP_PARAM ros param is above 0 on startup. The drone server then
+         * owns ros::Time, advancing it by simStep every loop without sleeping, and publishes it on CLOCK_TOPIC for
+         * user programs. Rigidbody callback queues are drained on the server thread in drone order instead of on the
+         * callback executor, and drones are updated serially, so that a scenario plays out identically on every run.
+         * The server shuts down once simTime reaches simEndTime (if above 0).
+         */
+        double simStep = 0.0;
+        double simEndTime = 0.0;
+        ros::Time simTime;
+        ros::Publisher clockPublisher;
+
+        /**
+         * boundary exchange between shards: every loop this shard publishes the state of its drones, and keeps the
+         * last boundary received from each other shard (indexed by shard, null until received)
+         */
+        ros::Publisher boundaryPublisher;
+        ros::Subscriber boundarySubscriber;
+        multi_drone_platform::shard_boundary boundaryMsg;
+        std::vector<multi_drone_platform::shard_boundary::ConstPtr> shardBoundaries;
+
+        /**
+         * the state of every drone known to this shard handed to collision avoidance, rebuilt every loop
+         */
+        neighbour_grid neighbours;
+
+        /**
+         * neighbours at their positions a prediction horizon from now, as structure-of-arrays in the bucket order of
+         * predictedNeighbours, and the repulsion between them, recomputed every loop
+         */
+        neighbour_grid predictedNeighbours;
+        repulsion_swarm repulsion;
+
+        /**
+         * latched flight state publishers keyed by drone slot index, see rigidbody::statePublisher
+         */
+        std::unordered_map<uint32_t, ros::Publisher> statePublishers;
+
+        /**
+         * whether the tracer is recording, follows the TRACE_PARAM ros param. Each time tracing is turned off the
+         * recorded timeline is written to the session directory, traceDumpCount numbers these files
+         */
+        bool isTracing = false;
+        unsigned int traceDumpCount = 0;
+
+        /**
+         * asynchronous writer of the drone server log to drone_server.txt in the session directory
+         */
+        log_sink sessionLog;
 
 #if POINT_SET_REG
         icp_impl icpImplementation;
@@ -86,12 +295,29 @@ class drone_server {
          * Adds a rigidbody to the drone server
          * @param pTag the tag to give the new drone (look at other documentation for details, "vflie_00")
          * @param args arguments to pass to the drone wrappers on_init function
+         * @param pReason set to the reason when the drone could not be added
          * @return a boolean if the addition succeeded or not
          */
-        bool add_new_rigidbody(const std::string& pTag, std::vector<std::string> args);
+        bool add_new_rigidbody(const std::string& pTag, std::vector<std::string> args, std::string& pReason);
+
+        /**
+         * makes a constructed rigidbody live: hands it its state publisher, attaches its callback queue and announces it
+         * @param pTag the drone's tag
+         * @param droneID the id reserved for the drone
+         * @param RB the constructed rigidbody, owned by the drone server from here on
+         */
+        void register_rigidbody(const std::string& pTag, uint32_t droneID, rigidbody* RB);
+
+        /**
+         * checks that a tag names a known drone type and is not used by a drone already on the drone server
+         * @param pTag the tag of the drone to add
+         * @param pReason set to the reason the tag was rejected
+         * @return true if a drone with this tag can be added
+         */
+        bool check_new_drone_tag(const std::string& pTag, std::string& pReason);
 
         /**
-         * removes a drone from the drone server
+         * removes a drone from the drone server, the drone's id becomes stale
          * @param pDroneID a reference drone id
          */
         void remove_rigidbody(unsigned int pDroneID);
@@ -111,17 +337,140 @@ class drone_server {
          */
         bool get_rigidbody_from_drone_id(uint32_t pID, rigidbody* &pReturnRigidbody);
 
+        /**
+         * calls update on every valid rigidbody, using the update pool if one exists
+         */
+        void update_rigidbodies();
+
+        /**
+         * returns whether the drone server is running a lock-step simulation
+         */
+        bool is_lockstep() const;
+
+        /**
+         * returns whether the drone server is one of several shards
+         */
+        bool is_sharded() const;
+
+        /**
+         * latches the latest physical snapshot of every rigidbody, so the rest of the loop sees a consistent swarm
+         */
+        void latch_snapshots();
+
+        /**
+         * filters the latched motion capture of every rigidbody and hands each rigidbody its new state estimate
+         */
+        void estimate_states();
+
+        /**
+         * gathers the state of this shard's drones and the drones of other shards into neighbours, and indexes them
+         */
+        void collect_neighbours();
+
+        /**
+         * computes the potential field repulsion between every pair of neighbours at once and hands each of this
+         * shard's rigidbodies its net repulsion, to be called after collect_neighbours(). Does nothing unless the
+         * avoidance engine is potential fields
+         */
+        void repel_neighbours();
+
+        /**
+         * publishes the state of this shard's drones to the other shards
+         */
+        void publish_boundary();
+
+        /**
+         * lock-step simulation only. Advances the simulated time by one step and publishes it
+         */
+        void advance_sim_clock();
+
+        /**
+         * lock-step simulation only. Calls every queued callback (commands, motion capture) of each rigidbody in drone
+         * order on the calling thread
+         */
+        void drain_rigidbody_queues();
+
+        /**
+         * builds a log string describing the load of each update pool worker over the last timing period
+         * @param timingPeriod the wall time over which the worker loads were accumulated in seconds
+         * @return a string representation of the worker loads
+         */
+        std::string get_worker_load_info(double timingPeriod);
+
+        /**
+         * logs the averages and histograms of the timing period, and folds them into the session histograms
+         * @param periodOverruns the number of deadlines missed during this timing period
+         */
+        void log_timing_period(uint64_t periodOverruns);
+
+        /**
+         * hands a command to the drone it is addressed to, or applies it to the drone server for server commands
+         * @param droneID the id of the drone the command is for
+         * @param msg the command
+         */
+        void dispatch_command(uint32_t droneID, const multi_drone_platform::api_update& msg);
+
+        /**
+         * writes the current state of every drone to the shared memory state board
+         */
+        void publish_state_board();
+
+        /**
+         * polls TRACE_PARAM, enabling the tracer or dumping the recorded trace when it changes, and drains the
+         * tracer's per-thread buffers while tracing
+         */
+        void update_tracing();
+
+        /**
+         * writes the recorded trace as Chrome trace-event JSON into the session directory
+         */
+        void dump_trace();
+
+        /**
+         * writes each drone's command hop latencies to command_latency.csv in the session directory
+         */
+        void write_command_latency();
+
+        /**
+         * points the session log at the session directory once SESSION_PARAM has been set
+         */
+        void check_session_log();
+
+        /**
+         * serves the emergency queue until the drone server shuts down, run on emergencyThread
+         */
+        void emergency_loop();
+
+        /**
+         * starts emergencyThread and emergencyPool at EMERGENCY_THREAD_PRIORITY, falling back to the default priority if not permitted
+         */
+        void start_emergency_thread();
+
     public:
         drone_server();
         ~drone_server();
 
         /**
-         * ROS callbacks for API and emergency
+         * ROS callbacks for API and emergency, emergency_callback is called on the emergency thread
          * @param msg the message
          */
         void api_callback(const geometry_msgs::TransformStamped::ConstPtr& msg);
+        void command_callback(const multi_drone_platform::api_command::ConstPtr& msg);
         void emergency_callback(const std_msgs::Empty::ConstPtr& msg);
 
+        /**
+         * ROS callback for the drone states published by other shards
+         * @param msg the boundary of another shard
+         */
+        void boundary_callback(const multi_drone_platform::shard_boundary::ConstPtr& msg);
+
+        /**
+         * ROS callback for a batch of drone commands, dispatches each command directly onto its rigidbody's callback
+         * queue and publishes the number of accepted and rejected commands
+         * @param msg the batch
+         */
+        void batch_callback(const multi_drone_platform::api_batch::ConstPtr& msg);
+
         /**
          * ROS Service server callbacks
          * @param req the request
@@ -129,8 +478,17 @@ class drone_server {
          * @return valid
          */
         bool api_get_data_service(nav_msgs::GetPlan::Request &req, nav_msgs::GetPlan::Response &res);
-        bool api_list_service(tf2_msgs::FrameGraph::Request &req, tf2_msgs::FrameGraph::Response &res);
+        bool api_list_service(multi_drone_platform::list_drones::Request &req, multi_drone_platform::list_drones::Response &res);
         bool add_drone_service(multi_drone_platform::add_drone::Request &req, multi_drone_platform::add_drone::Response &res);
+        bool add_drones_service(multi_drone_platform::add_drones::Request &req, multi_drone_platform::add_drones::Response &res);
+
+        /**
+         * advances the membership version and announces the change to user API programs
+         * @param change multi_drone_platform::membership_event::ADDED or REMOVED
+         * @param droneID the drone that was added or removed
+         * @param tag the drone's tag
+         */
+        void publish_membership_change(uint8_t change, uint32_t droneID, const std::string& tag);
 
         /**
          * main loop of the drone server
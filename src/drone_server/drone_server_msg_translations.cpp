@@ -1,7 +1,6 @@
 
 #include "geometry_msgs/TransformStamped.h"
 #include "nav_msgs/GetPlan.h"
-#include "tf2_msgs/FrameGraph.h"
 
 namespace mdp_translations {
 
@@ -54,6 +53,11 @@ class drone_feedback_srv {
         double& forward_x() {return data->response.plan.poses[0].pose.orientation.x;}
         double& forward_y() {return data->response.plan.poses[0].pose.orientation.y;}
         double& yaw_rate()  {return data->response.plan.poses[0].pose.orientation.z;}
+        double& overruns()  {return data->response.plan.poses[0].pose.orientation.w;}
+
+        /* timing histograms are returned as additional poses after the first, see drone_feedback_srv_res */
+        bool has_histogram(size_t index) {return data->response.plan.poses.size() > index + 1;}
+        geometry_msgs::Pose& histogram(size_t index) {return data->response.plan.poses[index + 1].pose;}
 };
 
 class drone_feedback_srv_req {
@@ -80,6 +84,24 @@ class drone_feedback_srv_res {
         double& forward_x() {return res->plan.poses[0].pose.orientation.x;}
         double& forward_y() {return res->plan.poses[0].pose.orientation.y;}
         double& yaw_rate()  {return res->plan.poses[0].pose.orientation.z;}
+        double& overruns()  {return res->plan.poses[0].pose.orientation.w;}
+
+        /* each histogram is encoded as a pose: position = {p50, p99, p99.9}, orientation = {max, mean, sample count}, times in seconds */
+        geometry_msgs::Pose& histogram(size_t index) {
+            while (res->plan.poses.size() < index + 2) res->plan.poses.push_back({});
+            return res->plan.poses[index + 1].pose;
+        }
+};
+
+/**
+ * indexes of the timing histograms returned by the TIME data service
+ */
+enum timing_histogram_index {
+    LOOP_PERIOD_HISTOGRAM = 0,
+    UPDATE_TIME_HISTOGRAM = 1,
+    SLACK_HISTOGRAM = 2,
+    COMMAND_ADJUST_TIME_HISTOGRAM = 3,
+    AVOIDANCE_TIME_HISTOGRAM = 4
 };
 
 }
\ No newline at end of file
@@ -0,0 +1,202 @@
+#include "kalman_bank.h"
+#include "rigidbody_slot_map.h"
+
+#include <algorithm>
+#include <cmath>
+
+double kalman_estimate::horizon(const ros::Time& time) const {
+    double h = (time - stamp).toSec();
+    double sinceReceived = (time - received).toSec();
+    if (std::abs(h - sinceReceived) > KALMAN_MAX_STEP) {
+        /* the capture stamp is not on the drone server's clock, so only the time since the frame arrived is known */
+        h = sinceReceived;
+    }
+    return std::min(std::max(h, 0.0), (double)KALMAN_MAX_STEP);
+}
+
+geometry_msgs::Vector3 kalman_estimate::predict(const ros::Time& time) const {
+    double h = this->horizon(time);
+    geometry_msgs::Vector3 predicted;
+    predicted.x = position.x + velocity.x * h + 0.5 * acceleration.x * h * h;
+    predicted.y = position.y + velocity.y * h + 0.5 * acceleration.y * h * h;
+    predicted.z = position.z + velocity.z * h + 0.5 * acceleration.z * h * h;
+    return predicted;
+}
+
+geometry_msgs::Vector3 kalman_estimate::predict_variance(const ros::Time& time) const {
+    double h = this->horizon(time);
+    double h2 = 0.5 * h * h;
+    std::array<double, 3> variance;
+    for (size_t axis = 0; axis < 3; axis++) {
+        /* J P J^T for J = [1, h, h^2 / 2] */
+        const std::array<double, COVARIANCE_TERM_COUNT>& P = covariance[axis];
+        variance[axis] = P[PP] + 2.0 * h * P[PV] + 2.0 * h2 * P[PA] + h * h * P[VV] + 2.0 * h * h2 * P[VA] + h2 * h2 * P[AA];
+    }
+    geometry_msgs::Vector3 ret;
+    ret.x = variance[0];
+    ret.y = variance[1];
+    ret.z = variance[2];
+    return ret;
+}
+
+kalman_bank::kalman_bank(uint32_t firstSlot): firstSlot(firstSlot) {}
+
+size_t kalman_bank::get_lane(uint32_t droneID) {
+    size_t lane = (droneID & SLOT_MAP_INDEX_MASK) - firstSlot;
+    if (lane >= laneIDs.size()) {
+        size_t laneCount = lane + 1;
+        for (auto& axis : axes) {
+            axis.position.resize(laneCount, 0.0);
+            axis.velocity.resize(laneCount, 0.0);
+            axis.acceleration.resize(laneCount, 0.0);
+            for (auto& term : axis.covariance) {
+                term.resize(laneCount, 0.0);
+            }
+            axis.measurement.resize(laneCount, 0.0);
+        }
+        laneIDs.resize(laneCount, 0);
+        tracked.resize(laneCount, 0);
+        stamps.resize(laneCount);
+        receivedStamps.resize(laneCount);
+        steps.resize(laneCount, 0.0);
+        measurementStamps.resize(laneCount);
+        measurementReceived.resize(laneCount);
+    }
+    return lane;
+}
+
+void kalman_bank::reset_lane(size_t lane) {
+    for (auto& axis : axes) {
+        axis.position[lane] = axis.measurement[lane];
+        axis.velocity[lane] = 0.0;
+        axis.acceleration[lane] = 0.0;
+        for (auto& term : axis.covariance) {
+            term[lane] = 0.0;
+        }
+        axis.covariance[kalman_estimate::PP][lane] = KALMAN_POSITION_VARIANCE;
+        axis.covariance[kalman_estimate::VV][lane] = KALMAN_INITIAL_VELOCITY_VARIANCE;
+        axis.covariance[kalman_estimate::AA][lane] = KALMAN_INITIAL_ACCELERATION_VARIANCE;
+    }
+    tracked[lane] = 1;
+    stamps[lane] = measurementStamps[lane];
+    receivedStamps[lane] = measurementReceived[lane];
+    steps[lane] = 0.0;
+}
+
+void kalman_bank::stage(uint32_t droneID, const ros::Time& stamp, const ros::Time& received,
+                        const geometry_msgs::Point& position) {
+    if ((droneID & SLOT_MAP_INDEX_MASK) < firstSlot) return;
+    size_t lane = get_lane(droneID);
+    if (laneIDs[lane] != droneID) {
+        laneIDs[lane] = droneID;
+        tracked[lane] = 0;
+    }
+    if (tracked[lane] && stamp <= stamps[lane]) return;
+
+    axes[0].measurement[lane] = position.x;
+    axes[1].measurement[lane] = position.y;
+    axes[2].measurement[lane] = position.z;
+    measurementStamps[lane] = stamp;
+    measurementReceived[lane] = received;
+
+    double step = tracked[lane] ? (stamp - stamps[lane]).toSec() : 0.0;
+    if (!tracked[lane] || step > KALMAN_MAX_STEP) {
+        this->reset_lane(lane);
+    } else {
+        steps[lane] = step;
+    }
+}
+
+void kalman_bank::update() {
+    using P = kalman_estimate;
+    size_t laneCount = laneIDs.size();
+    for (auto& axis : axes) {
+        double* p = axis.position.data();
+        double* v = axis.velocity.data();
+        double* a = axis.acceleration.data();
+        double* pp = axis.covariance[P::PP].data();
+        double* pv = axis.covariance[P::PV].data();
+        double* pa = axis.covariance[P::PA].data();
+        double* vv = axis.covariance[P::VV].data();
+        double* va = axis.covariance[P::VA].data();
+        double* aa = axis.covariance[P::AA].data();
+        const double* z = axis.measurement.data();
+        const double* step = steps.data();
+
+        for (size_t i = 0; i < laneCount; i++) {
+            double h = step[i];
+            if (h <= 0.0) continue;
+            double h2 = 0.5 * h * h;
+
+            /* predict, x = F x and P = F P F^T + Q for F = [1 h h^2/2; 0 1 h; 0 0 1] */
+            double predP = p[i] + h * v[i] + h2 * a[i];
+            double predV = v[i] + h * a[i];
+            double predA = a[i];
+
+            double r00 = pp[i] + h * pv[i] + h2 * pa[i];
+            double r01 = pv[i] + h * vv[i] + h2 * va[i];
+            double r02 = pa[i] + h * va[i] + h2 * aa[i];
+            double r11 = vv[i] + h * va[i];
+            double r12 = va[i] + h * aa[i];
+
+            double q = KALMAN_JERK_DENSITY;
+            double n00 = r00 + h * r01 + h2 * r02 + q * h * h * h * h * h / 20.0;
+            double n01 = r01 + h * r02 + q * h * h * h * h / 8.0;
+            double n02 = r02 + q * h * h * h / 6.0;
+            double n11 = r11 + h * r12 + q * h * h * h / 3.0;
+            double n12 = r12 + q * h * h / 2.0;
+            double n22 = aa[i] + q * h;
+
+            /* correct with the measured position, H = [1 0 0] */
+            double s = n00 + KALMAN_POSITION_VARIANCE;
+            double k0 = n00 / s;
+            double k1 = n01 / s;
+            double k2 = n02 / s;
+            double innovation = z[i] - predP;
+
+            p[i] = predP + k0 * innovation;
+            v[i] = predV + k1 * innovation;
+            a[i] = predA + k2 * innovation;
+
+            pp[i] = n00 - k0 * n00;
+            pv[i] = n01 - k0 * n01;
+            pa[i] = n02 - k0 * n02;
+            vv[i] = n11 - k1 * n01;
+            va[i] = n12 - k1 * n02;
+            aa[i] = n22 - k2 * n02;
+        }
+    }
+
+    for (size_t i = 0; i < laneCount; i++) {
+        if (steps[i] <= 0.0) continue;
+        stamps[i] = measurementStamps[i];
+        receivedStamps[i] = measurementReceived[i];
+        steps[i] = 0.0;
+    }
+}
+
+void kalman_bank::get_estimate(uint32_t droneID, const ros::Time& now, kalman_estimate& pEstimate) const {
+    size_t lane = (droneID & SLOT_MAP_INDEX_MASK) - firstSlot;
+    pEstimate.valid = (droneID & SLOT_MAP_INDEX_MASK) >= firstSlot && lane < laneIDs.size()
+        && laneIDs[lane] == droneID && tracked[lane];
+    /* a drone lost by motion capture falls back to its last measured pose rather than drifting with its estimate */
+    if (pEstimate.valid && (now - receivedStamps[lane]).toSec() > KALMAN_MAX_STEP) pEstimate.valid = false;
+    if (!pEstimate.valid) return;
+
+    pEstimate.stamp = stamps[lane];
+    pEstimate.received = receivedStamps[lane];
+    pEstimate.position.x = axes[0].position[lane];
+    pEstimate.position.y = axes[1].position[lane];
+    pEstimate.position.z = axes[2].position[lane];
+    pEstimate.velocity.x = axes[0].velocity[lane];
+    pEstimate.velocity.y = axes[1].velocity[lane];
+    pEstimate.velocity.z = axes[2].velocity[lane];
+    pEstimate.acceleration.x = axes[0].acceleration[lane];
+    pEstimate.acceleration.y = axes[1].acceleration[lane];
+    pEstimate.acceleration.z = axes[2].acceleration[lane];
+    for (size_t axis = 0; axis < 3; axis++) {
+        for (size_t term = 0; term < kalman_estimate::COVARIANCE_TERM_COUNT; term++) {
+            pEstimate.covariance[axis][term] = axes[axis].covariance[term][lane];
+        }
+    }
+}
@@ -0,0 +1,157 @@
+#ifndef MULTI_DRONE_PLATFORM_KALMAN_BANK_H
+#define MULTI_DRONE_PLATFORM_KALMAN_BANK_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "ros/time.h"
+#include "geometry_msgs/Point.h"
+#include "geometry_msgs/Vector3.h"
+
+/**
+ * spectral density of the white jerk driving the constant acceleration model (m^2/s^5), how quickly the filter lets
+ * a drone's acceleration change
+ */
+#define KALMAN_JERK_DENSITY 5.0
+
+/**
+ * variance of a motion capture position measurement (m^2), ~1mm standard deviation
+ */
+#define KALMAN_POSITION_VARIANCE 1.0e-6
+
+/**
+ * initial variance of the velocity (m^2/s^2) and acceleration (m^2/s^4) of a newly tracked drone
+ */
+#define KALMAN_INITIAL_VELOCITY_VARIANCE 1.0
+#define KALMAN_INITIAL_ACCELERATION_VARIANCE 10.0
+
+/**
+ * a drone whose motion capture pauses for longer than this (in seconds) is tracked again from its next frame, and its
+ * estimate is invalid until then. Predictions never extrapolate further than this
+ */
+#define KALMAN_MAX_STEP 0.5
+
+/**
+ * the estimated state of a drone, each axis is filtered independently
+ */
+struct kalman_estimate {
+    /**
+     * the order of the unique terms of the symmetric position, velocity, acceleration covariance of an axis
+     */
+    enum covariance_term {
+        PP, PV, PA, VV, VA, AA, COVARIANCE_TERM_COUNT
+    };
+
+    /* false until the drone's first motion capture frame has been filtered */
+    bool valid = false;
+    /* the time of the last filtered motion capture frame */
+    ros::Time stamp;
+    /* the time the drone server received the last filtered frame, on the drone server's clock */
+    ros::Time received;
+
+    geometry_msgs::Vector3 position;
+    geometry_msgs::Vector3 velocity;
+    geometry_msgs::Vector3 acceleration;
+    std::array<std::array<double, COVARIANCE_TERM_COUNT>, 3> covariance;
+
+    /**
+     * extrapolates the position of the drone under constant acceleration, compensating for the age of the estimate
+     * @param time the time to predict the position at, on the drone server's clock
+     * @return the predicted position
+     */
+    geometry_msgs::Vector3 predict(const ros::Time& time) const;
+
+    /**
+     * returns the variance of each axis of the position predicted for a time
+     * @param time the time to predict the position at, on the drone server's clock
+     */
+    geometry_msgs::Vector3 predict_variance(const ros::Time& time) const;
+
+    /**
+     * returns how far (in seconds) to extrapolate the estimate to a time, between 0 and KALMAN_MAX_STEP. The age is
+     * taken from the capture stamp unless it disagrees with the time the frame was received by more than
+     * KALMAN_MAX_STEP, i.e. the motion capture system stamps its frames on a clock of its own
+     * @param time the time to predict at, on the drone server's clock
+     */
+    double horizon(const ros::Time& time) const;
+};
+
+/**
+ * A bank of constant acceleration Kalman filters, one per drone of a drone server, estimating the position, velocity
+ * and acceleration of each drone from its motion capture positions. The state and covariance of every filter are stored
+ * as structure-of-arrays (one array per term and axis, indexed by lane) so that the filters are stepped together in
+ * plain loops over contiguous arrays once every drone server loop.
+ *
+ * Each drone is given the lane of its slot, a drone new to a lane (i.e. a reused slot) is tracked from scratch.
+ */
+class kalman_bank {
+public:
+    /**
+     * @param firstSlot the slot index of the first drone slot, drones of lower slots are never given a lane
+     */
+    explicit kalman_bank(uint32_t firstSlot = 0);
+
+    /**
+     * queues a motion capture frame to be filtered by the next call to update(), replacing any frame already queued
+     * for the drone. Frames no newer than the last filtered frame are ignored
+     * @param droneID the drone's id
+     * @param stamp the time the frame was captured
+     * @param received the time the drone server received the frame
+     * @param position the measured position of the drone
+     */
+    void stage(uint32_t droneID, const ros::Time& stamp, const ros::Time& received, const geometry_msgs::Point& position);
+
+    /**
+     * predicts every filter with a queued frame to the frame's time and corrects it with the frame
+     */
+    void update();
+
+    /**
+     * returns the estimated state of a drone
+     * @param droneID the drone's id
+     * @param now the current time on the drone server's clock
+     * @param pEstimate the returned estimate, invalid if no frame of the drone has been filtered or the last was
+     * received more than KALMAN_MAX_STEP ago
+     */
+    void get_estimate(uint32_t droneID, const ros::Time& now, kalman_estimate& pEstimate) const;
+
+private:
+    /**
+     * returns the lane of a drone, growing the bank to hold it
+     */
+    size_t get_lane(uint32_t droneID);
+
+    /**
+     * starts tracking a lane from the position of its queued frame
+     */
+    void reset_lane(size_t lane);
+
+    /**
+     * the filter state of one axis of every lane
+     */
+    struct axis_lanes {
+        std::vector<double> position;
+        std::vector<double> velocity;
+        std::vector<double> acceleration;
+        std::array<std::vector<double>, kalman_estimate::COVARIANCE_TERM_COUNT> covariance;
+        std::vector<double> measurement;
+    };
+    std::array<axis_lanes, 3> axes;
+
+    /* per lane, the id of the drone tracked, whether it is being tracked, and the capture and receive times of its
+     * last filtered frame */
+    std::vector<uint32_t> laneIDs;
+    std::vector<uint8_t> tracked;
+    std::vector<ros::Time> stamps;
+    std::vector<ros::Time> receivedStamps;
+
+    /* per lane, the time since the last filtered frame of the queued frame, 0 for lanes without a frame */
+    std::vector<double> steps;
+    std::vector<ros::Time> measurementStamps;
+    std::vector<ros::Time> measurementReceived;
+
+    uint32_t firstSlot;
+};
+
+#endif //MULTI_DRONE_PLATFORM_KALMAN_BANK_H
@@ -0,0 +1,111 @@
+#include "latency_histogram.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+constexpr uint32_t latency_histogram::subBucketCount;
+constexpr uint32_t latency_histogram::bucketCount;
+
+latency_histogram::latency_histogram() {
+    this->reset();
+}
+
+uint32_t latency_histogram::get_bucket_index(uint64_t valueNs) {
+    const uint64_t maxRecordable = (1ull << LATENCY_HISTOGRAM_MAX_BITS) - 1;
+    valueNs = std::min(valueNs, maxRecordable);
+    if (valueNs < subBucketCount) {
+        return (uint32_t)valueNs;
+    }
+
+    /* the most significant bit picks the power of two, the next SUB_BITS bits pick the linear sub bucket */
+    uint32_t msb = 63u - (uint32_t)__builtin_clzll(valueNs);
+    uint32_t shift = msb - LATENCY_HISTOGRAM_SUB_BITS + 1;
+    uint32_t subIndex = (uint32_t)(valueNs >> shift) - (subBucketCount / 2);
+    return (shift * (subBucketCount / 2)) + (subBucketCount / 2) + subIndex;
+}
+
+uint64_t latency_histogram::get_bucket_value(uint32_t index) {
+    if (index < subBucketCount) {
+        return index;
+    }
+    uint32_t shift = (index / (subBucketCount / 2)) - 1;
+    uint64_t subIndex = (index % (subBucketCount / 2)) + (subBucketCount / 2);
+    /* report the upper edge of the bucket so that percentiles are never under-reported */
+    return ((subIndex + 1) << shift) - 1;
+}
+
+void latency_histogram::record(uint64_t valueNs) {
+    counts[get_bucket_index(valueNs)]++;
+    totalCount++;
+    minValue = std::min(minValue, valueNs);
+    maxValue = std::max(maxValue, valueNs);
+    sum += (double)valueNs;
+}
+
+void latency_histogram::record_seconds(double seconds) {
+    if (!(seconds > 0.0)) seconds = 0.0;
+    this->record((uint64_t)(seconds * 1e9));
+}
+
+void latency_histogram::merge(const latency_histogram& other) {
+    for (uint32_t i = 0; i < bucketCount; i++) {
+        counts[i] += other.counts[i];
+    }
+    totalCount += other.totalCount;
+    minValue = std::min(minValue, other.minValue);
+    maxValue = std::max(maxValue, other.maxValue);
+    sum += other.sum;
+}
+
+void latency_histogram::reset() {
+    counts.fill(0);
+    totalCount = 0;
+    minValue = std::numeric_limits<uint64_t>::max();
+    maxValue = 0;
+    sum = 0.0;
+}
+
+uint64_t latency_histogram::get_percentile(double percentile) const {
+    if (totalCount == 0) return 0;
+    percentile = std::min(std::max(percentile, 0.0), 100.0);
+    uint64_t target = (uint64_t)std::ceil((percentile / 100.0) * (double)totalCount);
+    target = std::max(target, (uint64_t)1);
+
+    uint64_t seen = 0;
+    for (uint32_t i = 0; i < bucketCount; i++) {
+        seen += counts[i];
+        if (seen >= target) {
+            return std::min(get_bucket_value(i), maxValue);
+        }
+    }
+    return maxValue;
+}
+
+double latency_histogram::get_percentile_seconds(double percentile) const {
+    return (double)get_percentile(percentile) * 1e-9;
+}
+
+uint64_t latency_histogram::get_max() const {
+    return maxValue;
+}
+
+uint64_t latency_histogram::get_min() const {
+    return (totalCount == 0) ? 0 : minValue;
+}
+
+uint64_t latency_histogram::get_count() const {
+    return totalCount;
+}
+
+double latency_histogram::get_mean() const {
+    return (totalCount == 0) ? 0.0 : (sum / (double)totalCount);
+}
+
+double latency_histogram::get_max_seconds() const {
+    return (double)maxValue * 1e-9;
+}
+
+double latency_histogram::get_mean_seconds() const {
+    return get_mean() * 1e-9;
+}
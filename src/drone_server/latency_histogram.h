@@ -0,0 +1,86 @@
+#ifndef MULTI_DRONE_PLATFORM_LATENCY_HISTOGRAM_H
+#define MULTI_DRONE_PLATFORM_LATENCY_HISTOGRAM_H
+
+#include <array>
+#include <cstdint>
+
+/**
+ * number of bits of precision kept for each power of two, 5 bits gives a worst case relative error of ~3%
+ */
+#define LATENCY_HISTOGRAM_SUB_BITS 5
+
+/**
+ * the largest power of two recordable by the histogram in nanoseconds, larger values are clamped (2^36ns = ~68s)
+ */
+#define LATENCY_HISTOGRAM_MAX_BITS 36
+
+/**
+ * A fixed size, log-linear (HDR style) histogram of durations in nanoseconds. Recording is O(1) and never allocates,
+ * making it suitable for use inside the drone server loop. Percentiles are reported to within the precision of
+ * LATENCY_HISTOGRAM_SUB_BITS.
+ */
+class latency_histogram {
+public:
+    latency_histogram();
+
+    /**
+     * records a duration
+     * @param valueNs the duration in nanoseconds
+     */
+    void record(uint64_t valueNs);
+
+    /**
+     * records a duration
+     * @param seconds the duration in seconds, negative durations are recorded as zero
+     */
+    void record_seconds(double seconds);
+
+    /**
+     * adds all values recorded by another histogram to this histogram
+     * @param other the histogram to merge in
+     */
+    void merge(const latency_histogram& other);
+
+    /**
+     * clears all recorded values
+     */
+    void reset();
+
+    /**
+     * returns the value below which the given percentage of recorded values fall
+     * @param percentile the percentile to look up (0.0 - 100.0)
+     * @return the percentile value in nanoseconds
+     */
+    uint64_t get_percentile(double percentile) const;
+
+    /**
+     * convenience function returning get_percentile(..) in seconds
+     */
+    double get_percentile_seconds(double percentile) const;
+
+    uint64_t get_max() const;
+    uint64_t get_min() const;
+    uint64_t get_count() const;
+    double get_mean() const;
+
+    /**
+     * returns the max and mean in seconds
+     */
+    double get_max_seconds() const;
+    double get_mean_seconds() const;
+
+private:
+    static constexpr uint32_t subBucketCount = (1u << LATENCY_HISTOGRAM_SUB_BITS);
+    static constexpr uint32_t bucketCount = (LATENCY_HISTOGRAM_MAX_BITS - LATENCY_HISTOGRAM_SUB_BITS + 2) * (subBucketCount / 2);
+
+    static uint32_t get_bucket_index(uint64_t valueNs);
+    static uint64_t get_bucket_value(uint32_t index);
+
+    std::array<uint64_t, bucketCount> counts;
+    uint64_t totalCount;
+    uint64_t minValue;
+    uint64_t maxValue;
+    double sum;
+};
+
+#endif //MULTI_DRONE_PLATFORM_LATENCY_HISTOGRAM_H
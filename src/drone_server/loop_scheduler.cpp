@@ -0,0 +1,55 @@
+#include "loop_scheduler.h"
+
+#include <cerrno>
+#include <time.h>
+
+loop_scheduler::loop_scheduler(double rateHz) {
+    this->set_rate(rateHz);
+    this->reset();
+}
+
+void loop_scheduler::set_rate(double rateHz) {
+    periodNs = (rateHz > 0.0) ? (uint64_t)(1e9 / rateHz) : 0;
+}
+
+void loop_scheduler::reset() {
+    nextDeadlineNs = now_ns() + periodNs;
+}
+
+bool loop_scheduler::sleep() {
+    if (periodNs == 0) return true;
+
+    uint64_t now = now_ns();
+    if (now > nextDeadlineNs) {
+        /* missed the deadline, count it and start the next period from now */
+        overruns++;
+        nextDeadlineNs = now + periodNs;
+        return false;
+    }
+
+    timespec deadline;
+    deadline.tv_sec = (time_t)(nextDeadlineNs / 1000000000ull);
+    deadline.tv_nsec = (long)(nextDeadlineNs % 1000000000ull);
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, nullptr) == EINTR) {}
+
+    nextDeadlineNs += periodNs;
+    return true;
+}
+
+int64_t loop_scheduler::get_slack_ns() const {
+    return (int64_t)nextDeadlineNs - (int64_t)now_ns();
+}
+
+uint64_t loop_scheduler::get_overruns() const {
+    return overruns;
+}
+
+uint64_t loop_scheduler::get_period_ns() const {
+    return periodNs;
+}
+
+uint64_t loop_scheduler::now_ns() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t)ts.tv_sec * 1000000000ull) + (uint64_t)ts.tv_nsec;
+}
@@ -0,0 +1,64 @@
+#ifndef MULTI_DRONE_PLATFORM_LOOP_SCHEDULER_H
+#define MULTI_DRONE_PLATFORM_LOOP_SCHEDULER_H
+
+#include <cstdint>
+
+/**
+ * An absolute deadline loop scheduler used to pace the drone server loop. Deadlines are kept on CLOCK_MONOTONIC and
+ * slept to with clock_nanosleep(TIMER_ABSTIME, ..) so that time spent in the loop does not accumulate as drift.
+ * When a deadline is missed the overrun is counted and the schedule is re-anchored to the current time rather than
+ * bursting through the missed periods.
+ */
+class loop_scheduler {
+public:
+    /**
+     * @param rateHz the desired loop rate in Hertz, a rate of 0 or less disables sleeping
+     */
+    explicit loop_scheduler(double rateHz);
+
+    /**
+     * changes the loop rate, taking effect from the next deadline
+     * @param rateHz the desired loop rate in Hertz
+     */
+    void set_rate(double rateHz);
+
+    /**
+     * re-anchors the schedule such that the next deadline is one period from now
+     */
+    void reset();
+
+    /**
+     * sleeps until the next absolute deadline
+     * @return false if the deadline had already passed (an overrun), true otherwise
+     */
+    bool sleep();
+
+    /**
+     * returns the time remaining until the next deadline, negative if the deadline has passed
+     * @return the slack in nanoseconds
+     */
+    int64_t get_slack_ns() const;
+
+    /**
+     * returns the number of deadlines missed since construction
+     */
+    uint64_t get_overruns() const;
+
+    /**
+     * returns the loop period in nanoseconds, 0 if the scheduler is not sleeping
+     */
+    uint64_t get_period_ns() const;
+
+    /**
+     * returns the current time on CLOCK_MONOTONIC
+     * @return the time in nanoseconds
+     */
+    static uint64_t now_ns();
+
+private:
+    uint64_t periodNs = 0;
+    uint64_t nextDeadlineNs = 0;
+    uint64_t overruns = 0;
+};
+
+#endif //MULTI_DRONE_PLATFORM_LOOP_SCHEDULER_H
@@ -0,0 +1,88 @@
+#include "mocap_window.h"
+
+#include <cmath>
+
+/**
+ * returns the angle closest to a previous angle that is equivalent to the given angle
+ * @param angle the angle in radians, within [-pi, pi]
+ * @param previous the previous (unwrapped) angle in radians
+ */
+static double unwrap_angle(double angle, double previous) {
+    return previous + std::remainder(angle - previous, 2.0 * M_PI);
+}
+
+void mocap_window::push(double stamp, const geometry_msgs::Pose& pose) {
+    const geometry_msgs::Quaternion& q = pose.orientation;
+    double roll = std::atan2(2.0 * (q.w * q.x + q.y * q.z), 1.0 - 2.0 * (q.x * q.x + q.y * q.y));
+    double sinp = 2.0 * (q.w * q.y - q.z * q.x);
+    double pitch = (std::fabs(sinp) >= 1.0) ? std::copysign(M_PI / 2.0, sinp) : std::asin(sinp);
+    double yaw = std::atan2(2.0 * (q.w * q.z + q.x * q.y), 1.0 - 2.0 * (q.y * q.y + q.z * q.z));
+
+    if (count == 0) {
+        firstStamp = stamp;
+    } else {
+        roll = unwrap_angle(roll, values[ROLL][newest]);
+        pitch = unwrap_angle(pitch, values[PITCH][newest]);
+        yaw = unwrap_angle(yaw, values[YAW][newest]);
+    }
+
+    newest = (count == 0) ? 0 : (newest + 1) % MOCAP_WINDOW_SIZE;
+    if (count < MOCAP_WINDOW_SIZE) count++;
+
+    stamps[newest] = stamp - firstStamp;
+    values[X][newest] = pose.position.x;
+    values[Y][newest] = pose.position.y;
+    values[Z][newest] = pose.position.z;
+    values[ROLL][newest] = roll;
+    values[PITCH][newest] = pitch;
+    values[YAW][newest] = yaw;
+}
+
+bool mocap_window::empty() const {
+    return count == 0;
+}
+
+size_t mocap_window::size() const {
+    return count;
+}
+
+void mocap_window::estimate_velocity(geometry_msgs::Twist& pVelocity) const {
+    pVelocity = geometry_msgs::Twist();
+    if (count < 2) return;
+
+    /* a least-squares fit does not depend on the order of its samples, so the ring is used as is */
+    double meanStamp = 0.0;
+    for (size_t i = 0; i < count; i++) {
+        meanStamp += stamps[i];
+    }
+    meanStamp /= (double)count;
+
+    std::array<double, MOCAP_WINDOW_SIZE> offsets;
+    double variance = 0.0;
+    for (size_t i = 0; i < count; i++) {
+        offsets[i] = stamps[i] - meanStamp;
+        variance += offsets[i] * offsets[i];
+    }
+    if (variance <= 0.0) return;
+
+    /* slope = sum((t - mean(t)) * v) / sum((t - mean(t))^2), as sum(t - mean(t)) is 0 the mean of v is not needed */
+    std::array<double, AXIS_COUNT> slopes;
+    for (size_t axis = 0; axis < AXIS_COUNT; axis++) {
+        double covariance = 0.0;
+        for (size_t i = 0; i < count; i++) {
+            covariance += offsets[i] * values[axis][i];
+        }
+        slopes[axis] = covariance / variance;
+    }
+
+    pVelocity.linear.x = slopes[X];
+    pVelocity.linear.y = slopes[Y];
+    pVelocity.linear.z = slopes[Z];
+    pVelocity.angular.x = slopes[ROLL];
+    pVelocity.angular.y = slopes[PITCH];
+    pVelocity.angular.z = slopes[YAW];
+}
+
+double mocap_window::get_absolute_yaw() const {
+    return (count == 0) ? 0.0 : values[YAW][newest] * 180.0 / M_PI;
+}
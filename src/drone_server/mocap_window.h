@@ -0,0 +1,74 @@
+#ifndef MULTI_DRONE_PLATFORM_MOCAP_WINDOW_H
+#define MULTI_DRONE_PLATFORM_MOCAP_WINDOW_H
+
+#include <array>
+#include <cstddef>
+#include "geometry_msgs/Pose.h"
+#include "geometry_msgs/Twist.h"
+
+/**
+ * the number of motion capture frames the velocity of a drone is estimated over
+ */
+#define MOCAP_WINDOW_SIZE 5
+
+/**
+ * A fixed size window over the last MOCAP_WINDOW_SIZE motion capture frames of a drone, from which its linear and
+ * angular velocity are estimated by a least-squares fit. Frames are stored as compact samples in preallocated arrays
+ * (one per axis) overwritten in a ring, so adding a frame never allocates. The orientation of each frame is converted to
+ * euler angles once on arrival and unwrapped against the previous frame, so angles are continuous across +-180 degrees
+ * and the unwrapped yaw doubles as the drone's absolute yaw.
+ */
+class mocap_window {
+public:
+    /**
+     * adds a frame to the window, replacing the oldest frame once the window is full
+     * @param stamp the time of the frame in seconds
+     * @param pose the pose of the drone in the frame
+     */
+    void push(double stamp, const geometry_msgs::Pose& pose);
+
+    /**
+     * returns whether no frame has been added yet
+     */
+    bool empty() const;
+
+    /**
+     * returns the number of frames in the window
+     */
+    size_t size() const;
+
+    /**
+     * estimates the velocity of the drone as the slope of a least-squares line through the frames in the window for
+     * each axis, which is less sensitive to the noise of a single frame than the difference of the newest and oldest
+     * frames. The velocity is zero with fewer than two frames or if all frames share a stamp.
+     * @param pVelocity the returned linear (m/s) and angular (roll, pitch, yaw in radians/s) velocity
+     */
+    void estimate_velocity(geometry_msgs::Twist& pVelocity) const;
+
+    /**
+     * returns the unwrapped yaw of the newest frame in degrees, which keeps counting past +-180 degrees
+     */
+    double get_absolute_yaw() const;
+
+private:
+    enum axis {
+        X,
+        Y,
+        Z,
+        ROLL,
+        PITCH,
+        YAW,
+        AXIS_COUNT
+    };
+
+    /* the stamps of the samples relative to the first frame ever added, keeping the fit well conditioned */
+    std::array<double, MOCAP_WINDOW_SIZE> stamps;
+    std::array<std::array<double, MOCAP_WINDOW_SIZE>, AXIS_COUNT> values;
+
+    /* index of the newest sample and the number of valid samples */
+    size_t newest = 0;
+    size_t count = 0;
+    double firstStamp = 0.0;
+};
+
+#endif //MULTI_DRONE_PLATFORM_MOCAP_WINDOW_H
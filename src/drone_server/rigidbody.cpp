@@ -1,15 +1,38 @@
 #include <queue>
+#include <boost/make_shared.hpp>
 #include <std_msgs/Float32.h>
 #include "rigidbody.h"
 #include "element_conversions.cpp"
 #include "../collision_management/static_physical_management.h"
 #include "../collision_management/potential_fields.h"
+#include "../collision_management/orca_avoidance.h"
+#include "../debug/tracer/tracer.h"
+
+/**
+ * callback queue entry used to hand a command to a rigidbody's spinner thread without going through its api topic
+ */
+class api_update_callback : public ros::CallbackInterface {
+    private:
+        rigidbody* target;
+        multi_drone_platform::api_update msg;
+        void (rigidbody::*callback)(const multi_drone_platform::api_update&);
+
+    public:
+        api_update_callback(rigidbody* pTarget, const multi_drone_platform::api_update& pMsg,
+                            void (rigidbody::*pCallback)(const multi_drone_platform::api_update&))
+            : target(pTarget), msg(pMsg), callback(pCallback) {}
+
+        CallResult call() override {
+            (target->*callback)(msg);
+            return Success;
+        }
+};
 
-rigidbody::rigidbody(std::string tag, uint32_t id): mySpin(1,&myQueue), icpObject(tag, droneHandle) {
+rigidbody::rigidbody(std::string tag, uint32_t id): icpObject(tag, droneHandle) {
     this->tag = tag;
     this->numericID = id;
     this->batteryDying = false;
-    this->lastRecievedApiUpdate.msgType = "";
+    this->lastRecievedApiUpdate.opcode = multi_drone_platform::api_update::OPCODE_COUNT;
 
 //    initialise physical velocity limits in m/s
     this->velocity_limits.x = {{-10.0, 10.0}};
@@ -25,12 +48,6 @@ rigidbody::rigidbody(std::string tag, uint32_t id): mySpin(1,&myQueue), icpObjec
     // assume rigidbody is declared with drone facing in positive x direction
     this->absoluteYaw = 0.0f;
 
-    droneHandle.setParam("mdp/drone_" + std::to_string(this->get_id()) + "/width", this->width);
-    droneHandle.setParam("mdp/drone_" + std::to_string(this->get_id()) + "/height", this->height);
-    droneHandle.setParam("mdp/drone_" + std::to_string(this->get_id()) + "/length", this->length);
-    droneHandle.setParam("mdp/drone_" + std::to_string(this->get_id()) + "/restrictedDistance", this->restrictedDistance);
-    droneHandle.setParam("mdp/drone_" + std::to_string(this->get_id()) + "/influenceDistance", this->influenceDistance);
-
 //    initialise approx. mass in kg
     this->mass = 0.100;
 
@@ -99,13 +116,17 @@ void rigidbody::shutdown() {
 
     /* create and enqueue go to home command */
     multi_drone_platform::api_update msg;
-    msg.msgType = "GOTO_HOME";
+    msg.opcode = multi_drone_platform::api_update::GOTO_HOME;
     msg.yawVal = 0.0;
     msg.posVel.z = 0.0;
     msg.duration = 4.0;
-    this->enqueue_command(msg);
 
-    /* immediately handle go home command */
+    /* handled on the drone's callback queue, which owns the command queue, ahead of any later motion capture */
+    myQueue.addCallback(boost::make_shared<api_update_callback>(this, msg, &rigidbody::shutdown_callback));
+}
+
+void rigidbody::shutdown_callback(const multi_drone_platform::api_update& msg) {
+    this->enqueue_command(msg);
     this->handle_command();
 }
 
@@ -167,6 +188,8 @@ void rigidbody::set_desired_position(geometry_msgs::Vector3 pos, float yaw, floa
     this->log(logger::WARN, "next yaw is: " + std::to_string(yaw));
 
     /* send to wrapper */
+    std::lock_guard<std::recursive_mutex> wrapperGuard(wrapperLock);
+    if (this->get_state() == flight_state::DELETED) return;
     this->on_set_position(pos, yaw, duration);
 }
 
@@ -189,6 +212,8 @@ void rigidbody::set_desired_velocity(geometry_msgs::Vector3 vel, float yawRate,
     desiredTwistPublisher.publish(desTwistMsg);
 
     this->declare_expected_state(flight_state::MOVING, duration);
+    std::lock_guard<std::recursive_mutex> wrapperGuard(wrapperLock);
+    if (this->get_state() == flight_state::DELETED) return;
     this->on_set_velocity(vel, yawRate, duration);
 }
 
@@ -197,7 +222,7 @@ bool rigidbody::is_msg_different(const multi_drone_platform::api_update& msg, co
     double distanceBetweenCommonMsgs = 0.02;
     double timeBetweenTwoMsgs = ros::Time::now().toSec() - timeOfLastApiUpdate.toSec();
     if (timeBetweenTwoMsgs > timeBetweenCommonMsgs) return true; // there has been significant time between msgs
-    if (msg.msgType != last_message.msgType) return true;        // they are not the same msg type
+    if (msg.opcode != last_message.opcode) return true;          // they are not the same msg type
     if (msg.relativeXY != last_message.relativeXY) return true;    // they do not have the same xy relative
     if (msg.relativeZ != last_message.relativeZ) return true;      // they do not have the same z relative
     if (std::abs(msg.duration - (last_message.duration - timeBetweenTwoMsgs)) > 0.5) return true; // relative durations are significantly different
@@ -215,17 +240,21 @@ void rigidbody::set_home_coordiates(geometry_msgs::Vector3 pos) {
     homePosition.x = pos.x;
     homePosition.y = pos.y;
     homePosition.z = 0.0f;
+    this->publish_snapshot();
 }
 
 void rigidbody::calculate_velocity()
 {
-    currentVelocity = mdp_conversions::calc_vel(motionCapture.back(), motionCapture.front());
+    motionCapture.estimate_velocity(currentVelocity);
     // ROS_INFO("%s linear velocity [x: %f,y: %f,z: %f]", tag.c_str(), currVel.linear.x, currVel.linear.y, currVel.linear.z);
 }
 
 void rigidbody::add_motion_capture(const geometry_msgs::PoseStamped::ConstPtr& msg) {
-    /* if this is the first recieved message, fill motionCapture with homePositions */
-    geometry_msgs::PoseStamped motionMsg;
+    MDP_TRACE_SCOPE_ID("rigidbody::add_motion_capture", numericID);
+    this->timeOfLastMotionCaptureUpdate = ros::Time::now();
+
+    /* the frame is converted in place of the previous frame, so that its buffers are reused */
+    geometry_msgs::PoseStamped& motionMsg = latestMotionCapture;
 
     // do stuff with coordinate systems
     motionMsg.header = msg->header;
@@ -242,11 +271,8 @@ void rigidbody::add_motion_capture(const geometry_msgs::PoseStamped::ConstPtr& m
     motionMsg.header.frame_id = "mocap";
 
 
+    /* if this is the first recieved message, take its position as the home position */
     if (motionCapture.empty()) {
-        for (int i = 0; i < 5; i++) {
-            motionCapture.push(motionMsg);
-        }
-
         homePosition.x = motionMsg.pose.position.x;
         homePosition.y = motionMsg.pose.position.y;
         homePosition.z = motionMsg.pose.position.z;
@@ -254,18 +280,16 @@ void rigidbody::add_motion_capture(const geometry_msgs::PoseStamped::ConstPtr& m
         std::string homePosLog = "HOME POS: [" + std::to_string(homePosition.x) + ", " 
         + std::to_string(homePosition.y) + ", " + std::to_string(homePosition.z) + "]";
 
-        this->absoluteYaw = mdp_conversions::get_yaw_from_pose(motionMsg.pose);
-
         this->log(logger::INFO, homePosLog);
     }
 
-    /* otherwise, erase oldest message and push back newest message */
-    motionCapture.pop();
-    motionCapture.push(motionMsg);
+    /* the window overwrites its oldest frame once full, unstamped frames are timed by when they were received */
+    ros::Time frameTime = motionMsg.header.stamp.isZero() ? this->timeOfLastMotionCaptureUpdate : motionMsg.header.stamp;
+    motionCapture.push(frameTime.toSec(), motionMsg.pose);
     this->calculate_velocity();
     this->adjust_absolute_yaw();
 
-    currentPose = motionCapture.back().pose;
+    currentPose = motionMsg.pose;
     // ROS_INFO("Current Position: x: %f, y: %f, z: %f",currPos.position.x, currPos.position.y, currPos.position.z);
     // @TODO: Orientation implementation
 
@@ -279,17 +303,22 @@ void rigidbody::add_motion_capture(const geometry_msgs::PoseStamped::ConstPtr& m
 
     this->publish_physical_state();
 
-    this->timeOfLastMotionCaptureUpdate = ros::Time::now();
+    this->publish_snapshot();
+    std::lock_guard<std::recursive_mutex> wrapperGuard(wrapperLock);
     this->on_motion_capture(motionMsg);
 
 }
 
+void rigidbody::inject_motion_capture(const geometry_msgs::PoseStamped& msg) {
+    this->add_motion_capture(boost::make_shared<geometry_msgs::PoseStamped>(msg));
+}
+
 geometry_msgs::PoseStamped rigidbody::get_motion_capture() {
-    return motionCapture.back();
+    return latestMotionCapture;
 }
 
 void rigidbody::publish_physical_state() const {
-    currentPosePublisher.publish(motionCapture.back());
+    currentPosePublisher.publish(latestMotionCapture);
 
     geometry_msgs::TwistStamped stampedVel = {};
     stampedVel.header.stamp = ros::Time::now();
@@ -297,7 +326,8 @@ void rigidbody::publish_physical_state() const {
     currentTwistPublisher.publish(stampedVel);
 }
 
-void rigidbody::update(std::vector<rigidbody*>& rigidbodies) {
+void rigidbody::update(const neighbour_grid& neighbours) {
+    loopAvoidanceNs = 0;
     /* do a stage 2 timeout if necessary */
     if (this->timeoutTimer.is_stage_timeout()) {
         if (this->timeoutTimer.has_timed_out()) {
@@ -305,28 +335,51 @@ void rigidbody::update(std::vector<rigidbody*>& rigidbodies) {
 
             /* send land command through api */
             multi_drone_platform::api_update msg;
-            msg.msgType = "LAND";
+            msg.opcode = multi_drone_platform::api_update::LAND;
             msg.duration = 5.0f;
             apiPublisher.publish(msg);
         }
     }
-    else if (this->get_state() == MOVING || this->get_state() == HOVERING){
-        //potential_fields::check(this, rigidbodies);
+    else if (this->get_snapshot().state == MOVING || this->get_snapshot().state == HOVERING){
+        uint64_t avoidanceStart = command_trace::now_ns();
+        switch (avoidanceEngine) {
+            case POTENTIAL_FIELDS:
+                potential_fields::check(this, neighbours);
+                break;
+            case ORCA:
+                orca_avoidance::check(this, neighbours);
+                break;
+            case NO_AVOIDANCE:
+                break;
+        }
+        loopAvoidanceNs = command_trace::now_ns() - avoidanceStart;
     }
+    MDP_TRACE_SCOPE_ID("on_update", numericID);
+    std::lock_guard<std::recursive_mutex> wrapperGuard(wrapperLock);
     this->on_update();
 }
 
 void rigidbody::api_callback(const multi_drone_platform::api_update& msg) {
+    MDP_TRACE_SCOPE_ID("rigidbody::api_callback", numericID);
     if (!shutdownHasBeenCalled) {
         /* if shutdown has been called, then disable all incoming api updates */
         if (!batteryDying) {
             // ROS_INFO("%s recieved msg %s", tag.c_str(),msg.msg_type.c_str());
             // std::string commandInfo = "Recieved msg " + msg.msg_type;
             // this->postLog(0, commandInfo);  
+            uint64_t dequeued = command_trace::now_ns();
             this->commandQueue.clear();
             auto modMsg = static_physical_management::adjust_command(this, msg);
+            uint64_t adjusted = command_trace::now_ns();
             this->commandQueue.push_back(modMsg);
             handle_command();
+            uint64_t handled = command_trace::now_ns();
+
+            std::lock_guard<std::mutex> lock(timingLock);
+            commandAdjustTime.record(adjusted - dequeued);
+            if (msg.commandID != 0) {
+                this->record_command_hops(msg, dequeued, adjusted, handled);
+            }
         } else {
             this->log(logger::ERROR, "Battery Timeout");
             /* shutdown will tell the drone to go to home and land, it will
@@ -336,63 +389,83 @@ void rigidbody::api_callback(const multi_drone_platform::api_update& msg) {
     }
 }
 
+void rigidbody::record_command_hops(const multi_drone_platform::api_update& msg, uint64_t dequeued, uint64_t adjusted, uint64_t handled) {
+    /* the send stamp is only comparable when it is from this host's clock, skip the hops that use it otherwise */
+    if (msg.sentStamp != 0 && msg.clockID != 0 && msg.clockID == command_trace::clock_id()
+        && msg.receivedStamp >= msg.sentStamp) {
+        commandHops[command_trace::TRANSPORT].record(msg.receivedStamp - msg.sentStamp);
+        commandHops[command_trace::TOTAL].record(handled - msg.sentStamp);
+    }
+    if (msg.receivedStamp != 0 && msg.dispatchedStamp >= msg.receivedStamp) {
+        commandHops[command_trace::SERVER].record(msg.dispatchedStamp - msg.receivedStamp);
+    }
+    if (msg.dispatchedStamp != 0 && dequeued >= msg.dispatchedStamp) {
+        commandHops[command_trace::QUEUE].record(dequeued - msg.dispatchedStamp);
+    }
+    commandHops[command_trace::ADJUST].record(adjusted - dequeued);
+    commandHops[command_trace::HANDLE].record(handled - adjusted);
+}
+
+bool rigidbody::enqueue_api_update(const multi_drone_platform::api_update& msg) {
+    if (shutdownHasBeenCalled) return false;
+
+    multi_drone_platform::api_update queued = msg;
+    queued.dispatchedStamp = command_trace::now_ns();
+    myQueue.addCallback(boost::make_shared<api_update_callback>(this, queued, &rigidbody::api_callback));
+    return true;
+}
+
+class avoidance_callback : public ros::CallbackInterface {
+    private:
+        rigidbody* target;
+        multi_drone_platform::api_update msg;
+        ros::Time commandEnd;
+        void (rigidbody::*callback)(const multi_drone_platform::api_update&, const ros::Time&);
+
+    public:
+        avoidance_callback(rigidbody* pTarget, const multi_drone_platform::api_update& pMsg, const ros::Time& pCommandEnd,
+                           void (rigidbody::*pCallback)(const multi_drone_platform::api_update&, const ros::Time&))
+            : target(pTarget), msg(pMsg), commandEnd(pCommandEnd), callback(pCallback) {}
+
+        CallResult call() override {
+            (target->*callback)(msg, commandEnd);
+            return Success;
+        }
+};
+
+void rigidbody::enqueue_avoidance(const multi_drone_platform::api_update& msg, const ros::Time& pCommandEnd) {
+    myQueue.addCallback(boost::make_shared<avoidance_callback>(this, msg, pCommandEnd, &rigidbody::apply_avoidance));
+}
+
+void rigidbody::apply_avoidance(const multi_drone_platform::api_update& msg, const ros::Time& pCommandEnd) {
+    /* a command handled since the loop took its snapshot takes precedence over avoidance computed for the old one */
+    if (pCommandEnd != this->commandEnd) return;
+
+    if (msg.opcode == multi_drone_platform::api_update::VELOCITY) {
+        set_desired_velocity(msg.posVel, msg.yawVal, msg.duration);
+    } else {
+        set_desired_position(msg.posVel, msg.yawVal, msg.duration);
+    }
+}
+
 void rigidbody::handle_command() {
     if (!commandQueue.empty()) {
         this->timeoutTimer.close_timer(); // stop timeout 2 from happening as drone has received a message
         bool isGoHomeMessage = false;
         multi_drone_platform::api_update msg = this->commandQueue.front();
         if (is_msg_different(msg, this->lastRecievedApiUpdate)) {
-            this->log(logger::INFO, "=> Handling command: " + msg.msgType);
+            this->log(logger::INFO, std::string("=> Handling command: ") + api_opcode_to_string(msg.opcode));
             this->log(logger::DEBUG, "Duration " + std::to_string(msg.duration));
             this->lastRecievedApiUpdate = msg;
             this->timeOfLastApiUpdate = ros::Time::now();
             this->commandEnd = timeOfLastApiUpdate + ros::Duration(msg.duration);
-            switch(apiMap[msg.msgType]) {
-                /* VELOCITY */
-                case 0:
-                    ROS_INFO("V: [%.2f, %.2f, %.2f] rel_Xy: %d, rel_z: %d, dur: %.1f", msg.posVel.x, msg.posVel.y, msg.posVel.z, msg.relativeXY, msg.relativeZ, msg.duration);
-                    if (msg.relativeXY && msg.relativeZ) this->log(logger::ERROR, "This should have already been preprocessed");
-                    set_desired_velocity(msg.posVel, msg.yawVal, msg.duration);
-                    break;
-                /* POSITION */
-                case 1:
-                    ROS_INFO("P: xyz: %.2f %.2f %.2f, rel_Xy: %d, rel_z: %d", msg.posVel.x, msg.posVel.y, msg.posVel.z, msg.relativeXY, msg.relativeZ);
-                    if (msg.relativeXY && msg.relativeZ) this->log(logger::ERROR, "This should have already been preprocessed");
-                    set_desired_position(msg.posVel, msg.yawVal, msg.duration);
-                    break;
-                /* TAKEOFF */
-                case 2:
-                    ROS_INFO("Height: %f", msg.posVel.z);
-                    this->log(logger::INFO, "Duration: " + std::to_string(msg.duration));
-                    takeoff(msg.posVel.z, msg.duration);
-                    break;
-                /* LAND */
-                case 3:
-                    land(msg.duration);
-                    break;
-                /* HOVER */
-                case 4:
-                    this->hover(msg.duration);
-                    this->timeoutTimer.reset_timer(msg.duration - 0.05f);
-                    break;
-                /* EMERGENCY */
-                case 5: 
-                    emergency();
-                    break;
-                /* SET_HOME */
-                case 6:
-                    if (!msg.relativeXY) this->log(logger::ERROR, "This should have already been preprocessed");
-                    set_home_coordiates(msg.posVel);
-                    break;
-                /* GOTO_HOME */
-                case 8:
-                    go_home(msg.yawVal, msg.duration, msg.posVel.z);
-                    isGoHomeMessage = true;
-                    break;
-                default:
-                    this->log(logger::WARN, "The API command, " + msg.msgType + ", is not valid");
-                break;
+            this->publish_snapshot();
+            if (msg.opcode < commandHandlers.size()) {
+                (this->*commandHandlers[msg.opcode])(msg);
+            } else {
+                this->handle_invalid_command(msg);
             }
+            isGoHomeMessage = (msg.opcode == multi_drone_platform::api_update::GOTO_HOME);
         }
         dequeue_command();
 
@@ -403,6 +476,66 @@ void rigidbody::handle_command() {
     }
 }
 
+const std::array<rigidbody::command_handler, multi_drone_platform::api_update::OPCODE_COUNT> rigidbody::commandHandlers = {{
+    &rigidbody::handle_velocity_command,    /* VELOCITY */
+    &rigidbody::handle_position_command,    /* POSITION */
+    &rigidbody::handle_takeoff_command,     /* TAKEOFF */
+    &rigidbody::handle_land_command,        /* LAND */
+    &rigidbody::handle_hover_command,       /* HOVER */
+    &rigidbody::handle_emergency_command,   /* EMERGENCY */
+    &rigidbody::handle_set_home_command,    /* SET_HOME */
+    &rigidbody::handle_invalid_command,     /* GET_HOME */
+    &rigidbody::handle_go_home_command,     /* GOTO_HOME */
+    &rigidbody::handle_invalid_command,     /* ORIENTATION */
+    &rigidbody::handle_invalid_command,     /* TIME */
+    &rigidbody::handle_invalid_command,     /* DRONE_SERVER_FREQ */
+    &rigidbody::handle_invalid_command      /* LATENCY */
+}};
+
+void rigidbody::handle_velocity_command(const multi_drone_platform::api_update& msg) {
+    ROS_INFO("V: [%.2f, %.2f, %.2f] rel_Xy: %d, rel_z: %d, dur: %.1f", msg.posVel.x, msg.posVel.y, msg.posVel.z, msg.relativeXY, msg.relativeZ, msg.duration);
+    if (msg.relativeXY && msg.relativeZ) this->log(logger::ERROR, "This should have already been preprocessed");
+    set_desired_velocity(msg.posVel, msg.yawVal, msg.duration);
+}
+
+void rigidbody::handle_position_command(const multi_drone_platform::api_update& msg) {
+    ROS_INFO("P: xyz: %.2f %.2f %.2f, rel_Xy: %d, rel_z: %d", msg.posVel.x, msg.posVel.y, msg.posVel.z, msg.relativeXY, msg.relativeZ);
+    if (msg.relativeXY && msg.relativeZ) this->log(logger::ERROR, "This should have already been preprocessed");
+    set_desired_position(msg.posVel, msg.yawVal, msg.duration);
+}
+
+void rigidbody::handle_takeoff_command(const multi_drone_platform::api_update& msg) {
+    ROS_INFO("Height: %f", msg.posVel.z);
+    this->log(logger::INFO, "Duration: " + std::to_string(msg.duration));
+    takeoff(msg.posVel.z, msg.duration);
+}
+
+void rigidbody::handle_land_command(const multi_drone_platform::api_update& msg) {
+    land(msg.duration);
+}
+
+void rigidbody::handle_hover_command(const multi_drone_platform::api_update& msg) {
+    this->hover(msg.duration);
+    this->timeoutTimer.reset_timer(msg.duration - 0.05f);
+}
+
+void rigidbody::handle_emergency_command(const multi_drone_platform::api_update& msg) {
+    emergency();
+}
+
+void rigidbody::handle_set_home_command(const multi_drone_platform::api_update& msg) {
+    if (!msg.relativeXY) this->log(logger::ERROR, "This should have already been preprocessed");
+    set_home_coordiates(msg.posVel);
+}
+
+void rigidbody::handle_go_home_command(const multi_drone_platform::api_update& msg) {
+    go_home(msg.yawVal, msg.duration, msg.posVel.z);
+}
+
+void rigidbody::handle_invalid_command(const multi_drone_platform::api_update& msg) {
+    this->log(logger::WARN, std::string("The API command, ") + api_opcode_to_string(msg.opcode) + ", is not valid");
+}
+
 void rigidbody::enqueue_command(multi_drone_platform::api_update command) {
     commandQueue.push_back(command);
 }
@@ -418,6 +551,7 @@ void rigidbody::dequeue_command() {
 }
 
 void rigidbody::emergency() {
+    /* DELETED is set before the wrapper is reached, so commands still queued behind wrapperLock no longer act */
     this->set_state(flight_state::DELETED);
     this->on_emergency();
 }
@@ -429,6 +563,8 @@ void rigidbody::land(float duration) {
     }
 
     this->declare_expected_state(flight_state::MOVING);
+    std::lock_guard<std::recursive_mutex> wrapperGuard(wrapperLock);
+    if (this->get_state() == flight_state::DELETED) return;
     this->on_land(duration);
 }
 
@@ -438,6 +574,8 @@ void rigidbody::takeoff(float height, float duration) {
         return;
     }
     this->declare_expected_state(flight_state::MOVING, duration);
+    std::lock_guard<std::recursive_mutex> wrapperGuard(wrapperLock);
+    if (this->get_state() == flight_state::DELETED) return;
     this->on_takeoff(height, duration);
 }
 
@@ -455,7 +593,7 @@ void rigidbody::hover(float duration) {
 void rigidbody::go_home(float yaw, float duration, float in_height) {
     /* enqueue goto command */
     multi_drone_platform::api_update goMsg;
-    goMsg.msgType = "POSITION";
+    goMsg.opcode = multi_drone_platform::api_update::POSITION;
     goMsg.duration = duration;
     goMsg.yawVal = yaw;
     goMsg.posVel = homePosition;
@@ -465,7 +603,7 @@ void rigidbody::go_home(float yaw, float duration, float in_height) {
     /* enqueue land msg if necessary */
     if (in_height < 0.1f) {
         multi_drone_platform::api_update landMsg;
-        landMsg.msgType = "LAND";
+        landMsg.opcode = multi_drone_platform::api_update::LAND;
         landMsg.duration = 3.0f;
         enqueue_command(landMsg);
     }
@@ -514,7 +652,7 @@ void rigidbody::update_current_flight_state() {
     /* determine whether the drone is considered to be on the ground */
     /* in this case, if the drone is less than 5cm in from its home height it is considered landed */
     // @TODO: find a good value for this
-    bool droneIsOnTheGround = (motionCapture.back().pose.position.z < (homePosition.z + 0.05));
+    bool droneIsOnTheGround = (currentPose.position.z < (homePosition.z + 0.05));
 
 //    if (droneHasMoved) {
 //        this->log(logger::INFO, "mov count: " + std::to_string(this->movCounter));
@@ -553,14 +691,94 @@ void rigidbody::update_current_flight_state() {
 }
 
 void rigidbody::set_state(const flight_state& inputState) {
-    if (inputState != this->get_state()) {
+    std::lock_guard<std::mutex> lock(stateLock);
+    flight_state current = this->state;
+    if (inputState != current && current != flight_state::DELETED) {
         // this->log(logger::INFO, "Setting state to " + get_flight_state_string(inputState));
+        /* latch_snapshot() takes the state into the loop's snapshot, as set_state is not only called by the writer */
         this->state = inputState;
-        droneHandle.setParam("mdp/drone_" + std::to_string(this->numericID) + "/state", get_flight_state_string(this->state));
+        this->publish_state_event();
     }
 }
 
-const rigidbody::flight_state &rigidbody::get_state() const {
+void rigidbody::publish_snapshot() {
+    physical_snapshot& snapshot = snapshots.get_back();
+    snapshot.pose = this->currentPose;
+    snapshot.velocity = this->currentVelocity;
+    snapshot.homePosition = this->homePosition;
+    snapshot.state = this->state;
+    snapshot.timeOfLastMotionCaptureUpdate = this->timeOfLastMotionCaptureUpdate;
+    /* frames without a capture stamp are taken as captured when received */
+    snapshot.motionCaptureStamp = latestMotionCapture.header.stamp.isZero() ? this->timeOfLastMotionCaptureUpdate
+                                                                            : latestMotionCapture.header.stamp;
+    snapshot.command = this->lastRecievedApiUpdate;
+    snapshot.commandEnd = this->commandEnd;
+    snapshots.publish();
+}
+
+void rigidbody::latch_snapshot() {
+    snapshots.latch();
+    snapshots.get_front().state = this->state;
+}
+
+const rigidbody::physical_snapshot& rigidbody::get_snapshot() const {
+    return snapshots.get_front();
+}
+
+void rigidbody::set_estimate(const kalman_estimate& estimate) {
+    loopEstimate = estimate;
+    estimates.get_back() = estimate;
+    estimates.publish();
+}
+
+const kalman_estimate& rigidbody::get_loop_estimate() const {
+    return loopEstimate;
+}
+
+void rigidbody::set_repulsion(const geometry_msgs::Vector3& repulsion, double closest) {
+    loopRepulsion = repulsion;
+    loopClosest = closest;
+}
+
+const geometry_msgs::Vector3& rigidbody::get_loop_repulsion() const {
+    return loopRepulsion;
+}
+
+double rigidbody::get_loop_closest() const {
+    return loopClosest;
+}
+
+geometry_msgs::Vector3 rigidbody::predict_position(const ros::Time& time) {
+    estimates.latch();
+    const kalman_estimate& estimate = estimates.get_front();
+    if (!estimate.valid) return mdp_conversions::point_to_vector3(currentPose.position);
+    return estimate.predict(time);
+}
+
+void rigidbody::publish_state_event() {
+    /* the drone server hands over the publisher after construction, and then publishes the state reached so far */
+    if (!statePublisher) return;
+
+    multi_drone_platform::state_event msg;
+    msg.droneID = this->numericID;
+    msg.state = (uint8_t)this->state.load();
+    msg.sequence = ++this->stateSequence;
+    msg.stamp = ros::Time::now();
+    statePublisher.publish(msg);
+}
+
+void rigidbody::publish_physical_params() {
+    /* a struct parameter still exposes each member as mdp/drone_<id>/<name> to getParam */
+    XmlRpc::XmlRpcValue params;
+    params["width"] = this->width;
+    params["height"] = this->height;
+    params["length"] = this->length;
+    params["restrictedDistance"] = this->restrictedDistance;
+    params["influenceDistance"] = this->influenceDistance;
+    droneHandle.setParam("mdp/drone_" + std::to_string(this->get_id()), params);
+}
+
+rigidbody::flight_state rigidbody::get_state() const {
     return this->state;
 }
 
@@ -603,15 +821,8 @@ double rigidbody::get_end_yaw_from_yawrate_and_time_period(double yawrate, doubl
 }
 
 void rigidbody::adjust_absolute_yaw() {
-    if ((motionCapture.front().header.seq % (motionCapture.size() - 1)) == 0) {
-        auto newYaw = mdp_conversions::get_yaw_from_pose(motionCapture.back().pose);
-        auto oldYaw = mdp_conversions::get_yaw_from_pose(motionCapture.front().pose);
-        float yawDiff = newYaw - oldYaw;
-        if (std::abs(yawDiff) > 180.0f) {
-            yawDiff = - (360.0f - yawDiff);
-        }
-        absoluteYaw += yawDiff;
-    }
+    /* the window unwraps the yaw of every frame against the previous one, so it keeps counting past +-180 degrees */
+    absoluteYaw = (float)motionCapture.get_absolute_yaw();
 }
 
 ros::NodeHandle rigidbody::get_ros_node_handle() const {
@@ -0,0 +1,119 @@
+#include "rigidbody_slot_map.h"
+
+#include <algorithm>
+
+constexpr uint32_t rigidbody_slot_map::noFreeSlot;
+
+rigidbody_slot_map::rigidbody_slot_map(uint32_t firstIndex, uint32_t capacity) : firstIndex(firstIndex & SLOT_MAP_INDEX_MASK),
+    capacity(std::min(capacity, (SLOT_MAP_INDEX_MASK + 1) - (firstIndex & SLOT_MAP_INDEX_MASK))) {}
+
+uint32_t rigidbody_slot_map::make_id(uint32_t index, uint32_t generation) const {
+    return (generation << SLOT_MAP_INDEX_BITS) | ((firstIndex + index) & SLOT_MAP_INDEX_MASK);
+}
+
+bool rigidbody_slot_map::get_slot_index(uint32_t id, slot_state expectedState, uint32_t& pIndex) const {
+    uint32_t index = (id & SLOT_MAP_INDEX_MASK) - firstIndex;
+    /* ids below firstIndex wrap around to a large index */
+    if (index >= slots.size()) return false;
+
+    const slot& s = slots[index];
+    if (s.state != expectedState || make_id(index, s.generation) != id) return false;
+
+    pIndex = index;
+    return true;
+}
+
+void rigidbody_slot_map::push_free(uint32_t index) {
+    slot& s = slots[index];
+    s.state = FREE;
+    /* advance the generation so that old ids to this slot are detected as stale, wrapping within the id bits */
+    s.generation = (s.generation + 1) & (UINT32_MAX >> SLOT_MAP_INDEX_BITS);
+    s.link = freeHead;
+    freeHead = index;
+}
+
+bool rigidbody_slot_map::allocate(uint32_t& pID) {
+    uint32_t index;
+    if (freeHead != noFreeSlot) {
+        index = freeHead;
+        freeHead = slots[index].link;
+    } else if (slots.size() < capacity) {
+        index = (uint32_t)slots.size();
+        slots.emplace_back();
+    } else {
+        /* a further slot would take an id of the next shard's range */
+        return false;
+    }
+
+    slots[index].state = RESERVED;
+    pID = make_id(index, slots[index].generation);
+    return true;
+}
+
+bool rigidbody_slot_map::activate(uint32_t id, rigidbody* pRigidbody) {
+    uint32_t index;
+    if (!get_slot_index(id, RESERVED, index)) return false;
+
+    slots[index].state = LIVE;
+    slots[index].link = (uint32_t)dense.size();
+    dense.push_back(pRigidbody);
+    denseSlots.push_back(index);
+    return true;
+}
+
+void rigidbody_slot_map::release(uint32_t id) {
+    uint32_t index;
+    if (get_slot_index(id, RESERVED, index)) {
+        push_free(index);
+    }
+}
+
+bool rigidbody_slot_map::remove(uint32_t id) {
+    uint32_t index;
+    if (!get_slot_index(id, LIVE, index)) return false;
+
+    /* swap the last live rigidbody into the removed position to keep dense packed */
+    uint32_t denseIndex = slots[index].link;
+    uint32_t lastSlot = denseSlots.back();
+    dense[denseIndex] = dense.back();
+    denseSlots[denseIndex] = lastSlot;
+    slots[lastSlot].link = denseIndex;
+    dense.pop_back();
+    denseSlots.pop_back();
+
+    push_free(index);
+    return true;
+}
+
+bool rigidbody_slot_map::get(uint32_t id, rigidbody*& pReturnRigidbody) const {
+    uint32_t index;
+    if (!get_slot_index(id, LIVE, index)) return false;
+
+    pReturnRigidbody = dense[slots[index].link];
+    return true;
+}
+
+bool rigidbody_slot_map::is_stale(uint32_t id) const {
+    uint32_t index = (id & SLOT_MAP_INDEX_MASK) - firstIndex;
+    return (index < slots.size()) && (make_id(index, slots[index].generation) != id);
+}
+
+const std::vector<rigidbody*>& rigidbody_slot_map::get_live() const {
+    return dense;
+}
+
+size_t rigidbody_slot_map::size() const {
+    return dense.size();
+}
+
+bool rigidbody_slot_map::empty() const {
+    return dense.empty();
+}
+
+std::vector<rigidbody*>::const_iterator rigidbody_slot_map::begin() const {
+    return dense.begin();
+}
+
+std::vector<rigidbody*>::const_iterator rigidbody_slot_map::end() const {
+    return dense.end();
+}
@@ -0,0 +1,120 @@
+#ifndef MULTI_DRONE_PLATFORM_RIGIDBODY_SLOT_MAP_H
+#define MULTI_DRONE_PLATFORM_RIGIDBODY_SLOT_MAP_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class rigidbody;
+
+/**
+ * number of low bits of a drone id holding the slot index, the remaining high bits hold the slot generation
+ */
+#define SLOT_MAP_INDEX_BITS 20
+#define SLOT_MAP_INDEX_MASK ((1u << SLOT_MAP_INDEX_BITS) - 1)
+
+/**
+ * A generational slot map owning the drone id space of the drone server. Drone ids are handles made up of a slot index
+ * and the generation of that slot, so when a slot is reused by a new drone any id held for the old drone is detected
+ * as stale. Slots are reused in O(1) through a free list, and live rigidbodies are kept packed in a dense vector that
+ * can be iterated without holes. The first generation of every slot has the id equal to its index, so the first drones
+ * added keep the ids 0, 1, 2...
+ *
+ * Adding a drone is done in two steps as the rigidbody needs its id on construction: allocate() an id, construct the
+ * rigidbody, then activate(..) it (or release(..) the id if construction failed).
+ *
+ * A slot map can start its slot indices at an offset and be limited to a number of slots, so that several maps (i.e.
+ * drone server shards) hand out disjoint ids.
+ */
+class rigidbody_slot_map {
+public:
+    /**
+     * @param firstIndex the slot index of the map's first slot, ids with a lower slot index are never found
+     * @param capacity the most slots the map may hand out, limited to the slot indices from firstIndex up
+     */
+    explicit rigidbody_slot_map(uint32_t firstIndex = 0, uint32_t capacity = SLOT_MAP_INDEX_MASK + 1);
+
+    /**
+     * reserves a slot for a new rigidbody
+     * @param pID set to the id of the reserved slot
+     * @return false if every slot of the map is in use
+     */
+    bool allocate(uint32_t& pID);
+
+    /**
+     * makes the rigidbody in a reserved slot live
+     * @param id an id returned by allocate()
+     * @param pRigidbody the rigidbody to store
+     * @return false if the id does not refer to a reserved slot
+     */
+    bool activate(uint32_t id, rigidbody* pRigidbody);
+
+    /**
+     * returns a reserved slot to the free list without making it live
+     * @param id an id returned by allocate()
+     */
+    void release(uint32_t id);
+
+    /**
+     * removes a live rigidbody, the caller keeps ownership of the rigidbody. The slot's generation is advanced so that
+     * the id becomes stale.
+     * @param id the id of the rigidbody
+     * @return false if the id was not live
+     */
+    bool remove(uint32_t id);
+
+    /**
+     * looks up a live rigidbody
+     * @param id the drone id
+     * @param pReturnRigidbody set to the rigidbody if found
+     * @return false if the id is out of range, stale, or not live
+     */
+    bool get(uint32_t id, rigidbody* &pReturnRigidbody) const;
+
+    /**
+     * returns whether the id's slot exists but belongs to a different generation (i.e. the drone was removed)
+     */
+    bool is_stale(uint32_t id) const;
+
+    /**
+     * returns all live rigidbodies packed without holes. The order is not stable across removals.
+     */
+    const std::vector<rigidbody*>& get_live() const;
+
+    size_t size() const;
+    bool empty() const;
+
+    std::vector<rigidbody*>::const_iterator begin() const;
+    std::vector<rigidbody*>::const_iterator end() const;
+
+private:
+    enum slot_state : uint8_t {
+        FREE,
+        RESERVED,
+        LIVE
+    };
+
+    struct slot {
+        uint32_t generation = 0;
+        /* index into the dense vector when live, next free slot when free */
+        uint32_t link = 0;
+        slot_state state = FREE;
+    };
+
+    /* index is the position in slots, offset by firstIndex in the id */
+    uint32_t make_id(uint32_t index, uint32_t generation) const;
+    bool get_slot_index(uint32_t id, slot_state expectedState, uint32_t& pIndex) const;
+    void push_free(uint32_t index);
+
+    uint32_t firstIndex;
+    uint32_t capacity;
+    std::vector<slot> slots;
+    std::vector<rigidbody*> dense;
+    /* slot index of each entry in dense */
+    std::vector<uint32_t> denseSlots;
+
+    static constexpr uint32_t noFreeSlot = UINT32_MAX;
+    uint32_t freeHead = noFreeSlot;
+};
+
+#endif //MULTI_DRONE_PLATFORM_RIGIDBODY_SLOT_MAP_H
@@ -0,0 +1,76 @@
+#ifndef MULTI_DRONE_PLATFORM_SHARD_LAYOUT_H
+#define MULTI_DRONE_PLATFORM_SHARD_LAYOUT_H
+
+#include <cstdint>
+#include <string>
+
+#include "rigidbody_slot_map.h"
+
+/**
+ * the number of drone server shards making up the platform, 1 (the default) runs a single unsharded drone server
+ */
+#define SHARD_COUNT_PARAM "/mdp/shard_count"
+
+/**
+ * private parameter of each drone server process selecting the shard it runs as, from 0 to shard_count - 1
+ */
+#define SHARD_INDEX_PARAM "~shard_index"
+
+/**
+ * topic on which every shard publishes the state of its drones to the other shards
+ */
+#define SHARD_BOUNDARY_TOPIC "/mdp_shard_boundary"
+
+/**
+ * number of low bits of a slot index addressing a drone within its shard, the bits above select the shard. A shard
+ * owns up to 65536 slots and there can be up to 16 shards within the slot index bits of a drone id
+ */
+#define SHARD_SLOT_BITS 16
+#define SHARD_SLOT_MASK ((1u << SHARD_SLOT_BITS) - 1)
+#define MAX_SHARDS (1u << (SLOT_MAP_INDEX_BITS - SHARD_SLOT_BITS))
+
+/**
+ * Layout of a sharded drone server. Drones are sharded by id range: shard k allocates the slot indices from
+ * k << SHARD_SLOT_BITS, so the shard owning a drone is known from its id alone. Drone topics stay unique as drone ids
+ * are, while the drone server's own topics and services are moved under mdp_shard_<k>/ for every shard but the first,
+ * so that an unsharded platform keeps its names.
+ */
+namespace shard_layout {
+
+/**
+ * returns the shard owning a drone
+ * @param droneID the drone's id
+ */
+inline uint32_t get_shard(uint32_t droneID) {
+    return (droneID & SLOT_MAP_INDEX_MASK) >> SHARD_SLOT_BITS;
+}
+
+/**
+ * returns the first slot index allocated by a shard
+ * @param shard the shard index
+ */
+inline uint32_t get_first_slot(uint32_t shard) {
+    return shard << SHARD_SLOT_BITS;
+}
+
+/**
+ * returns the name of a drone server topic or service for a shard
+ * @param shard the shard index
+ * @param name the unsharded name, i.e. "mdp_command"
+ */
+inline std::string get_topic(uint32_t shard, const std::string& name) {
+    if (shard == 0) return name;
+    return "mdp_shard_" + std::to_string(shard) + "/" + name;
+}
+
+/**
+ * returns the suffix added to the files a shard writes into the session directory, empty for the first shard
+ * @param shard the shard index
+ */
+inline std::string get_file_suffix(uint32_t shard) {
+    if (shard == 0) return "";
+    return "_shard_" + std::to_string(shard);
+}
+}
+
+#endif //MULTI_DRONE_PLATFORM_SHARD_LAYOUT_H
@@ -0,0 +1,153 @@
+#include "state_board.h"
+#include "shard_layout.h"
+
+#include <cstring>
+#include <utility>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* readers give up on a slot that is being rewritten after this many attempts */
+#define STATE_BOARD_READ_RETRIES 64
+
+state_board::state_board(void* pMapping, size_t size, bool owner, std::string name)
+    : mapping(pMapping), mappingSize(size), isOwner(owner), shmName(std::move(name)) {
+    boardHeader = (header*)mapping;
+    entries = (entry*)((char*)mapping + sizeof(header));
+}
+
+state_board::~state_board() {
+    if (isOwner) {
+        boardHeader->alive.store(0, std::memory_order_release);
+    }
+    munmap(mapping, mappingSize);
+    if (isOwner) {
+        shm_unlink(shmName.c_str());
+    }
+}
+
+size_t state_board::get_mapping_size() {
+    return sizeof(header) + (sizeof(entry) * STATE_BOARD_SLOTS);
+}
+
+std::string state_board::get_shm_name(uint32_t shard) {
+    std::string name = STATE_BOARD_SHM_NAME;
+    if (shard > 0) name += "_" + std::to_string(shard);
+    return name;
+}
+
+state_board* state_board::create(uint32_t shard) {
+    std::string name = get_shm_name(shard);
+    /* always start from a fresh object so that clients of a previous drone server see it die */
+    shm_unlink(name.c_str());
+    int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (fd < 0) return nullptr;
+
+    size_t size = get_mapping_size();
+    if (ftruncate(fd, (off_t)size) != 0) {
+        close(fd);
+        shm_unlink(name.c_str());
+        return nullptr;
+    }
+
+    void* mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        shm_unlink(name.c_str());
+        return nullptr;
+    }
+
+    /* the object is zero filled by ftruncate, an all zero entry is an inactive slot with an even sequence */
+    state_board* board = new state_board(mapping, size, true, name);
+    board->boardHeader->version = STATE_BOARD_VERSION;
+    board->boardHeader->slotCount = STATE_BOARD_SLOTS;
+    board->boardHeader->tick.store(0, std::memory_order_relaxed);
+    board->boardHeader->alive.store(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    board->boardHeader->magic = STATE_BOARD_MAGIC;
+    return board;
+}
+
+state_board* state_board::open(uint32_t shard) {
+    std::string name = get_shm_name(shard);
+    int fd = shm_open(name.c_str(), O_RDONLY, 0);
+    if (fd < 0) return nullptr;
+
+    struct stat info;
+    size_t size = get_mapping_size();
+    if (fstat(fd, &info) != 0 || (size_t)info.st_size < size) {
+        close(fd);
+        return nullptr;
+    }
+
+    void* mapping = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) return nullptr;
+
+    state_board* board = new state_board(mapping, size, false, name);
+    if (board->boardHeader->magic != STATE_BOARD_MAGIC || board->boardHeader->version != STATE_BOARD_VERSION
+        || board->boardHeader->slotCount != STATE_BOARD_SLOTS) {
+        delete board;
+        return nullptr;
+    }
+    return board;
+}
+
+state_board::entry* state_board::get_entry(uint32_t droneID) const {
+    uint32_t index = droneID & SHARD_SLOT_MASK;
+    if (index >= STATE_BOARD_SLOTS) return nullptr;
+    return &entries[index];
+}
+
+bool state_board::write(const state_board_snapshot& snapshot) {
+    entry* e = get_entry(snapshot.droneID);
+    if (e == nullptr) return false;
+
+    uint32_t sequence = e->sequence.load(std::memory_order_relaxed);
+    e->sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    e->data = snapshot;
+    e->active = 1;
+    e->sequence.store(sequence + 2, std::memory_order_release);
+    return true;
+}
+
+void state_board::clear(uint32_t droneID) {
+    entry* e = get_entry(droneID);
+    if (e == nullptr) return;
+
+    uint32_t sequence = e->sequence.load(std::memory_order_relaxed);
+    e->sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    e->active = 0;
+    e->sequence.store(sequence + 2, std::memory_order_release);
+}
+
+void state_board::advance_tick() {
+    boardHeader->tick.fetch_add(1, std::memory_order_release);
+}
+
+bool state_board::read(uint32_t droneID, state_board_snapshot& pSnapshot) const {
+    const entry* e = get_entry(droneID);
+    if (e == nullptr) return false;
+
+    for (int attempt = 0; attempt < STATE_BOARD_READ_RETRIES; attempt++) {
+        uint32_t before = e->sequence.load(std::memory_order_acquire);
+        if (before & 1u) continue;
+
+        uint32_t active = e->active;
+        memcpy(&pSnapshot, &e->data, sizeof(state_board_snapshot));
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        uint32_t after = e->sequence.load(std::memory_order_relaxed);
+        if (before == after) {
+            return active != 0 && pSnapshot.droneID == droneID;
+        }
+    }
+    return false;
+}
+
+bool state_board::is_alive() const {
+    return boardHeader->alive.load(std::memory_order_acquire) != 0;
+}
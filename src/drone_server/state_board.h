@@ -0,0 +1,129 @@
+#ifndef MULTI_DRONE_PLATFORM_STATE_BOARD_H
+#define MULTI_DRONE_PLATFORM_STATE_BOARD_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/**
+ * name of the POSIX shared memory object holding the state board, the boards of shards other than the first are
+ * suffixed with _<shard>
+ */
+#define STATE_BOARD_SHM_NAME "/mdp_state_board"
+
+/**
+ * identifies a valid state board and the layout version, bump STATE_BOARD_VERSION whenever state_board_entry changes
+ */
+#define STATE_BOARD_MAGIC 0x5342444du
+#define STATE_BOARD_VERSION 1u
+
+/**
+ * number of drone slots on the board. A drone is stored at the slot index of its id within its shard (see
+ * rigidbody_slot_map and shard_layout.h), drones whose slot index is beyond the board are not published
+ */
+#define STATE_BOARD_SLOTS 1024u
+
+/**
+ * the state of a single drone as published by the drone server. All positions are in meters in world coordinates.
+ */
+struct state_board_snapshot {
+    uint32_t droneID;
+    /* rigidbody flight state, matches mdp::drone_state */
+    uint32_t state;
+    /* time of the last motion capture frame in seconds, 0 if none has been received */
+    double poseStamp;
+    double position[3];
+    /* quaternion x, y, z, w */
+    double orientation[4];
+    double linearVelocity[3];
+    double angularVelocity[3];
+    double homePosition[3];
+};
+
+/**
+ * A table of drone states in POSIX shared memory, written by the drone server once per tick and read by user API
+ * programs on the same host without a ROS round trip. Each slot is guarded by a seqlock: the writer makes the sequence
+ * odd while it writes, and readers retry if the sequence was odd or changed while they copied the slot, so readers
+ * never block the writer.
+ */
+class state_board {
+public:
+    struct entry {
+        std::atomic<uint32_t> sequence;
+        uint32_t active;
+        state_board_snapshot data;
+    };
+
+    struct header {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t slotCount;
+        /* cleared when the drone server shuts down so that readers can tell the board is no longer maintained */
+        std::atomic<uint32_t> alive;
+        std::atomic<uint64_t> tick;
+    };
+
+    ~state_board();
+
+    /**
+     * creates (or recreates) the state board, should only be called by the drone server
+     * @param shard the drone server shard publishing to the board
+     * @return the board, or nullptr if shared memory could not be created
+     */
+    static state_board* create(uint32_t shard = 0);
+
+    /**
+     * maps an existing state board for reading
+     * @param shard the drone server shard whose board to map
+     * @return the board, or nullptr if there is no valid board on this host
+     */
+    static state_board* open(uint32_t shard = 0);
+
+    /**
+     * publishes the state of a drone
+     * @param snapshot the drone state, snapshot.droneID selects the slot
+     * @return false if the drone's slot is beyond the board
+     */
+    bool write(const state_board_snapshot& snapshot);
+
+    /**
+     * marks a drone's slot as no longer holding a drone
+     * @param droneID the id of the removed drone
+     */
+    void clear(uint32_t droneID);
+
+    /**
+     * advances the board's tick counter, called by the drone server once per loop after writing
+     */
+    void advance_tick();
+
+    /**
+     * copies the state of a drone out of the board without locking
+     * @param droneID the id of the drone
+     * @param pSnapshot the returned drone state
+     * @return false if the drone is not on the board (or its id is stale)
+     */
+    bool read(uint32_t droneID, state_board_snapshot& pSnapshot) const;
+
+    /**
+     * returns whether the drone server that created the board is still maintaining it
+     */
+    bool is_alive() const;
+
+private:
+    state_board(void* mapping, size_t size, bool owner, std::string name);
+
+    static size_t get_mapping_size();
+    static std::string get_shm_name(uint32_t shard);
+    entry* get_entry(uint32_t droneID) const;
+
+    void* mapping;
+    size_t mappingSize;
+    bool isOwner;
+    std::string shmName;
+    header* boardHeader;
+    entry* entries;
+};
+
+#endif //MULTI_DRONE_PLATFORM_STATE_BOARD_H
@@ -0,0 +1,77 @@
+#ifndef MULTI_DRONE_PLATFORM_TRIPLE_BUFFER_H
+#define MULTI_DRONE_PLATFORM_TRIPLE_BUFFER_H
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+/**
+ * A lock-free single writer, single reader buffer handing the latest value from a writer thread to a reader thread.
+ * The writer fills its back buffer and publishes it, the reader latches the most recently published buffer as its
+ * front buffer. Neither side ever waits on the other, and the front buffer does not change until the reader latches
+ * again, so everything the reader does between two latches sees the same value.
+ *
+ * Of the three buffers the writer owns one, the reader owns one, and the third (the most recently published) is held
+ * by the shared state, swapped in and out with a single atomic exchange.
+ */
+template <typename T>
+class triple_buffer {
+public:
+    triple_buffer() : sharedState(1), backIndex(0), frontIndex(2) {}
+
+    /**
+     * returns the writer's back buffer to fill before calling publish(), only to be called by the writer
+     */
+    T& get_back() {
+        return buffers[backIndex];
+    }
+
+    /**
+     * publishes the back buffer as the latest value and takes the buffer it replaces as the new back buffer, only to
+     * be called by the writer
+     */
+    void publish() {
+        uint8_t previous = sharedState.exchange(backIndex | NEW_VALUE_BIT, std::memory_order_acq_rel);
+        backIndex = previous & INDEX_MASK;
+    }
+
+    /**
+     * makes the latest published value the front buffer if one was published since the last latch, only to be called
+     * by the reader
+     * @return true if the front buffer changed
+     */
+    bool latch() {
+        if ((sharedState.load(std::memory_order_relaxed) & NEW_VALUE_BIT) == 0) return false;
+        uint8_t previous = sharedState.exchange(frontIndex, std::memory_order_acq_rel);
+        frontIndex = previous & INDEX_MASK;
+        return true;
+    }
+
+    /**
+     * returns the reader's front buffer, holding the value latched by the last call to latch()
+     */
+    const T& get_front() const {
+        return buffers[frontIndex];
+    }
+
+    /**
+     * returns the reader's front buffer to amend, only to be called by the reader. The amendment lasts until the next
+     * value is latched
+     */
+    T& get_front() {
+        return buffers[frontIndex];
+    }
+
+private:
+    static const uint8_t INDEX_MASK = 0x3;
+    static const uint8_t NEW_VALUE_BIT = 0x4;
+
+    std::array<T, 3> buffers;
+
+    /* index of the most recently published buffer, with NEW_VALUE_BIT set until the reader latches it */
+    std::atomic<uint8_t> sharedState;
+    uint8_t backIndex;
+    uint8_t frontIndex;
+};
+
+#endif //MULTI_DRONE_PLATFORM_TRIPLE_BUFFER_H
@@ -0,0 +1,96 @@
+#include "update_pool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <pthread.h>
+
+update_pool::update_pool(unsigned int workerCount) {
+    workerCount = std::max(workerCount, 1u);
+    loads.resize(workerCount);
+    workers.reserve(workerCount);
+    for (unsigned int i = 0; i < workerCount; i++) {
+        workers.emplace_back(&update_pool::worker_loop, this, i);
+    }
+}
+
+update_pool::~update_pool() {
+    {
+        std::lock_guard<std::mutex> lock(poolMutex);
+        shouldExit = true;
+    }
+    startCondition.notify_all();
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+void update_pool::run(size_t itemCount, const std::function<void(size_t)>& task) {
+    if (itemCount == 0) return;
+
+    std::unique_lock<std::mutex> lock(poolMutex);
+    currentTask = &task;
+    currentItemCount = itemCount;
+    nextItem.store(0, std::memory_order_relaxed);
+    workersRemaining = (unsigned int)workers.size();
+    generation++;
+    startCondition.notify_all();
+
+    /* barrier, wait for every worker to finish this generation */
+    doneCondition.wait(lock, [this] { return workersRemaining == 0; });
+    currentTask = nullptr;
+}
+
+unsigned int update_pool::get_worker_count() const {
+    return (unsigned int)workers.size();
+}
+
+int update_pool::set_scheduling(int policy, int priority) {
+    sched_param param = {};
+    param.sched_priority = priority;
+    for (auto& worker : workers) {
+        int error = pthread_setschedparam(worker.native_handle(), policy, &param);
+        if (error != 0) return error;
+    }
+    return 0;
+}
+
+std::vector<update_pool::worker_load> update_pool::take_worker_loads() {
+    /* workers only write to their load between a start and the barrier, so this is safe outside of run(..) */
+    std::vector<worker_load> ret = loads;
+    std::fill(loads.begin(), loads.end(), worker_load());
+    return ret;
+}
+
+void update_pool::worker_loop(unsigned int workerIndex) {
+    uint64_t lastGeneration = 0;
+    while (true) {
+        const std::function<void(size_t)>* task;
+        size_t itemCount;
+        {
+            std::unique_lock<std::mutex> lock(poolMutex);
+            startCondition.wait(lock, [&] { return shouldExit || generation != lastGeneration; });
+            if (shouldExit) return;
+            lastGeneration = generation;
+            task = currentTask;
+            itemCount = currentItemCount;
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        uint64_t updates = 0;
+        for (size_t i = nextItem.fetch_add(1); i < itemCount; i = nextItem.fetch_add(1)) {
+            (*task)(i);
+            updates++;
+        }
+        std::chrono::duration<double> busy = std::chrono::steady_clock::now() - start;
+        loads[workerIndex].busyTime += busy.count();
+        loads[workerIndex].updates += updates;
+
+        {
+            std::lock_guard<std::mutex> lock(poolMutex);
+            workersRemaining--;
+            if (workersRemaining == 0) {
+                doneCondition.notify_one();
+            }
+        }
+    }
+}
@@ -0,0 +1,89 @@
+#ifndef MULTI_DRONE_PLATFORM_UPDATE_POOL_H
+#define MULTI_DRONE_PLATFORM_UPDATE_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * A fixed pool of worker threads used by the drone server to run per-drone work, such as the update stage or an
+ * emergency, in parallel. Each call to run(..) hands out item indices to the workers and blocks until every item has
+ * been processed, acting as a barrier between the parallel stage and the remainder of the caller.
+ */
+class update_pool {
+public:
+    /**
+     * load information for a single worker, accumulated since the last call to take_worker_loads()
+     */
+    struct worker_load {
+        double busyTime = 0.0;
+        uint64_t updates = 0;
+    };
+
+    /**
+     * creates the pool and starts the given number of worker threads
+     * @param workerCount the number of worker threads to create (at least one worker is always created)
+     */
+    explicit update_pool(unsigned int workerCount);
+
+    /**
+     * stops and joins all worker threads
+     */
+    ~update_pool();
+
+    update_pool(const update_pool&) = delete;
+    update_pool& operator=(const update_pool&) = delete;
+
+    /**
+     * runs the given task once for every index in [0, itemCount) across the worker threads. This function does not
+     * return until every task has completed.
+     * @param itemCount the number of items to process
+     * @param task the task to run, called with the index of the item to process
+     */
+    void run(size_t itemCount, const std::function<void(size_t)>& task);
+
+    /**
+     * returns the number of worker threads in the pool
+     * @return the worker count
+     */
+    unsigned int get_worker_count() const;
+
+    /**
+     * sets the scheduling policy and priority of every worker thread, as with pthread_setschedparam
+     * @param policy the scheduling policy, e.g. SCHED_FIFO
+     * @param priority the priority within the given policy
+     * @return 0 if every worker was changed, otherwise the error of the first worker that could not be changed
+     */
+    int set_scheduling(int policy, int priority);
+
+    /**
+     * returns the load of each worker since the last call and resets the accumulated loads. Must be called from the
+     * same thread that calls run(..).
+     * @return a list of worker loads indexed by worker
+     */
+    std::vector<worker_load> take_worker_loads();
+
+private:
+    void worker_loop(unsigned int workerIndex);
+
+    std::vector<std::thread> workers;
+    std::vector<worker_load> loads;
+
+    std::mutex poolMutex;
+    std::condition_variable startCondition;
+    std::condition_variable doneCondition;
+
+    const std::function<void(size_t)>* currentTask = nullptr;
+    size_t currentItemCount = 0;
+    std::atomic<size_t> nextItem{0};
+
+    uint64_t generation = 0;
+    unsigned int workersRemaining = 0;
+    bool shouldExit = false;
+};
+
+#endif //MULTI_DRONE_PLATFORM_UPDATE_POOL_H
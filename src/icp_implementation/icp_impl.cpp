@@ -1,6 +1,7 @@
 #include "icp_impl.h"
 #include <Eigen/Dense>
 #include <Eigen/Eigenvalues>
+#include "../debug/tracer/tracer.h"
 
 icp_impl::icp_impl(const std::vector<rigidbody *> *rigidbodyListPtr, ros::NodeHandle& nodeHandle) {
     this->rigidbodyList = rigidbodyListPtr;
@@ -11,6 +12,7 @@ icp_impl::~icp_impl() = default;
 
 void icp_impl::marker_cloud_callback(const visualization_msgs::Marker::ConstPtr& msg)
 {
+    MDP_TRACE_SCOPE("icp_impl::marker_cloud_callback");
     // premake the stamped header
     std_msgs::Header premadeHeader;
     premadeHeader.stamp = ros::Time::now();
@@ -19,11 +21,6 @@ void icp_impl::marker_cloud_callback(const visualization_msgs::Marker::ConstPtr&
     kd_tree_3d pointCloudTree(msg->points);
 
     for (auto rigidbody : *this->rigidbodyList) {
-        // if this rigidbody does not exist (deleted or uninitialised), ignore it
-        if (rigidbody == nullptr) {
-            continue;
-        }
-
         // ignore vflies (special case, vflies produce their own poses)
         // comment this out to test ICP using a vflie, also enable publishing of markers from vflie
         if (rigidbody->isVflie) {
@@ -7,6 +7,9 @@
 
 class icp_impl {
 public:
+    /**
+     * @param rigidbodyListPtr the live rigidbodies of the drone server, packed without null entries
+     */
     explicit icp_impl(const std::vector<rigidbody*>* rigidbodyListPtr, ros::NodeHandle& nodeHandle);
     ~icp_impl();
 
@@ -1,17 +1,40 @@
 #include "user_api.h"
 
 #include "ros/ros.h"
-#include "boost/algorithm/string/split.hpp"
+#include "boost/bind.hpp"
 #include <unordered_map>
 #include <ros/callback_queue.h>
 
 #include "../drone_server/drone_server_msg_translations.cpp"
 
 #include "../drone_server/element_conversions.cpp"
+#include "../drone_server/state_board.h"
+#include "../drone_server/command_trace.h"
+#include "../drone_server/shard_layout.h"
 #include "geometry_msgs/TwistStamped.h"
+#include "multi_drone_platform/api_command.h"
+#include "multi_drone_platform/api_batch.h"
+#include "multi_drone_platform/api_batch_result.h"
+#include "multi_drone_platform/state_event.h"
+#include "multi_drone_platform/list_drones.h"
+#include "multi_drone_platform/membership_event.h"
+#include <algorithm>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <unistd.h>
 
 #define FRAME_ID "user_api"
 
+/* number of received batch results kept before the oldest are discarded */
+#define MAX_BATCH_RESULTS 64
+
+/* how often to retry mapping the drone server's state board when it is not available, in seconds */
+#define STATE_BOARD_RETRY_PERIOD 1.0
+
+/* how long to wait for the latched state event of a drone that has not been watched before, in seconds */
+#define STATE_EVENT_TIMEOUT 1.0
+
 
 namespace mdp {
 
@@ -41,6 +64,30 @@ struct drone_data {
     }
 };
 
+/**
+ * the connection to a single drone server shard, an unsharded drone server is shard 0
+ */
+struct shard_link {
+    ros::Publisher publisher;
+    ros::Publisher batchPublisher;
+    ros::ServiceClient dataClient;
+    ros::ServiceClient listClient;
+    ros::Subscriber batchResultSubscriber;
+    ros::Subscriber membershipSubscriber;
+
+    /**
+     * the shard's shared memory state board, null when the shard is not on this host
+     */
+    std::unique_ptr<state_board> stateBoard;
+    ros::WallTime lastStateBoardAttempt;
+
+    /**
+     * the membership version of the shard's drones in the cached drone list, see node_data::members
+     */
+    uint32_t membershipVersion = 0;
+    bool membershipStale = true;
+};
+
 /**
  * persistent memory structure used internally, constructed with call to initialise(), destructed
  * with call to terminate()
@@ -48,11 +95,139 @@ struct drone_data {
 struct node_data {
     ros::NodeHandle* node;
     ros::Rate* loopRate;
-    ros::Publisher publisher;
-    ros::ServiceClient dataClient;
-    ros::ServiceClient listClient;
     std::unordered_map<uint32_t, drone_data> droneData;
     ros::CallbackQueue asyncCallbackQueue;
+
+    /**
+     * the drone server shards indexed by shard, commands and requests for a drone are routed to the shard owning it
+     */
+    std::vector<shard_link> shards;
+
+    uint32_t nextBatchID = 0;
+
+    /* ids given to traced commands, unique per process like batch ids */
+    uint64_t nextCommandID = 0;
+    std::map<uint32_t, batch_result> batchResults;
+
+    /**
+     * the number of shard results still to be received for each batch sent by this program that spans several shards
+     */
+    std::map<uint32_t, uint32_t> pendingBatchShards;
+
+    /**
+     * returns the shard owning a drone
+     * @param droneID the drone
+     */
+    shard_link& get_shard(uint32_t droneID) {
+        uint32_t shard = shard_layout::get_shard(droneID);
+        return shards[(shard < shards.size()) ? shard : 0];
+    }
+
+    /**
+     * subscriptions to the drones' latched state event topics, made on first use. State events have their own callback
+     * queue so that waiting on it is only woken by state changes
+     */
+    struct state_watch {
+        ros::Subscriber subscriber;
+        multi_drone_platform::state_event::ConstPtr last;
+    };
+    std::unordered_map<uint32_t, state_watch> stateWatches;
+    ros::CallbackQueue stateQueue;
+
+    /**
+     * the cached list of drones on the drone server, kept up to date by the membership events of each shard. A shard's
+     * drones are refreshed through its list service when one of its events has been missed
+     */
+    std::vector<mdp::id> members;
+
+    /**
+     * adds a drone to the cached list and subscribes to its pose and velocity
+     * @param pDroneID the drone
+     */
+    void add_member(const mdp::id& pDroneID) {
+        members.push_back(pDroneID);
+
+        auto id = pDroneID.numericID;
+        if (droneData.count(id) == 0) {
+            /* create drone_data struct and init ros Subscribers */
+            droneData[id] = {};
+
+            droneData[id].poseSubscriber = node->subscribe<geometry_msgs::PoseStamped>(
+                "mdp/drone_" + std::to_string(id) + "/curr_pose",
+                1, 
+                &drone_data::pose_callback, 
+                &droneData[id]);
+
+            droneData[id].twistSubscriber = node->subscribe<geometry_msgs::TwistStamped>(
+                "mdp/drone_" + std::to_string(id) + "/curr_twist",
+                1, 
+                &drone_data::twist_callback, 
+                &droneData[id]);
+        }
+    }
+
+    /**
+     * callback for the drone server's membership changes
+     * @param msg
+     */
+    void membership_callback(const multi_drone_platform::membership_event::ConstPtr& msg) {
+        shard_link& shard = get_shard(msg->droneID);
+        if (shard.membershipStale || msg->version != shard.membershipVersion + 1) {
+            /* older and repeated events are already part of the cached list, newer ones mean an event was missed */
+            if (msg->version != shard.membershipVersion) shard.membershipStale = true;
+            return;
+        }
+
+        shard.membershipVersion = msg->version;
+        if (msg->change == multi_drone_platform::membership_event::ADDED) {
+            mdp::id newId;
+            newId.numericID = msg->droneID;
+            newId.name = msg->tag;
+            add_member(newId);
+        } else {
+            for (auto it = members.begin(); it != members.end(); it++) {
+                if (it->numericID == msg->droneID) {
+                    members.erase(it);
+                    break;
+                }
+            }
+            droneData.erase(msg->droneID);
+        }
+    }
+
+    /**
+     * callback for a drone's state change events
+     * @param msg
+     */
+    void state_callback(const multi_drone_platform::state_event::ConstPtr& msg) {
+        state_watch& watch = stateWatches[msg->droneID];
+        /* a reconnect can redeliver the latched event, only keep the newest */
+        if (!watch.last || msg->sequence > watch.last->sequence || msg->stamp > watch.last->stamp) {
+            watch.last = msg;
+        }
+    }
+
+    /**
+     * callback for the drone server's response to command batches
+     * @param msg
+     */
+    void batch_result_callback(const multi_drone_platform::api_batch_result::ConstPtr& msg) {
+        /* a batch spanning several shards gets a result from each, which are summed */
+        batch_result& result = batchResults[msg->batchID];
+        result.batchID = msg->batchID;
+        result.accepted += msg->accepted;
+        result.rejected += msg->rejected;
+        result.rejectedIDs.insert(result.rejectedIDs.end(), msg->rejectedIDs.begin(), msg->rejectedIDs.end());
+
+        auto pending = pendingBatchShards.find(msg->batchID);
+        if (pending != pendingBatchShards.end() && --pending->second == 0) {
+            pendingBatchShards.erase(pending);
+        }
+        while (batchResults.size() > MAX_BATCH_RESULTS) {
+            pendingBatchShards.erase(batchResults.begin()->first);
+            batchResults.erase(batchResults.begin());
+        }
+    }
 }* nodeData;
 
 void initialise(double pUpdateRate, std::string nodeName) {
@@ -65,12 +240,30 @@ void initialise(double pUpdateRate, std::string nodeName) {
     nodeData->node = new ros::NodeHandle();
     nodeData->loopRate = new ros::Rate(pUpdateRate);
 
-    nodeData->publisher = nodeData->node->advertise<geometry_msgs::TransformStamped> ("mdp", 100);
-    nodeData->dataClient = nodeData->node->serviceClient<nav_msgs::GetPlan> ("mdp_data_srv");
-    nodeData->listClient = nodeData->node->serviceClient<tf2_msgs::FrameGraph> ("mdp_list_srv");
+    int shardCount = 1;
+    nodeData->node->param<int>(SHARD_COUNT_PARAM, shardCount, 1);
+    nodeData->shards.resize((size_t)std::max(shardCount, 1));
+    for (uint32_t s = 0; s < nodeData->shards.size(); s++) {
+        shard_link& shard = nodeData->shards[s];
+        shard.publisher = nodeData->node->advertise<multi_drone_platform::api_command> (shard_layout::get_topic(s, "mdp_command"), 100);
+        shard.dataClient = nodeData->node->serviceClient<nav_msgs::GetPlan> (shard_layout::get_topic(s, "mdp_data_srv"));
+        shard.listClient = nodeData->node->serviceClient<multi_drone_platform::list_drones> (shard_layout::get_topic(s, "mdp_list_srv"));
+        shard.batchPublisher = nodeData->node->advertise<multi_drone_platform::api_batch> (shard_layout::get_topic(s, "mdp_batch"), 100);
+    }
+
+    /* batch results are shared by every user program, start from a per-process id to avoid clashes */
+    nodeData->nextBatchID = (uint32_t)getpid() << 16;
+    nodeData->nextCommandID = ((uint64_t)getpid() << 32) | 1;
 
     sleep(1);
     nodeData->node->setCallbackQueue(&nodeData->asyncCallbackQueue);
+    for (uint32_t s = 0; s < nodeData->shards.size(); s++) {
+        shard_link& shard = nodeData->shards[s];
+        shard.batchResultSubscriber = nodeData->node->subscribe<multi_drone_platform::api_batch_result>(
+            shard_layout::get_topic(s, "mdp_batch_result"), 100, &node_data::batch_result_callback, nodeData);
+        shard.membershipSubscriber = nodeData->node->subscribe<multi_drone_platform::membership_event>(
+            shard_layout::get_topic(s, "mdp_membership"), 100, &node_data::membership_callback, nodeData);
+    }
     get_all_rigidbodies();
 
     ROS_INFO("Initialised Client API Connection");
@@ -82,7 +275,7 @@ void terminate(bool land_drones) {
     if (land_drones) {
         auto drones = get_all_rigidbodies();
         for (size_t i = 0; i < drones.size(); i++) {
-            if (get_state({static_cast<uint32_t>(i), ""}) != drone_state::LANDED)
+            if (get_state(drones[i]) != drone_state::LANDED)
                 cmd_land(drones[i]);
         }
         for (const auto &drone : drones) {
@@ -91,6 +284,9 @@ void terminate(bool land_drones) {
     }
 
     nodeData->droneData.clear();
+    nodeData->shards.clear();
+    nodeData->stateWatches.clear();
+    nodeData->stateQueue.disable();
     nodeData->asyncCallbackQueue.disable();
 
     ROS_INFO("Finished Client API Connection");
@@ -100,92 +296,183 @@ void terminate(bool land_drones) {
     ros::shutdown();
 }
 
-std::vector<mdp::id> get_all_rigidbodies() {
-    tf2_msgs::FrameGraph srvData;
-
-    std::vector<mdp::id> vec;
-    if (nodeData->listClient.call(srvData)) {
-        std::vector<std::string> results;
-        boost::split(results, srvData.response.frame_yaml, [](char c){return c == ' ';});
-
-        for (std::string& str : results) {
-            if (str.length() > 0) {
-                std::vector<std::string> idStr;
-                boost::split(idStr, str, [](char c){return c == ':';});
-                mdp::id newId;
-                newId.numericID = atoi(idStr[0].c_str());
-                newId.name = idStr[1];
-                vec.push_back(newId);
-            }
-        }
+/**
+ * replaces a shard's drones in the cached drone list with the shard's list if its membership version has changed
+ * @param shardIndex the shard
+ * @return false if the shard's list service could not be called
+ */
+bool refresh_shard_members(uint32_t shardIndex) {
+    shard_link& shard = nodeData->shards[shardIndex];
+    multi_drone_platform::list_drones srvData;
+    srvData.request.knownVersion = shard.membershipVersion;
+    if (!shard.listClient.call(srvData)) {
+        return false;
+    }
 
-        // add drone data for each drone
-        for (size_t i = 0; i < vec.size(); i++) {
-            auto id = vec[i].numericID;
-            if (nodeData->droneData.count(id) == 0) {
-                /* create drone_data struct and init ros Subscribers */
-                nodeData->droneData[id] = {};
-
-                nodeData->droneData[id].poseSubscriber = nodeData->node->subscribe<geometry_msgs::PoseStamped>(
-                    "mdp/drone_" + std::to_string(id) + "/curr_pose",
-                    1, 
-                    &drone_data::pose_callback, 
-                    &nodeData->droneData[id]);
-
-                nodeData->droneData[id].twistSubscriber = nodeData->node->subscribe<geometry_msgs::TwistStamped>(
-                    "mdp/drone_" + std::to_string(id) + "/curr_twist",
-                    1, 
-                    &drone_data::twist_callback, 
-                    &nodeData->droneData[id]);
+    shard.membershipStale = false;
+    if (!srvData.response.changed) return true;
+
+    shard.membershipVersion = srvData.response.version;
+    auto& members = nodeData->members;
+    members.erase(std::remove_if(members.begin(), members.end(), [shardIndex](const mdp::id& member) {
+        return shard_layout::get_shard(member.numericID) == shardIndex;
+    }), members.end());
+    for (size_t i = 0; i < srvData.response.droneIDs.size() && i < srvData.response.tags.size(); i++) {
+        mdp::id newId;
+        newId.numericID = srvData.response.droneIDs[i];
+        newId.name = srvData.response.tags[i];
+        nodeData->add_member(newId);
+    }
+
+    /* drop the data of drones that are no longer on the server */
+    for (auto it = nodeData->droneData.begin(); it != nodeData->droneData.end();) {
+        bool isMember = false;
+        for (const auto& member : members) {
+            if (member.numericID == it->first) {
+                isMember = true;
+                break;
             }
         }
-    } else {
-        ROS_WARN("Failed to call api list service");
+        it = isMember ? std::next(it) : nodeData->droneData.erase(it);
     }
-
-    return vec;
+    return true;
 }
 
-double encode_relative_array_to_double(bool relative, bool keepHeight) {
-    return ((1.0 * relative) + (2.0 * keepHeight));
+/**
+ * refreshes the cached drones of every shard that has missed a membership event
+ * @return false if a shard's list service could not be called
+ */
+bool refresh_members() {
+    bool refreshed = true;
+    for (uint32_t s = 0; s < nodeData->shards.size(); s++) {
+        if (nodeData->shards[s].membershipStale && !refresh_shard_members(s)) {
+            refreshed = false;
+        }
+    }
+    return refreshed;
 }
 
-void set_drone_velocity(const mdp::id& pDroneID, mdp::velocity_msg pMsg) {
-    geometry_msgs::TransformStamped msgData;
-    mdp_translations::input_msg inputMsg(&msgData);
+std::vector<mdp::id> get_all_rigidbodies() {
+    /* apply any membership events received since the last call */
+    nodeData->asyncCallbackQueue.callAvailable();
 
-    inputMsg.drone_id().numeric_id() = pDroneID.numericID;
-    inputMsg.msg_type() = "VELOCITY";
+    if (!refresh_members()) {
+        ROS_WARN("Failed to call api list service");
+        return {};
+    }
+    return nodeData->members;
+}
 
-    inputMsg.pos_vel().x = pMsg.velocity[0];
-    inputMsg.pos_vel().y = pMsg.velocity[1];
-    inputMsg.pos_vel().z = pMsg.velocity[2];
-    inputMsg.yaw_rate() = pMsg.yawRate;
-    inputMsg.duration() = pMsg.duration;
-    inputMsg.relative() = encode_relative_array_to_double(pMsg.relative, pMsg.keepHeight);
+/**
+ * publishes a command to the drone server as a versioned api_command
+ * @param droneID the id of the drone the command is for
+ * @param command the command
+ */
+void publish_command(uint32_t droneID, const multi_drone_platform::api_update& command) {
+    multi_drone_platform::api_command msgData;
+    msgData.version = multi_drone_platform::api_command::VERSION;
+    msgData.droneID = droneID;
+    msgData.command = command;
+    msgData.command.commandID = nodeData->nextCommandID++;
+    msgData.command.sentStamp = command_trace::now_ns();
+    msgData.command.clockID = command_trace::clock_id();
+
+    if (command.opcode == multi_drone_platform::api_update::DRONE_SERVER_FREQ) {
+        /* drone server commands apply to every shard */
+        for (auto& shard : nodeData->shards) {
+            shard.publisher.publish(msgData);
+        }
+        return;
+    }
+    nodeData->get_shard(droneID).publisher.publish(msgData);
+}
 
-    nodeData->publisher.publish(msgData);
+void set_drone_velocity(const mdp::id& pDroneID, mdp::velocity_msg pMsg) {
+    multi_drone_platform::api_update msg;
+    msg.opcode = multi_drone_platform::api_update::VELOCITY;
+
+    msg.posVel.x = pMsg.velocity[0];
+    msg.posVel.y = pMsg.velocity[1];
+    msg.posVel.z = pMsg.velocity[2];
+    msg.yawVal = pMsg.yawRate;
+    msg.duration = pMsg.duration;
+    msg.relativeXY = pMsg.relative;
+    msg.relativeZ = pMsg.keepHeight;
+
+    publish_command(pDroneID.numericID, msg);
 }
 
 void set_drone_position(const mdp::id& pDroneID, mdp::position_msg pMsg) {
-    geometry_msgs::TransformStamped msgData;
-    mdp_translations::input_msg inputMsg(&msgData);
+    multi_drone_platform::api_update msg;
+    msg.opcode = multi_drone_platform::api_update::POSITION;
+
+    msg.posVel.x = pMsg.position[0];
+    msg.posVel.y = pMsg.position[1];
+    msg.posVel.z = pMsg.position[2];
+    msg.duration = pMsg.duration;
+    msg.yawVal = pMsg.yaw;
+    msg.relativeXY = pMsg.relative;
+    msg.relativeZ = pMsg.keepHeight;
+
+    publish_command(pDroneID.numericID, msg);
+}
+
+/**
+ * returns the state board of the shard owning a drone, mapping it if it is not yet mapped or the shard has restarted
+ * @param droneID the drone
+ * @return the state board, or null if it is not available on this host
+ */
+state_board* get_state_board(uint32_t droneID) {
+    uint32_t shardIndex = shard_layout::get_shard(droneID);
+    if (shardIndex >= nodeData->shards.size()) return nullptr;
 
-    inputMsg.drone_id().numeric_id() = pDroneID.numericID;
-    inputMsg.msg_type() = "POSITION";
+    shard_link& shard = nodeData->shards[shardIndex];
+    if (shard.stateBoard && shard.stateBoard->is_alive()) {
+        return shard.stateBoard.get();
+    }
 
-    inputMsg.pos_vel().x  = pMsg.position[0];
-    inputMsg.pos_vel().y  = pMsg.position[1];
-    inputMsg.pos_vel().z  = pMsg.position[2];
-    inputMsg.duration()  = pMsg.duration;
-    inputMsg.yaw()       = pMsg.yaw;
-    inputMsg.relative()  = encode_relative_array_to_double(pMsg.relative, pMsg.keepHeight);
+    ros::WallTime now = ros::WallTime::now();
+    if (shard.lastStateBoardAttempt.isZero() || (now - shard.lastStateBoardAttempt).toSec() > STATE_BOARD_RETRY_PERIOD) {
+        shard.lastStateBoardAttempt = now;
+        shard.stateBoard.reset(state_board::open(shardIndex));
+        if (shard.stateBoard && shard.stateBoard->is_alive()) {
+            return shard.stateBoard.get();
+        }
+    }
+    return nullptr;
+}
 
-    nodeData->publisher.publish(msgData);
+/**
+ * reads a drone's state from the state board
+ * @param pRigidbodyID the drone
+ * @param pSnapshot the returned drone state
+ * @return false if the state board is not available or does not hold the drone
+ */
+bool read_state_board(const mdp::id& pRigidbodyID, state_board_snapshot& pSnapshot) {
+    state_board* board = get_state_board(pRigidbodyID.numericID);
+    return (board != nullptr) && board->read(pRigidbodyID.numericID, pSnapshot);
 }
 
 position_data get_position(const mdp::id& pRigidbodyID) {
     position_data data;
+
+    state_board_snapshot snapshot;
+    if (read_state_board(pRigidbodyID, snapshot)) {
+        geometry_msgs::Pose pose;
+        pose.orientation.x = snapshot.orientation[0];
+        pose.orientation.y = snapshot.orientation[1];
+        pose.orientation.z = snapshot.orientation[2];
+        pose.orientation.w = snapshot.orientation[3];
+
+        data.respectiveID =     pRigidbodyID;
+        data.timeStampSec =     (float)snapshot.poseStamp;
+        data.x =                snapshot.position[0];
+        data.y =                snapshot.position[1];
+        data.z =                snapshot.position[2];
+        data.yaw =              mdp_conversions::get_yaw_from_pose(pose);
+        return data;
+    }
+
     // if the drone id does not exist, return
     // @TODO: make this a value you can check for validity
     if (nodeData->droneData.count(pRigidbodyID.numericID) == 0) return data;
@@ -205,6 +492,18 @@ position_data get_position(const mdp::id& pRigidbodyID) {
 
 velocity_data get_velocity(const mdp::id& pRigidbodyID) {
     velocity_data data;
+
+    state_board_snapshot snapshot;
+    if (read_state_board(pRigidbodyID, snapshot)) {
+        data.respectiveID =     pRigidbodyID;
+        data.timeStampSec =     (float)snapshot.poseStamp;
+        data.x =                snapshot.linearVelocity[0];
+        data.y =                snapshot.linearVelocity[1];
+        data.z =                snapshot.linearVelocity[2];
+        data.yawRate =          snapshot.angularVelocity[1];
+        return data;
+    }
+
     // if the drone id does not exist, return
     if (nodeData->droneData.count(pRigidbodyID.numericID) == 0) return data;
 
@@ -222,65 +521,51 @@ velocity_data get_velocity(const mdp::id& pRigidbodyID) {
 }
 
 void cmd_takeoff(const mdp::id& pDroneID, float pHeight, float pDuration) {
-    geometry_msgs::TransformStamped msgData;
-    mdp_translations::input_msg inputMsg(&msgData);
+    multi_drone_platform::api_update msg;
+    msg.opcode = multi_drone_platform::api_update::TAKEOFF;
+    msg.posVel.z = pHeight;
+    msg.duration = pDuration;
 
-    inputMsg.drone_id().numeric_id() = pDroneID.numericID;
-    inputMsg.msg_type() = "TAKEOFF";
-    inputMsg.pos_vel().z = pHeight;
-    inputMsg.duration() = pDuration;
-
-    nodeData->publisher.publish(msgData);
+    publish_command(pDroneID.numericID, msg);
 }
 
 void cmd_land(const mdp::id& pDroneID, float duration) {
-    geometry_msgs::TransformStamped msgData;
-    mdp_translations::input_msg inputMsg(&msgData);
-
-    inputMsg.drone_id().numeric_id() = pDroneID.numericID;
-    inputMsg.msg_type() = "LAND";
-    inputMsg.duration() = duration;
+    multi_drone_platform::api_update msg;
+    msg.opcode = multi_drone_platform::api_update::LAND;
+    msg.duration = duration;
 
-    nodeData->publisher.publish(msgData);
+    publish_command(pDroneID.numericID, msg);
 }
 
 void cmd_emergency(const mdp::id& pDroneID) {
-    geometry_msgs::TransformStamped msgData;
-    mdp_translations::input_msg inputMsg(&msgData);
-
-    inputMsg.drone_id().numeric_id() = pDroneID.numericID;
-    inputMsg.msg_type() = "EMERGENCY";
+    multi_drone_platform::api_update msg;
+    msg.opcode = multi_drone_platform::api_update::EMERGENCY;
 
-    nodeData->publisher.publish(msgData);
+    publish_command(pDroneID.numericID, msg);
 }
 
 void cmd_hover(const mdp::id& pDroneID, float duration) {
-    geometry_msgs::TransformStamped msgData;
-    mdp_translations::input_msg inputMsg(&msgData);
+    multi_drone_platform::api_update msg;
+    msg.opcode = multi_drone_platform::api_update::HOVER;
+    msg.duration = duration;
 
-    inputMsg.drone_id().numeric_id() = pDroneID.numericID;
-    inputMsg.msg_type() = "HOVER";
-    inputMsg.duration() = duration;
-
-    nodeData->publisher.publish(msgData);
+    publish_command(pDroneID.numericID, msg);
 }
 
 
 void set_home(const mdp::id& pDroneID, mdp::position_msg pMsg) {
-    geometry_msgs::TransformStamped msgData;
-    mdp_translations::input_msg inputMsg(&msgData);
-
-    inputMsg.drone_id().numeric_id() = pDroneID.numericID;
-    inputMsg.msg_type() = "SET_HOME";
+    multi_drone_platform::api_update msg;
+    msg.opcode = multi_drone_platform::api_update::SET_HOME;
 
-    inputMsg.pos_vel().x = pMsg.position[0];
-    inputMsg.pos_vel().y = pMsg.position[1];
-    inputMsg.pos_vel().z = pMsg.position[2];
+    msg.posVel.x = pMsg.position[0];
+    msg.posVel.y = pMsg.position[1];
+    msg.posVel.z = pMsg.position[2];
 
-    inputMsg.relative() = encode_relative_array_to_double(pMsg.relative, pMsg.keepHeight);
-    inputMsg.yaw() = pMsg.yaw;
+    msg.relativeXY = pMsg.relative;
+    msg.relativeZ = pMsg.keepHeight;
+    msg.yawVal = pMsg.yaw;
 
-    nodeData->publisher.publish(msgData);
+    publish_command(pDroneID.numericID, msg);
 }
 
 position_data get_home(const mdp::id& pDroneID) {
@@ -295,7 +580,17 @@ position_data get_home(const mdp::id& pDroneID) {
 
     position_data posData;
     posData.respectiveID = pDroneID;
-    if (nodeData->dataClient.call(srvData)) {
+
+    state_board_snapshot snapshot;
+    if (read_state_board(pDroneID, snapshot)) {
+        posData.timeStampSec = ros::Time::now().toSec();
+        posData.x = snapshot.homePosition[0];
+        posData.y = snapshot.homePosition[1];
+        posData.z = snapshot.homePosition[2];
+        return posData;
+    }
+
+    if (nodeData->get_shard(pDroneID.numericID).dataClient.call(srvData)) {
         posData.timeStampSec = ros::Time::now().toSec();
         posData.x = feedbackSrv.vec3().x;
         posData.y = feedbackSrv.vec3().y;
@@ -308,28 +603,158 @@ position_data get_home(const mdp::id& pDroneID) {
 }
 
 void go_to_home(const mdp::id& pDroneID, float duration, float pHeight) {
-    geometry_msgs::TransformStamped msgData;
-    mdp_translations::input_msg inputMsg(&msgData);
+    multi_drone_platform::api_update msg;
+    msg.opcode = multi_drone_platform::api_update::GOTO_HOME;
+    msg.posVel.z = pHeight;
+    msg.yawVal = 0.0f;
+    msg.duration = duration;
+
+    msg.relativeXY = false;
+    msg.relativeZ = (pHeight < 0.0f);
+
+    publish_command(pDroneID.numericID, msg);
+}
 
-    inputMsg.drone_id().numeric_id() = pDroneID.numericID;
-    inputMsg.msg_type() = "GOTO_HOME";
-    inputMsg.pos_vel().z = pHeight;
-    inputMsg.yaw() = 0.0f;
-    inputMsg.duration() = duration;
+command_batch::command& command_batch::add(const mdp::id& pDroneID, uint8_t pOpcode) {
+    commands.emplace_back();
+    commands.back().droneID = pDroneID.numericID;
+    commands.back().opcode = pOpcode;
+    return commands.back();
+}
+
+void command_batch::set_drone_velocity(const mdp::id& pDroneID, mdp::velocity_msg pMsg) {
+    command& cmd = this->add(pDroneID, multi_drone_platform::api_update::VELOCITY);
+    cmd.posVel = pMsg.velocity;
+    cmd.yaw = pMsg.yawRate;
+    cmd.duration = pMsg.duration;
+    cmd.relativeXY = pMsg.relative;
+    cmd.relativeZ = pMsg.keepHeight;
+}
 
-    inputMsg.relative() = encode_relative_array_to_double(false, (pHeight < 0.0f));
+void command_batch::set_drone_position(const mdp::id& pDroneID, mdp::position_msg pMsg) {
+    command& cmd = this->add(pDroneID, multi_drone_platform::api_update::POSITION);
+    cmd.posVel = pMsg.position;
+    cmd.yaw = pMsg.yaw;
+    cmd.duration = pMsg.duration;
+    cmd.relativeXY = pMsg.relative;
+    cmd.relativeZ = pMsg.keepHeight;
+}
+
+void command_batch::cmd_takeoff(const mdp::id& pDroneID, float pHeight, float pDuration) {
+    command& cmd = this->add(pDroneID, multi_drone_platform::api_update::TAKEOFF);
+    cmd.posVel[2] = pHeight;
+    cmd.duration = pDuration;
+}
 
-    nodeData->publisher.publish(msgData);
+void command_batch::cmd_land(const mdp::id& pDroneID, float duration) {
+    this->add(pDroneID, multi_drone_platform::api_update::LAND).duration = duration;
+}
+
+void command_batch::cmd_emergency(const mdp::id& pDroneID) {
+    this->add(pDroneID, multi_drone_platform::api_update::EMERGENCY);
+}
+
+void command_batch::cmd_hover(const mdp::id& pDroneID, float duration) {
+    this->add(pDroneID, multi_drone_platform::api_update::HOVER).duration = duration;
+}
+
+void command_batch::go_to_home(const mdp::id& pDroneID, float duration, float pHeight) {
+    command& cmd = this->add(pDroneID, multi_drone_platform::api_update::GOTO_HOME);
+    cmd.posVel[2] = pHeight;
+    cmd.duration = duration;
+    cmd.relativeZ = (pHeight < 0.0f);
+}
+
+void command_batch::clear() {
+    commands.clear();
+}
+
+size_t command_batch::size() const {
+    return commands.size();
+}
+
+const std::vector<command_batch::command>& command_batch::get_commands() const {
+    return commands;
+}
+
+uint32_t send_command_batch(const mdp::command_batch& batch) {
+    /* a batch id of 0 marks a result that has not been received */
+    if (nodeData->nextBatchID == 0) nodeData->nextBatchID++;
+    uint32_t batchID = nodeData->nextBatchID++;
+
+    /* the batch is split into one message per shard, each shard reports its part of the result */
+    std::vector<multi_drone_platform::api_batch> shardBatches(nodeData->shards.size());
+    auto& commands = batch.get_commands();
+    for (size_t i = 0; i < commands.size(); i++) {
+        uint32_t shard = shard_layout::get_shard(commands[i].droneID);
+        multi_drone_platform::api_batch& msgData = shardBatches[(shard < shardBatches.size()) ? shard : 0];
+        msgData.droneIDs.push_back(commands[i].droneID);
+        msgData.commands.emplace_back();
+
+        multi_drone_platform::api_update& msg = msgData.commands.back();
+        msg.opcode      = commands[i].opcode;
+        msg.posVel.x    = commands[i].posVel[0];
+        msg.posVel.y    = commands[i].posVel[1];
+        msg.posVel.z    = commands[i].posVel[2];
+        msg.yawVal      = commands[i].yaw;
+        msg.duration    = commands[i].duration;
+        msg.relativeXY  = commands[i].relativeXY;
+        msg.relativeZ   = commands[i].relativeZ;
+        msg.commandID   = nodeData->nextCommandID++;
+    }
+
+    uint32_t shardsSent = 0;
+    uint64_t sent = command_trace::now_ns();
+    for (size_t s = 0; s < shardBatches.size(); s++) {
+        multi_drone_platform::api_batch& msgData = shardBatches[s];
+        /* an empty batch still goes to the first shard so that every batch gets a result */
+        if (msgData.commands.empty() && (s > 0 || commands.size() > 0)) continue;
+
+        msgData.batchID = batchID;
+        for (auto& msg : msgData.commands) {
+            msg.sentStamp = sent;
+            msg.clockID = command_trace::clock_id();
+        }
+        nodeData->shards[s].batchPublisher.publish(msgData);
+        shardsSent++;
+    }
+    if (shardsSent > 1) {
+        nodeData->pendingBatchShards[batchID] = shardsSent;
+    }
+    return batchID;
+}
+
+batch_result get_command_batch_result(uint32_t batchID) {
+    nodeData->asyncCallbackQueue.callAvailable();
+
+    auto it = nodeData->batchResults.find(batchID);
+    if (it == nodeData->batchResults.end() || nodeData->pendingBatchShards.count(batchID) > 0) return batch_result{};
+
+    batch_result result = it->second;
+    nodeData->batchResults.erase(it);
+    return result;
 }
 
 void set_drone_server_update_frequency(float pUpdateFrequency) {
-    geometry_msgs::TransformStamped msgData;
-    mdp_translations::input_msg inputMsg(&msgData);
+    multi_drone_platform::api_update msg;
+    msg.opcode = multi_drone_platform::api_update::DRONE_SERVER_FREQ;
+    msg.posVel.x = pUpdateFrequency;
 
-    inputMsg.msg_type() = "DRONE_SERVER_FREQ";
-    inputMsg.pos_vel().x = pUpdateFrequency;
+    publish_command(0, msg);
+}
 
-    nodeData->publisher.publish(msgData);
+timing_distribution decode_timing_distribution(mdp_translations::drone_feedback_srv& feedbackSrv, size_t index) {
+    timing_distribution distribution;
+    if (!feedbackSrv.has_histogram(index)) return distribution;
+
+    auto& histogram = feedbackSrv.histogram(index);
+    distribution.p50 = histogram.position.x;
+    distribution.p99 = histogram.position.y;
+    distribution.p999 = histogram.position.z;
+    distribution.max = histogram.orientation.x;
+    distribution.mean = histogram.orientation.y;
+    distribution.sampleCount = (uint64_t)histogram.orientation.z;
+    return distribution;
 }
 
 timings get_operating_frequencies() {
@@ -339,13 +764,19 @@ timings get_operating_frequencies() {
     feedbackSrv.msg_type() = "TIME";
 
     timings timingsData{};
-    if (nodeData->dataClient.call(srvData)) {
+    if (nodeData->shards[0].dataClient.call(srvData)) {
         timingsData.timeStampSec = ros::Time::now().toSec();
         timingsData.desDroneServerUpdateRate = feedbackSrv.vec3().x;
         timingsData.actualDroneServerUpdateRate = feedbackSrv.vec3().y;
         timingsData.moCapUpdateRate = feedbackSrv.vec3().z;
         timingsData.timeToUpdateDrones = feedbackSrv.forward_x();
         timingsData.waitTimePerFrame = feedbackSrv.forward_y();
+        timingsData.overruns = (uint64_t)feedbackSrv.overruns();
+        timingsData.loopPeriod = decode_timing_distribution(feedbackSrv, mdp_translations::LOOP_PERIOD_HISTOGRAM);
+        timingsData.droneUpdateTime = decode_timing_distribution(feedbackSrv, mdp_translations::UPDATE_TIME_HISTOGRAM);
+        timingsData.slack = decode_timing_distribution(feedbackSrv, mdp_translations::SLACK_HISTOGRAM);
+        timingsData.commandAdjustTime = decode_timing_distribution(feedbackSrv, mdp_translations::COMMAND_ADJUST_TIME_HISTOGRAM);
+        timingsData.avoidanceTime = decode_timing_distribution(feedbackSrv, mdp_translations::AVOIDANCE_TIME_HISTOGRAM);
     } else {
         ROS_WARN("Failed to call api data service");
     }
@@ -353,10 +784,69 @@ timings get_operating_frequencies() {
     return timingsData;
 }
 
+command_latency get_command_latency(const mdp::id& pDroneID) {
+    nav_msgs::GetPlan srvData;
+    mdp_translations::drone_feedback_srv feedbackSrv(&srvData);
+
+    feedbackSrv.drone_id().numeric_id() = pDroneID.numericID;
+    feedbackSrv.msg_type() = "LATENCY";
+
+    command_latency latencyData{};
+    if (nodeData->get_shard(pDroneID.numericID).dataClient.call(srvData)) {
+        latencyData.respectiveID = pDroneID;
+        latencyData.timeStampSec = ros::Time::now().toSec();
+        latencyData.transport = decode_timing_distribution(feedbackSrv, command_trace::TRANSPORT);
+        latencyData.server = decode_timing_distribution(feedbackSrv, command_trace::SERVER);
+        latencyData.queue = decode_timing_distribution(feedbackSrv, command_trace::QUEUE);
+        latencyData.adjust = decode_timing_distribution(feedbackSrv, command_trace::ADJUST);
+        latencyData.handle = decode_timing_distribution(feedbackSrv, command_trace::HANDLE);
+        latencyData.total = decode_timing_distribution(feedbackSrv, command_trace::TOTAL);
+    } else {
+        ROS_WARN("Failed to call api data service");
+    }
+
+    return latencyData;
+}
+
 void spin_until_rate() {
     nodeData->loopRate->sleep();
 }
 
+/**
+ * subscribes to a drone's state events if not yet subscribed
+ * @param pDroneID the drone
+ * @return the drone's state watch, its last event is null until the first event is received
+ */
+node_data::state_watch& watch_state(const mdp::id& pDroneID) {
+    auto it = nodeData->stateWatches.find(pDroneID.numericID);
+    if (it != nodeData->stateWatches.end() && it->second.subscriber) {
+        return it->second;
+    }
+
+    node_data::state_watch& watch = nodeData->stateWatches[pDroneID.numericID];
+    ros::SubscribeOptions options = ros::SubscribeOptions::create<multi_drone_platform::state_event>(
+            "mdp/drone_" + std::to_string(pDroneID.numericID) + "/state", 10,
+            boost::bind(&node_data::state_callback, nodeData, _1), ros::VoidPtr(), &nodeData->stateQueue);
+    watch.subscriber = nodeData->node->subscribe(options);
+    return watch;
+}
+
+/**
+ * returns the last state event of a drone, waiting for the latched event if the drone has not been watched before
+ * @param pDroneID the drone
+ * @return the last state event, or null if none was received
+ */
+multi_drone_platform::state_event::ConstPtr get_state_event(const mdp::id& pDroneID) {
+    node_data::state_watch& watch = watch_state(pDroneID);
+    nodeData->stateQueue.callAvailable();
+
+    ros::WallTime deadline = ros::WallTime::now() + ros::WallDuration(STATE_EVENT_TIMEOUT);
+    while (!watch.last && ros::ok() && ros::WallTime::now() < deadline) {
+        nodeData->stateQueue.callAvailable(deadline - ros::WallTime::now());
+    }
+    return watch.last;
+}
+
 void sleep_until_idle(const mdp::id& pDroneID) {
     ROS_INFO("Sleeping until drone '%s' goes idle", pDroneID.name.c_str());
     
@@ -364,37 +854,36 @@ void sleep_until_idle(const mdp::id& pDroneID) {
     nodeData->loopRate->reset();
     nodeData->loopRate->sleep();
 
-    std::string stateParam = "mdp/drone_" + std::to_string(pDroneID.numericID) + "/state";
-    std::string droneState;
-    if (!ros::param::get(stateParam, droneState)) {
+    if (!get_state_event(pDroneID)) {
         ROS_WARN("Failed to get current state of drone id: %d", pDroneID.numericID);
         return;
     }
-    while (true) {
-        if (droneState == "DELETED") break;
-        if (droneState == "LANDED") break;
-        if (droneState == "HOVERING") break;
 
-        spin_until_rate();
-        if (!ros::param::get(stateParam, droneState)) {
-            return;
+    /* block on the drone's state events rather than polling */
+    node_data::state_watch& watch = watch_state(pDroneID);
+    while (ros::ok()) {
+        nodeData->stateQueue.callAvailable();
+        switch (watch.last->state) {
+            case multi_drone_platform::state_event::DELETED:
+            case multi_drone_platform::state_event::LANDED:
+            case multi_drone_platform::state_event::HOVERING:
+                return;
+            default:
+                nodeData->stateQueue.callAvailable(ros::WallDuration(STATE_EVENT_TIMEOUT));
+                break;
         }
     }
 }
 
-const std::unordered_map<std::string, mdp::drone_state> stateMap = {
-        {"UNKNOWN", mdp::drone_state::UNKNOWN},
-        {"LANDED", mdp::drone_state::LANDED},
-        {"HOVERING", mdp::drone_state::HOVERING},
-        {"MOVING", mdp::drone_state::MOVING},
-        {"DELETED", mdp::drone_state::DELETED}
-};
-
 drone_state get_state(const mdp::id& pDroneID) {
-    std::string stateParam = "mdp/drone_" + std::to_string(pDroneID.numericID) + "/state";
-    std::string droneState;
-    if (ros::param::get(stateParam, droneState)) {
-        return stateMap.at(droneState);
+    state_board_snapshot snapshot;
+    if (read_state_board(pDroneID, snapshot)) {
+        return (drone_state)snapshot.state;
+    }
+
+    multi_drone_platform::state_event::ConstPtr event = get_state_event(pDroneID);
+    if (event) {
+        return (drone_state)event->state;
     } else {
         ROS_WARN("Failed to get current state of drone id: %d", pDroneID.numericID);
         return drone_state::DELETED;
@@ -409,7 +898,15 @@ bool velocity_data::isValid() const {
     return (this->timeStampSec > 0);
 }
 
+bool batch_result::isValid() const {
+    return (this->batchID != 0);
+}
+
 bool timings::isValid() const {
     return (this->timeStampSec > 0);
 }
+
+bool command_latency::isValid() const {
+    return (this->timeStampSec > 0);
+}
 }
\ No newline at end of file
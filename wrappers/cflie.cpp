@@ -120,13 +120,6 @@ class DRONE_WRAPPER(cflie, linkUri, droneAddress)
             this->droneAddress = (this->get_tag().substr(this->get_tag().find_first_of('_')+1));
         }
 
-
-        droneHandle.setParam("mdp/drone_" + std::to_string(this->get_id()) + "/width", this->width);
-        droneHandle.setParam("mdp/drone_" + std::to_string(this->get_id()) + "/height", this->height);
-        droneHandle.setParam("mdp/drone_" + std::to_string(this->get_id()) + "/length", this->length);
-        droneHandle.setParam("mdp/drone_" + std::to_string(this->get_id()) + "/restrictedDistance", this->restrictedDistance);
-        droneHandle.setParam("mdp/drone_" + std::to_string(this->get_id()) + "/influenceDistance", this->influenceDistance);
-
         addCrazyflieService = droneHandle.serviceClient<crazyflie_driver::AddCrazyflie>("/add_crazyflie");
         myUri = linkUri + "/0xE7E7E7E7" + droneAddress;
         crazyflie_driver::AddCrazyflie msg;
@@ -1,5 +1,6 @@
 #include "rigidbody.h"
 #include <boost/asio.hpp>
+#include <mutex>
 
 /* ensure the name of this file is identical to the name of the class, this will be the tag of the new drone. If this
  * file is included in the /wrappers/ folder, then it will automatically be compiled with the drone server. When developing
@@ -13,6 +14,9 @@ private:
     boost::asio::ip::udp::socket socket{io_service};
     boost::asio::ip::udp::endpoint endpoint;
 
+    /* on_emergency sends alongside the other wrapper functions, and an asio socket is not safe to share between threads */
+    std::mutex socketLock;
+
 
     bool send_message_to_drone(const std::string& message) {
         if (!this->socket.is_open()) {
@@ -21,6 +25,7 @@ private:
         }
 
         boost::system::error_code err;
+        std::lock_guard<std::mutex> socketGuard(socketLock);
         this->socket.send_to(boost::asio::buffer(message), this->endpoint, 0, err);
         if (err.value() != boost::system::errc::success) {
             std::stringstream ss;
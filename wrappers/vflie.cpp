@@ -1,6 +1,7 @@
 #include "rigidbody.h"
 #include <visualization_msgs/Marker.h>
 #include <Eigen/Dense>
+#include <mutex>
 
 #define ICP_TEST false
 
@@ -60,7 +61,14 @@ class DRONE_WRAPPER(vflie, homePosX, homePosY)
 
     double lastPoseUpdate = -1.0;
 
-    void publish_current_pose() {
+    /* set by on_emergency, the vflie ignores every later command while it lands */
+    bool emergencyLanding = false;
+
+    /* guards the simulated state above, as on_emergency may run alongside the other wrapper functions */
+    std::mutex simLock;
+
+    /* returns the simulated pose in the motion capture frame, simLock must be held */
+    geometry_msgs::PoseStamped current_pose() {
         geometry_msgs::Quaternion orientation = to_quaternion(this->currentYaw);
 
         geometry_msgs::PoseStamped translatedMsg;
@@ -75,7 +83,16 @@ class DRONE_WRAPPER(vflie, homePosX, homePosY)
         translatedMsg.pose.orientation.w = orientation.w;
         translatedMsg.header.frame_id = "mocap";
         translatedMsg.header.stamp = ros::Time::now();
-        this->posePub.publish(translatedMsg);
+        return translatedMsg;
+    }
+
+    /* simLock must not be held, as a lockstep vflie handles the injected pose and any resulting command right away */
+    void publish_pose(const geometry_msgs::PoseStamped& translatedMsg) {
+        if (this->isLockstep) {
+            this->inject_motion_capture(translatedMsg);
+        } else {
+            this->posePub.publish(translatedMsg);
+        }
     }
 
 #if ICP_TEST
@@ -121,6 +138,20 @@ class DRONE_WRAPPER(vflie, homePosX, homePosY)
     };
 #endif /* ICP_TEST */
 
+    /* simLock must be held */
+    void move_to(geometry_msgs::Vector3 pos, float yaw, float duration) {
+        this->moveType = move_type::POSITION;
+
+        this->desiredPositionArray[0] = pos.x;
+        this->desiredPositionArray[1] = pos.y;
+        this->desiredPositionArray[2] = pos.z;
+
+        this->desiredYaw = yaw;
+        this->currentYaw = std::fmod(this->currentYaw, 360.0);
+
+        this->endOfCommand = ros::Time::now().toSec() + duration;
+    }
+
     void pub_des() {
         geometry_msgs::PoseStamped msg;
         msg.pose.position.x = this->desiredPose.position.x;
@@ -143,11 +174,6 @@ public:
         this->height = 0.07;
         this->restrictedDistance = 0.10;
         this->influenceDistance = 0.40;
-        droneHandle.setParam("mdp/drone_" + std::to_string(this->get_id()) + "/width", this->width);
-        droneHandle.setParam("mdp/drone_" + std::to_string(this->get_id()) + "/height", this->height);
-        droneHandle.setParam("mdp/drone_" + std::to_string(this->get_id()) + "/length", this->length);
-        droneHandle.setParam("mdp/drone_" + std::to_string(this->get_id()) + "/restrictedDistance", this->restrictedDistance);
-        droneHandle.setParam("mdp/drone_" + std::to_string(this->get_id()) + "/influenceDistance", this->influenceDistance);
 
         this->posePub = this->droneHandle.advertise<geometry_msgs::PoseStamped> (get_pose_topic(this->get_tag()), 1);
         this->desPub = this->droneHandle.advertise<geometry_msgs::PoseStamped> (desPoseTopic, 1);
@@ -161,7 +187,7 @@ public:
         this->homePosition.z = 0.0;
         this->positionArray = {this->homePosition.x, this->homePosition.y, 0.0};
 
-        this->publish_current_pose();
+        this->publish_pose(this->current_pose());
     };
 
     void on_deinit() final {}
@@ -169,21 +195,15 @@ public:
     void on_set_position(geometry_msgs::Vector3 pos, 
                         float yaw,
                         float duration) override {
-
-        this->moveType = move_type::POSITION;
-
-        this->desiredPositionArray[0] = pos.x;
-        this->desiredPositionArray[1] = pos.y;
-        this->desiredPositionArray[2] = pos.z;
-
-        this->desiredYaw = yaw;
-        this->currentYaw = std::fmod(this->currentYaw, 360.0);
-
-        this->endOfCommand = ros::Time::now().toSec() + duration;
+        std::lock_guard<std::mutex> simGuard(simLock);
+        if (this->emergencyLanding) return;
+        this->move_to(pos, yaw, duration);
     }
 
     void on_set_velocity(geometry_msgs::Vector3 vel, float yawrate, float duration) override {
         //@TODO: add relative height
+        std::lock_guard<std::mutex> simGuard(simLock);
+        if (this->emergencyLanding) return;
         this->moveType = move_type::VELOCITY;
         this->currentYawRate = yawrate;
         this->endOfCommand = ros::Time::now().toSec() + duration;
@@ -194,6 +214,7 @@ public:
     }
     
     void on_update() override {
+        std::unique_lock<std::mutex> simGuard(simLock);
         if (lastPoseUpdate < 0.0) {lastPoseUpdate = ros::Time::now().toSec(); return;}
         double deltaTime = ros::Time::now().toSec() - lastPoseUpdate;
         double T = 10 * deltaTime;
@@ -253,13 +274,17 @@ public:
         this->positionArray[1] = this->positionArray[1] + (this->velocityArray[1] * deltaTime);
         this->positionArray[2] = this->positionArray[2] + (this->velocityArray[2] * deltaTime);
 
+        lastPoseUpdate = ros::Time::now().toSec();
+
 #if ICP_TEST
         this->publish_vflie_marker_set(); // enable only when testing ICP
+        simGuard.unlock();
 #else
-        this->publish_current_pose();
+        geometry_msgs::PoseStamped pose = this->current_pose();
+        simGuard.unlock();
+        this->publish_pose(pose);
 #endif
         this->pub_des();
-        lastPoseUpdate = ros::Time::now().toSec();
     }
 
     void on_takeoff(float height, float duration) override {
@@ -268,7 +293,9 @@ public:
         pos.y = this->currentPose.position.y;
         pos.z = height;
 
-        on_set_position(pos, this->currentYaw, duration);
+        std::lock_guard<std::mutex> simGuard(simLock);
+        if (this->emergencyLanding) return;
+        this->move_to(pos, this->currentYaw, duration);
     }
 
     void on_land(float duration) override {
@@ -277,16 +304,21 @@ public:
         pos.y = this->currentPose.position.y;
         pos.z = 0.0;
 
-        on_set_position(pos, this->currentYaw, duration);
+        std::lock_guard<std::mutex> simGuard(simLock);
+        if (this->emergencyLanding) return;
+        this->move_to(pos, this->currentYaw, duration);
     }
 
     void on_emergency() override {
+        /* lands from the simulated position, currentPose is written by the drone's callbacks on another thread */
+        std::lock_guard<std::mutex> simGuard(simLock);
         geometry_msgs::Vector3 pos;
-        pos.x = this->currentPose.position.x;
-        pos.y = this->currentPose.position.y;
+        pos.x = this->positionArray[0];
+        pos.y = this->positionArray[1];
         pos.z = 0.0;
 
-        on_set_position(pos, this->currentYaw, 0.5);
+        this->emergencyLanding = true;
+        this->move_to(pos, this->currentYaw, 0.5);
     }
 };
 